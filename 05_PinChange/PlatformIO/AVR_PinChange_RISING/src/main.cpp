@@ -31,7 +31,7 @@ int main() {
     cli();
     PCICR = (1 << PCIE2);
     PCMSK2 = (1 << PCINT18);
-    PCIFR |= (1 << PCIF2)
+    PCIFR |= (1 << PCIF2);
     sei();
 
     // Loop. Flashes PB5 every 5 seconds.
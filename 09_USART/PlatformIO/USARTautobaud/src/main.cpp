@@ -0,0 +1,31 @@
+#include <avr/interrupt.h>
+#include "USARTinterrupt.h"
+#include "USARTautobaud.h"
+#include "printf.h"
+
+//============================================================
+// Find the baud rate from a 'U' sent by the other end, then
+// echo what it sends. RX (D0) must be wired to ICP1 (D8).
+//============================================================
+
+int main() {
+    // Give the other end 10 seconds to send a 'U'.
+    uint32_t baudRate = USARTautobaud(10000);
+
+    if (!baudRate) {
+        baudRate = 9600;
+        USARTinit(baudRate);
+    }
+
+    sei();
+
+    printf("Talking at %lu baud, measured bit %u cycles.\n",
+           (unsigned long)baudRate, USARTautobaudCycles());
+    printf("Please type some text...\n");
+
+    while (1) {
+        int c = USARTreadByte();
+        if (c != -1)
+            USARTputChar(c);
+    }
+}
@@ -0,0 +1,112 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "USARTinterrupt.h"
+#include "USARTframe.h"
+#include "printf.h"
+
+//============================================================
+// Binary telemetry frames. Times the COBS/CRC encoder and
+// decoder against printf style text, using Timer/counter 1
+// as a clock cycle counter, then echoes received frames.
+//============================================================
+
+// Some made up sensor readings.
+typedef struct {
+    uint16_t sequence;
+    int16_t temperature;    // Hundredths of a degree.
+    int16_t pressure;       // Tenths of a millibar.
+    int16_t humidity;       // Tenths of a percent.
+} telemetry;
+
+
+//------------------------------------------------------------
+// Timer/counter 1, normal mode, no prescaler, counts clock
+// cycles. Good for up to 65535 of them.
+//------------------------------------------------------------
+void startTimer1() {
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    TCCR1B = (1 << CS10);
+}
+
+uint16_t stopTimer1() {
+    uint16_t cycles = TCNT1;
+    TCCR1B = 0;
+    return cycles;
+}
+
+
+//------------------------------------------------------------
+// Called by USARTframePoll() with each good frame received.
+// Send it straight back.
+//------------------------------------------------------------
+void echoFrame(const uint8_t *payload, uint8_t length) {
+    USARTframeSend(payload, length);
+}
+
+
+int main() {
+    uint8_t payload[64];
+    uint8_t frame[FRAME_MAX_ENCODED];
+    char text[40];
+    frameDecoder decoder;
+    uint16_t frameSize;
+    uint16_t cycles;
+    uint8_t result = FRAME_NONE;
+
+    USARTinit(115200);
+    sei();
+
+    printf("COBS/CRC-16 frame timings, in clock cycles.\n\n");
+
+    // A payload with a zero every 16 bytes.
+    for (uint8_t x = 0; x < sizeof(payload); x++)
+        payload[x] = (x & 0x0F) ? x : 0;
+
+    startTimer1();
+    frameSize = frameEncode(payload, sizeof(payload), frame);
+    cycles = stopTimer1();
+    printf("Encode %u bytes to %u: %u cycles, %u per byte.\n",
+           (unsigned)sizeof(payload), frameSize, cycles,
+           cycles / (unsigned)sizeof(payload));
+
+    frameDecoderInit(&decoder);
+    startTimer1();
+    for (uint16_t x = 0; x < frameSize; x++)
+        result = frameDecodeByte(&decoder, frame[x]);
+    cycles = stopTimer1();
+    printf("Decode %u bytes to %u: %u cycles, %u per byte, %s.\n",
+           frameSize, decoder.length, cycles,
+           cycles / frameSize,
+           result == FRAME_OK ? "CRC good" : "FAILED");
+
+    // The same readings, as text and as a binary frame.
+    telemetry reading = {1234, 2150, 10132, 456};
+
+    startTimer1();
+    uint8_t textSize = snprintf(text, sizeof(text), "%u,%d,%d,%d\n",
+                                reading.sequence,
+                                reading.temperature,
+                                reading.pressure,
+                                reading.humidity);
+    cycles = stopTimer1();
+    printf("\nTelemetry as text: %u bytes, %u cycles.\n",
+           textSize, cycles);
+
+    startTimer1();
+    frameSize = frameEncode((const uint8_t *)&reading,
+                            sizeof(reading), frame);
+    cycles = stopTimer1();
+    printf("Telemetry as a frame: %u bytes, %u cycles.\n",
+           frameSize, cycles);
+
+    printf("\nNow echoing frames, binary only from here.\n");
+    USARTflush();
+
+    USARTframeSetCallback(echoFrame);
+
+    while (1) {
+        USARTframePoll();
+    }
+}
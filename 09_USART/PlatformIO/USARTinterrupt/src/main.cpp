@@ -11,11 +11,13 @@
 //------------------------------------------------------------
 
 #include <util/delay.h>
+#include <avr/pgmspace.h>
 #include "USARTinterrupt.h"
 #include "printf.h"
 
-const char Message[] = {"Welcome to AVR interrupted"
-                        " USART communications."};
+// Kept in flash, PROGMEM, rather than copied to Static RAM.
+const char Message[] PROGMEM = {"Welcome to AVR interrupted"
+                                " USART communications."};
 
 int main() {
 
@@ -26,7 +28,7 @@ int main() {
     sei();
 
     // Write a message;
-    printf("%s\n\n", Message);
+    printf("%S\n\n", Message);
 
 
 // These lines were used in testing, feel free to uncomment
@@ -0,0 +1,73 @@
+#include <string.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "USARTinterrupt.h"
+#include "printf.h"
+
+//============================================================
+// A simple command line, using USART line mode. The RX ISR
+// echoes, edits and assembles each line, so the loop has no
+// work to do until a whole command has been typed, and sleeps
+// until then.
+//============================================================
+
+bool echo = true;
+
+
+//------------------------------------------------------------
+// Do whatever the line says.
+//------------------------------------------------------------
+void doCommand(const char *line, int length) {
+    if (!strcmp(line, "help")) {
+        printf("Commands are: help, stats, echo.\n");
+    } else if (!strcmp(line, "stats")) {
+        USARTStatsStruct stats;
+
+        USARTstats(&stats);
+        printf("Received %lu, sent %lu, dropped %u, errors %u.\n",
+               (unsigned long)stats.rxBytes,
+               (unsigned long)stats.txBytes, stats.rxDropped,
+               stats.overruns + stats.frameErrors + stats.parityErrors);
+    } else if (!strcmp(line, "echo")) {
+        // This empties the rxBuffer, but we've read it all.
+        echo = !echo;
+        USARTlineMode(true, echo);
+        printf("Echo is %s.\n", echo ? "on" : "off");
+    } else if (length) {
+        printf("You typed \"%s\", %d characters.\n", line, length);
+    }
+}
+
+
+int main() {
+    char line[64];
+
+    USARTinit(115200);
+    USARTlineMode(true, echo);
+    sei();
+
+    printf("USART line mode. Type \"help\" for help.\n> ");
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
+    while (1) {
+        // Nothing to do until a whole line has arrived. Check
+        // with interrupts off, or the RX interrupt could end
+        // the line just before we sleep, and we'd not wake up
+        // until the next one.
+        cli();
+        if (!USARTlineReady()) {
+            sleep_enable();
+            sei();          // The next instruction always runs.
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+
+        int length;
+        while ((length = USARTreadLine(line, sizeof(line))) != -1) {
+            doCommand(line, length);
+            printf("> ");
+        }
+    }
+}
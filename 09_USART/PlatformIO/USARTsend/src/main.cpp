@@ -0,0 +1,75 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "USARTinterrupt.h"
+#include "printf.h"
+
+//============================================================
+// Send a long constant message by copying it into the txBuffer,
+// then by handing USARTsend() a descriptor for it, and time
+// how long the main code is kept waiting by each.
+//============================================================
+
+const char message[] PROGMEM =
+    "This message lives in flash, and is exactly two hundred "
+    "bytes long. Copying it all into the txBuffer takes 200 calls "
+    "to cBufferAdd(), and most of them have to wait. Sent by "
+    "descriptor, it takes none.\n";
+
+bool messageSent = false;
+
+
+//------------------------------------------------------------
+// Timer/counter 1, normal mode, divide by 64. At 16 MHz, that's
+// a tick every 4 microseconds, for up to 262 milliseconds.
+//------------------------------------------------------------
+void startTimer1() {
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    TCCR1B = (1 << CS11) | (1 << CS10);
+}
+
+uint16_t stopTimer1() {
+    uint16_t ticks = TCNT1;
+    TCCR1B = 0;
+    return ticks;
+}
+
+
+//------------------------------------------------------------
+// Called by USARTsendPoll() once the last byte of the message
+// has gone to UDR0.
+//------------------------------------------------------------
+void sent(const void *) {
+    messageSent = true;
+}
+
+
+int main() {
+    uint16_t ticks;
+
+    USARTinit(115200);
+    sei();
+
+    // The old way, a byte at a time, through the txBuffer.
+    startTimer1();
+    for (uint16_t x = 0; x < sizeof(message) - 1; x++)
+        USARTputChar(pgm_read_byte(&message[x]));
+    ticks = stopTimer1();
+
+    USARTflush();
+    printf("Copied: main code waited %u ticks.\n\n", ticks);
+
+    // The new way, by descriptor, straight from flash.
+    startTimer1();
+    USARTsend(message, sizeof(message) - 1, USART_TX_PROGMEM, sent);
+    ticks = stopTimer1();
+
+    while (!messageSent)
+        USARTsendPoll();
+    printf("By descriptor: main code waited %u ticks.\n", ticks);
+    USARTflush();
+
+    while (1) ;
+}
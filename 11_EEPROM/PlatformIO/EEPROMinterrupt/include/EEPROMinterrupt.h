@@ -62,5 +62,10 @@ EEPROMerror EEPROMupdate(const uint8_t *buffer,
                          const uint16_t dataSize, 
                          const uint16_t writeAddress);                        
 
+// As EEPROMupdate(), but the data are in flash (PROGMEM).
+EEPROMerror EEPROMupdate_P(const uint8_t *buffer, 
+                           const uint16_t dataSize, 
+                           const uint16_t writeAddress);
+
 #endif // EEPROMINTERRUPT_H
 
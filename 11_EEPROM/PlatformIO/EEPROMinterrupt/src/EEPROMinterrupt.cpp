@@ -1,4 +1,5 @@
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include "EEPROMinterrupt.h"
 
 volatile EEPROMinfo_t EEPROMinfo;
@@ -116,6 +117,73 @@ EEPROMerror EEPROMupdate(const uint8_t *buffer,
 }
 
 
+EEPROMerror EEPROMupdate_P(const uint8_t *buffer, 
+                           const uint16_t dataSize, 
+                           const uint16_t writeAddress) {
+                            
+    // Is EEPROM busy?
+    if (EEPROMinfo.status != EEPROM_ready) {
+        return EEPROM_busy;
+    }
+
+    // Anything to write?
+    if (!dataSize) {
+        return EEPROM_dataSize;
+    }
+
+    // EEPROM address out of range?
+    if ((writeAddress > E2END) || 
+        (writeAddress + dataSize > E2END)) {
+       return EEPROM_addressError;
+    }
+
+    // Buffers for each character read from EEPROM and flash.
+    uint8_t oneCharacter;
+    uint8_t flashCharacter;
+
+    // Result of the read/write.
+    EEPROMerror result;
+
+    // How many bytes did we write?
+    uint16_t bytesProcessed = 0;
+
+    // As EEPROMupdate(), but the ISR can't read flash, so
+    // each byte that differs is copied to RAM and written
+    // from there.
+    for (uint16_t x = 0; x < dataSize; x++) {
+        result = EEPROMread(&oneCharacter, 
+                            1, 
+                            (x + writeAddress), 
+                            true);
+                            
+        if (result != EEPROM_noError)
+            return result;
+         
+        flashCharacter = pgm_read_byte(&buffer[x]);
+        if (oneCharacter != flashCharacter) {
+            result = EEPROMwrite(&flashCharacter, 
+                                 1, 
+                                 (x + writeAddress), 
+                                 true);
+                                 
+            if (result != EEPROM_noError)
+                return result;
+
+            bytesProcessed++;
+        }        
+    }
+
+    // Fiddle in the EEPROMinfo structure to show the
+    // original requested bytes and buffers etc.
+    EEPROMinfo.bufferAddress = (uint8_t *)buffer;
+    EEPROMinfo.dataSize = dataSize;
+    EEPROMinfo.rwAddress = writeAddress;
+    EEPROMinfo.currentByte = dataSize + 1;
+    EEPROMinfo.bytesProcessed = bytesProcessed;
+    return EEPROM_noError;
+}
+
+
 EEPROMerror EEPROMread(const uint8_t *buffer, 
                        const uint16_t dataSize, 
                        const uint16_t readAddress,
@@ -14,12 +14,14 @@
 #include "EEPROMinterrupt.h"
 #include "USARTinterrupt.h"
 #include <util/delay.h>
+#include <avr/pgmspace.h>
 #include <string.h>
 
 
 #define EEPROM_ADDRESS (const uint8_t)0
-const char Message[] = {"Greetings Interrupted AVR"
-                        " EEPROM world!!"};
+// Kept in flash, PROGMEM, rather than copied to Static RAM.
+const char Message[] PROGMEM = {"Greetings Interrupted AVR"
+                                " EEPROM world!!"};
 
 #define READ_THIS_MUCH_DATA 40
 char loopBuffer[READ_THIS_MUCH_DATA + 1];
@@ -39,9 +41,9 @@ int main() {
 
     EEPROMerror result;
     
-    result = EEPROMupdate((const uint8_t *)Message,
-                           strlen(Message), 
-                           EEPROM_ADDRESS);
+    result = EEPROMupdate_P((const uint8_t *)Message,
+                             strlen_P(Message), 
+                             EEPROM_ADDRESS);
 
     if (result != EEPROM_noError) {
         USARTwriteText("In main(), EEPROMupdate() error: ");
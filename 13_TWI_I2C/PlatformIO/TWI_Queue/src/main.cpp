@@ -0,0 +1,111 @@
+//------------------------------------------------------------
+// Read four LM75A temperature sensors, at 0x48 to 0x4B, with
+// the TWIlib transaction queue. The interrupt handler chains
+// the four reads together, and the main code is free to do
+// other things until they are all done.
+//------------------------------------------------------------
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "USARTinterrupt.h"
+#include "TWIlib.h"
+
+#define SENSORS 4
+#define FIRST_SENSOR 0x48
+
+// The LM75A temperature register.
+uint8_t temperatureRegister = 0x00;
+
+// Where each sensor's reading, and how it went, end up.
+uint8_t temperature[SENSORS][2];
+volatile uint8_t result[SENSORS];
+volatile uint8_t finished = 0;
+
+
+//------------------------------------------------------------
+// Timer/counter 1 in CTC mode, divide by 64, interrupts every
+// 250 ticks, or every millisecond at 16 MHz. TWITick() gives
+// up on a hung read after TWI_TIMEOUT_TICKS of them.
+//------------------------------------------------------------
+void startTimer1() {
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    OCR1A = (F_CPU / 64 / 1000) - 1;
+    TIMSK1 = (1 << OCIE1A);
+    TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10);
+}
+
+ISR(TIMER1_COMPA_vect) {
+    TWITick();
+}
+
+
+//------------------------------------------------------------
+// Called by the TWI ISR as each read finishes. The context
+// is the sensor's number.
+//------------------------------------------------------------
+void readDone(uint8_t errorCode, void *context) {
+    result[(uintptr_t)context] = errorCode;
+    finished++;
+}
+
+
+int main() {
+    USARTinit(9600);
+    sei();
+    // The LM75A can do 400 KHz. TWBR and the prescaler are
+    // worked out at compile time.
+    TWIInit<400000>();
+    startTimer1();
+
+    // A slave left half way through a byte by a reset would
+    // block the bus. Make sure it's free.
+    TWIRecoverBus();
+
+    printf("\nLM75A Transaction Queue Example\n");
+    printf("SCL is %lu Hz\n\n", (unsigned long)SCLfreqHz());
+
+    while (1) {
+        finished = 0;
+
+        // Queue a read of each sensor. The queue holds four,
+        // by default, so none of these has to wait.
+        for (uint8_t sensor = 0; sensor < SENSORS; sensor++) {
+            while (TWIWriteRead(FIRST_SENSOR + sensor,
+                                &temperatureRegister, 1,
+                                temperature[sensor], 2,
+                                readDone, (void *)(uintptr_t)sensor) ==
+                   TWI_TX_RX_NOT_READY)
+                ;
+        }
+
+        // Something useful would go here. We just count.
+        uint32_t spins = 0;
+        while (finished < SENSORS)
+            spins++;
+
+        for (uint8_t sensor = 0; sensor < SENSORS; sensor++) {
+            printf("0x%02X: ", FIRST_SENSOR + sensor);
+
+            if (result[sensor] == TWI_SUCCESS) {
+                printf("%d%s\n", (int8_t)temperature[sensor][0],
+                       temperature[sensor][1] & 0x80 ? ".5" : ".0");
+            } else {
+                printf("Error 0x%02X\n", result[sensor]);
+            }
+        }
+
+        printf("Main loop went round %lu times while reading.\n",
+               (unsigned long)spins);
+
+        // Any of these going up means trouble on the bus.
+        TWIStatsStruct stats;
+        TWIStats(&stats);
+        printf("Timeouts: %u, recoveries: %u, stuck: %u\n\n",
+               stats.timeouts, stats.recoveries, stats.stuck);
+
+        _delay_ms(5000);
+    }
+}
@@ -0,0 +1,104 @@
+//------------------------------------------------------------
+// Read four LM75A temperature sensors, at 0x48 to 0x4B, each
+// at its own rate, with the TWIscheduler library. All the
+// reading is done by interrupts, the main code only prints
+// the results.
+//------------------------------------------------------------
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "USARTinterrupt.h"
+#include "TWIlib.h"
+#include "TWIscheduler.h"
+
+#define SENSORS 4
+#define FIRST_SENSOR 0x48
+
+// What to read from each LM75A. The temperature register,
+// two bytes, then the configuration register, one byte.
+const TWIschedStep lm75Script[] = {
+    {0x00, 2},
+    {0x01, 1}
+};
+
+// How often to read each one, in milliseconds.
+const uint16_t periods[SENSORS] = {100, 250, 500, 1000};
+
+TWIschedDevice sensors[SENSORS];
+uint8_t readings[SENSORS][3];
+
+
+//------------------------------------------------------------
+// Timer/counter 1 in CTC mode, divide by 64, interrupts every
+// 250 ticks, or every millisecond at 16 MHz.
+//------------------------------------------------------------
+void startTimer1() {
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    OCR1A = (F_CPU / 64 / 1000) - 1;
+    TIMSK1 = (1 << OCIE1A);
+    TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10);
+}
+
+ISR(TIMER1_COMPA_vect) {
+    TWITick();
+    TWIschedTick();
+}
+
+
+int main() {
+    USARTinit(9600);
+    sei();
+    TWIInit<400000>();
+    TWIRecoverBus();
+    TWIschedInit();
+
+    printf("\nLM75A Scheduler Example\n\n");
+
+    for (uint8_t sensor = 0; sensor < SENSORS; sensor++) {
+        if (!TWIschedAdd(&sensors[sensor], FIRST_SENSOR + sensor,
+                         periods[sensor], lm75Script, 2,
+                         readings[sensor])) {
+            printf("0x%02X: can't be read every %u ms\n",
+                   FIRST_SENSOR + sensor, periods[sensor]);
+        }
+    }
+
+    startTimer1();
+
+    while (1) {
+        _delay_ms(5000);
+
+        for (uint8_t sensor = 0; sensor < SENSORS; sensor++) {
+            uint8_t data[3];
+            uint8_t result = TWIschedFetch(&sensors[sensor], data);
+
+            printf("0x%02X: ", FIRST_SENSOR + sensor);
+
+            if (result == TWI_SUCCESS) {
+                printf("%d%s (config 0x%02X)", (int8_t)data[0],
+                       data[1] & 0x80 ? ".5" : ".0", data[2]);
+            } else if (result == TWI_NO_RELEVANT_INFO) {
+                printf("No new reading");
+            } else {
+                printf("Error 0x%02X", result);
+            }
+
+            // Start the stats again, for the next five seconds.
+            TWIschedStatsStruct stats;
+            TWIschedStats(&sensors[sensor], &stats, true);
+
+            printf(", %u read, %u failed, %u skipped, "
+                   "%lu.%03lu Hz, jitter %lu us max, %lu us mean\n",
+                   stats.samples, stats.errors, stats.skipped,
+                   (unsigned long)(stats.rateMilliHz / 1000),
+                   (unsigned long)(stats.rateMilliHz % 1000),
+                   (unsigned long)stats.jitterMaxUs,
+                   (unsigned long)stats.jitterMeanUs);
+        }
+
+        printf("\n");
+    }
+}
@@ -0,0 +1,97 @@
+//------------------------------------------------------------
+// Make the Uno an I2C slave, at address 0x20, with a bank of
+// eight registers that any master can read and write. The
+// TWI interrupt handler does all the work.
+//
+// 0     - LED on D13, 1 = on, 0 = off.
+// 1 - 3 - Free for the master to use.
+// 4 - 5 - Seconds since reset, high byte first.
+// 6     - Count of writes by the master.
+// 7     - Always 0x5A, to identify us.
+//------------------------------------------------------------
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+#include "USARTinterrupt.h"
+#include "TWIlib.h"
+
+#define SLAVE_ADDRESS 0x20
+
+#define REG_LED 0
+#define REG_SECONDS 4
+#define REG_WRITES 6
+#define REG_ID 7
+
+volatile uint8_t registers[8];
+
+// Set by the callback, for the main loop.
+volatile bool changed = false;
+volatile uint8_t changedFirst;
+volatile uint8_t changedCount;
+
+
+//------------------------------------------------------------
+// Called by the TWI ISR when a master has written to the
+// registers. Keep it short, the bus waits for us.
+//------------------------------------------------------------
+void registersWritten(uint8_t reg, uint8_t count) {
+    changedFirst = reg;
+    changedCount = count;
+    changed = true;
+    registers[REG_WRITES]++;
+}
+
+
+int main() {
+    USARTinit(9600);
+    sei();
+
+    DDRB |= (1 << DDB5);
+
+    registers[REG_ID] = 0x5A;
+    TWIInit();
+    TWISlaveInit(SLAVE_ADDRESS, registers, sizeof(registers),
+                 registersWritten);
+
+    printf("\nTWI Slave Example, at address 0x%02X\n\n", SLAVE_ADDRESS);
+
+    uint16_t seconds = 0;
+    uint8_t ticks = 0;
+
+    while (1) {
+        _delay_ms(10);
+
+        // The master may read the count at any time, so both
+        // bytes must change together.
+        if (++ticks == 100) {
+            ticks = 0;
+            seconds++;
+
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                registers[REG_SECONDS] = seconds >> 8;
+                registers[REG_SECONDS + 1] = seconds & 0xFF;
+            }
+        }
+
+        if (!changed)
+            continue;
+
+        uint8_t first, count;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            first = changedFirst;
+            count = changedCount;
+            changed = false;
+        }
+
+        printf("Registers %u to %u written.\n",
+               first, first + count - 1);
+
+        if (registers[REG_LED]) {
+            PORTB |= (1 << PORTB5);
+        } else {
+            PORTB &= ~(1 << PORTB5);
+        }
+    }
+}
@@ -34,8 +34,12 @@ void cBufferInit(circularBuffer *buf) {
 uint8_t cBufferBytesUsed(circularBuffer *buf) {
 
     // Return number of bytes written to buffer so far.
+#ifdef CBUFFER_FULL_CAPACITY
+    return (uint8_t)(buf->headIndex - buf->tailIndex);
+#else
     return ((BUFFER_SIZE + buf->headIndex - buf->tailIndex) %
             BUFFER_SIZE);
+#endif
 }
 
 
@@ -45,9 +49,14 @@ uint8_t cBufferBytesUsed(circularBuffer *buf) {
 //------------------------------------------------------------
 uint8_t cBufferBytesFree(circularBuffer *buf) {
 
+#ifdef CBUFFER_FULL_CAPACITY
+    // Return BUFFER_SIZE minus space used.
+    return (BUFFER_SIZE - cBufferBytesUsed(buf));
+#else
     // Return BUFFER_SIZE minus space used minus 1.
     return (BUFFER_SIZE - 1 - 
             cBufferBytesUsed(buf));
+#endif
 }
 
 
@@ -58,9 +67,14 @@ bool cBufferAdd(circularBuffer *buf, uint8_t aByte) {
 
     // Any free space? Add the byte.
     if (!cBufferFull(buf)) {
+#ifdef CBUFFER_FULL_CAPACITY
+        buf->cBuffer[buf->headIndex % BUFFER_SIZE] = aByte;
+        buf->headIndex++;
+#else
         uint8_t nextPut = (buf->headIndex + 1) % BUFFER_SIZE;
         buf->cBuffer[nextPut] = aByte;
         buf->headIndex = nextPut;
+#endif
         return true;
     }
     
@@ -76,9 +90,14 @@ bool cBufferGet(circularBuffer *buf, uint8_t *aByte) {
 
    // Test if buffer is empty? If not, fetch a byte.
     if (!cBufferEmpty(buf)) {
+#ifdef CBUFFER_FULL_CAPACITY
+        *aByte = buf->cBuffer[buf->tailIndex % BUFFER_SIZE];
+        buf->tailIndex++;
+#else
         uint8_t nextGet = (buf->tailIndex + 1) % BUFFER_SIZE;
         *aByte = buf->cBuffer[nextGet];
         buf->tailIndex = nextGet;
+#endif
         return true;
     }
 
@@ -97,9 +116,14 @@ bool cBufferEmpty(circularBuffer *buf) {
 
 //------------------------------------------------------------
 // Is this buffer full? If ((head + 1) MOD BUFFER_SIZE) == Tail
+// or, in full capacity mode, if head - tail == BUFFER_SIZE.
 //------------------------------------------------------------
 bool cBufferFull(circularBuffer *buf) {
+#ifdef CBUFFER_FULL_CAPACITY
+    return cBufferBytesUsed(buf) == BUFFER_SIZE;
+#else
     return (buf->headIndex + 1) % BUFFER_SIZE == 
                  buf->tailIndex;
+#endif
 }
 
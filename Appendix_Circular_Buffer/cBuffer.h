@@ -43,6 +43,32 @@
 //
 // Bytes free is buffer_Size - 1 - bytes used so far.
 //============================================================
+// FULL CAPACITY MODE
+//
+// Define CBUFFER_FULL_CAPACITY, at the top of this file, or
+// with "-DCBUFFER_FULL_CAPACITY" on the compiler command line,
+// and a buffer of size 'n' holds all 'n' bytes.
+//
+// HEAD and TAIL are then free running counters, never reset
+// to zero. HEAD counts the bytes ever added and TAIL counts
+// the bytes ever removed. Both simply roll over from 255 to
+// 0, and as the arithmetic is all uint8_t, HEAD - TAIL is
+// still correct after they do.
+//
+// The buffer is EMPTY when HEAD == TAIL.
+//
+// The buffer is FULL when HEAD - TAIL == buffer_size.
+//
+// The next byte is added at HEAD MOD buffer_size, and read
+// from TAIL MOD buffer_size.
+//
+// Bytes used so far is HEAD - TAIL.
+//
+// Bytes free is buffer_size - bytes used so far.
+//
+// HEAD - TAIL can only go up to 255, so in this mode the
+// buffer size must be a power of 2, and 128 at most.
+//============================================================
 
 
 //------------------------------------------------------------
@@ -54,6 +80,11 @@
 //------------------------------------------------------------
 #define BUFFER_SIZE 32
 
+#if defined(CBUFFER_FULL_CAPACITY) && \
+    ((BUFFER_SIZE > 128) || (BUFFER_SIZE & (BUFFER_SIZE - 1)))
+    #error "Full capacity mode needs a power of 2 BUFFER_SIZE, <= 128."
+#endif
+
 
 //------------------------------------------------------------
 // The actual buffer. Contains its own head and tail indexes.
@@ -67,6 +98,9 @@
 // tailIndex is the byte position where the most recent byte
 // was removed. This is incremented just before getting the
 // next byte from the buffer.
+//
+// In full capacity mode, they are the counts of bytes added
+// and removed, as above.
 //------------------------------------------------------------
 typedef struct circularBuffer {
     uint8_t headIndex;
@@ -16,6 +16,14 @@
 #include <stdio.h>
 #include "cBuffer.h"
 
+// Space that can never be used, one byte unless running in
+// full capacity mode.
+#ifdef CBUFFER_FULL_CAPACITY
+    #define BUFFER_SPARE 0
+#else
+    #define BUFFER_SPARE 1
+#endif
+
 
 void displayBufferSpace(circularBuffer *buf) {
 
@@ -108,6 +116,60 @@ int main() {
     // Check the available space.
     displayBufferSpace(buf);
 
+
+    // Stream 1,000 bytes through the buffer, 7 in and 5 out,
+    // then 5 in and 7 out, checking that every byte comes out
+    // in order and the counts always add up. The indexes wrap
+    // many times over, and in full capacity mode they roll
+    // over from 255 to 0.
+    printf("\n5. Streaming 1000 bytes through the buffer.....\n\n");
+
+    cBufferInit(buf);
+
+    uint16_t written = 0;
+    uint16_t read = 0;
+    uint16_t errors = 0;
+    uint8_t rollOvers = 0;
+
+    while (read < 1000) {
+        uint8_t adds = (read & 0x100) ? 5 : 7;
+        uint8_t gets = (read & 0x100) ? 7 : 5;
+        uint8_t oldHead = buf->headIndex;
+
+        for (uint8_t x = 0; x < adds && written < 1000; x++) {
+            if (cBufferFull(buf))
+                break;
+
+            cBufferAdd(buf, (uint8_t)written);
+            written++;
+        }
+
+        if (buf->headIndex < oldHead)
+            rollOvers++;
+
+        for (uint8_t x = 0; x < gets; x++) {
+            uint8_t ch;
+
+            if (!cBufferGet(buf, &ch))
+                break;
+
+            if (ch != (uint8_t)read)
+                errors++;
+
+            read++;
+        }
+
+        if (cBufferBytesUsed(buf) != (uint8_t)(written - read) ||
+            cBufferBytesUsed(buf) + cBufferBytesFree(buf) !=
+                BUFFER_SIZE - BUFFER_SPARE)
+            errors++;
+    }
+
+    printf("Wrote %d, read %d, head wrapped %d times, %d errors.\n",
+           written, read, rollOvers, errors);
+
+    displayBufferSpace(buf);
+
 }
 
 
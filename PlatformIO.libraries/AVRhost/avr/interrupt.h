@@ -0,0 +1,56 @@
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+//============================================================
+// Host (Linux) replacement for <avr/interrupt.h>.
+//
+// ISR(USART_RX_vect) defines a function named __vector_18,
+// as it does on the AVR. The simulator's interrupt thread
+// calls it whenever the interrupt is enabled, its flag is set
+// and global interrupts are on. Interrupts are dispatched in
+// vector order, lowest first, one at a time.
+//============================================================
+
+#include <avr/io.h>
+
+
+//------------------------------------------------------------
+// Global interrupt enable and disable. cli() does not return
+// until any interrupt handler already running has finished.
+//------------------------------------------------------------
+void hostSei();
+void hostCli();
+
+#define sei() hostSei()
+#define cli() hostCli()
+
+
+//------------------------------------------------------------
+// Interrupt handler definitions. The attributes are accepted
+// and ignored - interrupts never nest in the simulator.
+//------------------------------------------------------------
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define ISR_FLATTEN
+#define ISR_ALIASOF(v)
+
+#ifdef __cplusplus
+    #define ISR(vector, ...) \
+        extern "C" void vector(void); \
+        void vector(void)
+#else
+    #define ISR(vector, ...) \
+        void vector(void); \
+        void vector(void)
+#endif
+
+#define SIGNAL(vector) ISR(vector)
+#define EMPTY_INTERRUPT(vector) ISR(vector) {}
+#define ISR_ALIAS(vector, target) ISR(vector) { target(); }
+
+#define reti() return
+
+#define BADISR_vect __vector_default
+
+#endif // HOST_AVR_INTERRUPT_H
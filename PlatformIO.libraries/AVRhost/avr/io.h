@@ -0,0 +1,528 @@
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+//============================================================
+// Host (Linux) replacement for <avr/io.h>, ATmega328P only.
+//
+// The register names are the same as avr-libc's, but each one
+// is a hostRegister object belonging to the peripheral model
+// in hostSim.cpp, rather than a memory address. The bit names
+// and vector names are exactly as in avr-libc's iom328p.h so
+// the book's code compiles unchanged.
+//
+// Only the peripherals used in the book are modelled, the
+// others are missing, so code using them fails to compile
+// rather than silently doing nothing.
+//============================================================
+
+#include <stdint.h>
+#include "hostRegister.h"
+
+
+//------------------------------------------------------------
+// avr-libc's <avr/sfr_defs.h> helpers.
+//------------------------------------------------------------
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit) do { } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) do { } while (bit_is_set(sfr, bit))
+
+
+//------------------------------------------------------------
+// Memory sizes.
+//------------------------------------------------------------
+#define RAMSTART     0x100
+#define RAMEND       0x8FF
+#define XRAMEND      RAMEND
+#define E2END        0x3FF
+#define E2PAGESIZE   4
+#define FLASHEND     0x7FFF
+#define SPM_PAGESIZE 128
+
+
+//------------------------------------------------------------
+// Status register. Only the I bit is modelled.
+//------------------------------------------------------------
+extern hostRegister8 SREG;
+#define SREG_I 7
+
+
+//------------------------------------------------------------
+// General purpose I/O registers.
+//------------------------------------------------------------
+extern hostRegister8 GPIOR0;
+extern hostRegister8 GPIOR1;
+extern hostRegister8 GPIOR2;
+
+
+//------------------------------------------------------------
+// Ports B, C and D.
+//------------------------------------------------------------
+extern hostRegister8 PINB;
+extern hostRegister8 DDRB;
+extern hostRegister8 PORTB;
+extern hostRegister8 PINC;
+extern hostRegister8 DDRC;
+extern hostRegister8 PORTC;
+extern hostRegister8 PIND;
+extern hostRegister8 DDRD;
+extern hostRegister8 PORTD;
+
+#define PINB0 0
+#define PINB1 1
+#define PINB2 2
+#define PINB3 3
+#define PINB4 4
+#define PINB5 5
+#define PINB6 6
+#define PINB7 7
+
+#define DDB0 0
+#define DDB1 1
+#define DDB2 2
+#define DDB3 3
+#define DDB4 4
+#define DDB5 5
+#define DDB6 6
+#define DDB7 7
+
+#define PORTB0 0
+#define PORTB1 1
+#define PORTB2 2
+#define PORTB3 3
+#define PORTB4 4
+#define PORTB5 5
+#define PORTB6 6
+#define PORTB7 7
+
+#define PINC0 0
+#define PINC1 1
+#define PINC2 2
+#define PINC3 3
+#define PINC4 4
+#define PINC5 5
+#define PINC6 6
+
+#define DDC0 0
+#define DDC1 1
+#define DDC2 2
+#define DDC3 3
+#define DDC4 4
+#define DDC5 5
+#define DDC6 6
+
+#define PORTC0 0
+#define PORTC1 1
+#define PORTC2 2
+#define PORTC3 3
+#define PORTC4 4
+#define PORTC5 5
+#define PORTC6 6
+
+#define PIND0 0
+#define PIND1 1
+#define PIND2 2
+#define PIND3 3
+#define PIND4 4
+#define PIND5 5
+#define PIND6 6
+#define PIND7 7
+
+#define DDD0 0
+#define DDD1 1
+#define DDD2 2
+#define DDD3 3
+#define DDD4 4
+#define DDD5 5
+#define DDD6 6
+#define DDD7 7
+
+#define PORTD0 0
+#define PORTD1 1
+#define PORTD2 2
+#define PORTD3 3
+#define PORTD4 4
+#define PORTD5 5
+#define PORTD6 6
+#define PORTD7 7
+
+// <avr/portpins.h> short names.
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+
+//------------------------------------------------------------
+// External interrupts INT0 and INT1.
+//------------------------------------------------------------
+extern hostRegister8 EICRA;
+extern hostRegister8 EIMSK;
+extern hostRegister8 EIFR;
+
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+
+#define INT0 0
+#define INT1 1
+
+#define INTF0 0
+#define INTF1 1
+
+
+//------------------------------------------------------------
+// Pin change interrupts.
+//------------------------------------------------------------
+extern hostRegister8 PCICR;
+extern hostRegister8 PCIFR;
+extern hostRegister8 PCMSK0;
+extern hostRegister8 PCMSK1;
+extern hostRegister8 PCMSK2;
+
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+
+#define PCIF0 0
+#define PCIF1 1
+#define PCIF2 2
+
+#define PCINT0 0
+#define PCINT1 1
+#define PCINT2 2
+#define PCINT3 3
+#define PCINT4 4
+#define PCINT5 5
+#define PCINT6 6
+#define PCINT7 7
+
+#define PCINT8 0
+#define PCINT9 1
+#define PCINT10 2
+#define PCINT11 3
+#define PCINT12 4
+#define PCINT13 5
+#define PCINT14 6
+
+#define PCINT16 0
+#define PCINT17 1
+#define PCINT18 2
+#define PCINT19 3
+#define PCINT20 4
+#define PCINT21 5
+#define PCINT22 6
+#define PCINT23 7
+
+
+//------------------------------------------------------------
+// Power reduction, MCU status and sleep mode control.
+//------------------------------------------------------------
+extern hostRegister8 PRR;
+extern hostRegister8 MCUSR;
+extern hostRegister8 SMCR;
+
+#define PRADC 0
+#define PRUSART0 1
+#define PRSPI 2
+#define PRTIM1 3
+#define PRTIM0 5
+#define PRTIM2 6
+#define PRTWI 7
+
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+
+#define SE 0
+#define SM0 1
+#define SM1 2
+#define SM2 3
+
+
+//------------------------------------------------------------
+// Watchdog timer.
+//------------------------------------------------------------
+extern hostRegister8 WDTCSR;
+
+#define WDP0 0
+#define WDP1 1
+#define WDP2 2
+#define WDE 3
+#define WDCE 4
+#define WDP3 5
+#define WDIE 6
+#define WDIF 7
+
+
+//------------------------------------------------------------
+// EEPROM.
+//------------------------------------------------------------
+extern hostRegister8 EECR;
+extern hostRegister8 EEDR;
+extern hostRegister16 EEAR;
+
+#define EERE 0
+#define EEPE 1
+#define EEMPE 2
+#define EERIE 3
+#define EEPM0 4
+#define EEPM1 5
+
+
+//------------------------------------------------------------
+// Timer/counter 1.
+//------------------------------------------------------------
+extern hostRegister8 TCCR1A;
+extern hostRegister8 TCCR1B;
+extern hostRegister8 TCCR1C;
+extern hostRegister16 TCNT1;
+extern hostRegister16 ICR1;
+extern hostRegister16 OCR1A;
+extern hostRegister16 OCR1B;
+extern hostRegister8 TIMSK1;
+extern hostRegister8 TIFR1;
+
+#define WGM10 0
+#define WGM11 1
+#define COM1B0 4
+#define COM1B1 5
+#define COM1A0 6
+#define COM1A1 7
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define ICES1 6
+#define ICNC1 7
+
+#define FOC1B 6
+#define FOC1A 7
+
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+#define ICIE1 5
+
+#define TOV1 0
+#define OCF1A 1
+#define OCF1B 2
+#define ICF1 5
+
+
+//------------------------------------------------------------
+// SPI.
+//------------------------------------------------------------
+extern hostRegister8 SPCR;
+extern hostRegister8 SPSR;
+extern hostRegister8 SPDR;
+
+#define SPR0 0
+#define SPR1 1
+#define CPHA 2
+#define CPOL 3
+#define MSTR 4
+#define DORD 5
+#define SPE 6
+#define SPIE 7
+
+#define SPI2X 0
+#define WCOL 6
+#define SPIF 7
+
+
+//------------------------------------------------------------
+// Analog comparator.
+//------------------------------------------------------------
+extern hostRegister8 ACSR;
+extern hostRegister8 DIDR1;
+
+#define ACIS0 0
+#define ACIS1 1
+#define ACIC 2
+#define ACIE 3
+#define ACI 4
+#define ACO 5
+#define ACBG 6
+#define ACD 7
+
+#define AIN0D 0
+#define AIN1D 1
+
+
+//------------------------------------------------------------
+// Analog to digital converter. ADC and ADCW are the same 16
+// bit result register, as in avr-libc.
+//------------------------------------------------------------
+extern hostRegister16 ADCW;
+extern hostRegister8 ADCL;
+extern hostRegister8 ADCH;
+extern hostRegister8 ADCSRA;
+extern hostRegister8 ADCSRB;
+extern hostRegister8 ADMUX;
+extern hostRegister8 DIDR0;
+
+#define ADC ADCW
+
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+#define ACME 6
+
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+
+#define ADC0D 0
+#define ADC1D 1
+#define ADC2D 2
+#define ADC3D 3
+#define ADC4D 4
+#define ADC5D 5
+
+
+//------------------------------------------------------------
+// Two wire interface.
+//------------------------------------------------------------
+extern hostRegister8 TWBR;
+extern hostRegister8 TWSR;
+extern hostRegister8 TWAR;
+extern hostRegister8 TWDR;
+extern hostRegister8 TWCR;
+extern hostRegister8 TWAMR;
+
+#define TWPS0 0
+#define TWPS1 1
+#define TWS3 3
+#define TWS4 4
+#define TWS5 5
+#define TWS6 6
+#define TWS7 7
+
+#define TWGCE 0
+#define TWA0 1
+#define TWA1 2
+#define TWA2 3
+#define TWA3 4
+#define TWA4 5
+#define TWA5 6
+#define TWA6 7
+
+#define TWIE 0
+#define TWEN 2
+#define TWWC 3
+#define TWSTO 4
+#define TWSTA 5
+#define TWEA 6
+#define TWINT 7
+
+
+//------------------------------------------------------------
+// USART0.
+//------------------------------------------------------------
+extern hostRegister8 UCSR0A;
+extern hostRegister8 UCSR0B;
+extern hostRegister8 UCSR0C;
+extern hostRegister16 UBRR0;
+extern hostRegister8 UDR0;
+
+#define MPCM0 0
+#define U2X0 1
+#define UPE0 2
+#define DOR0 3
+#define FE0 4
+#define UDRE0 5
+#define TXC0 6
+#define RXC0 7
+
+#define TXB80 0
+#define RXB80 1
+#define UCSZ02 2
+#define TXEN0 3
+#define RXEN0 4
+#define UDRIE0 5
+#define TXCIE0 6
+#define RXCIE0 7
+
+#define UCPOL0 0
+#define UCSZ00 1
+#define UCSZ01 2
+#define USBS0 3
+#define UPM00 4
+#define UPM01 5
+#define UMSEL00 6
+#define UMSEL01 7
+
+
+//------------------------------------------------------------
+// Interrupt vectors. Numbered as in the data sheet, minus
+// one, exactly as avr-libc does it.
+//------------------------------------------------------------
+#define _VECTOR(N) __vector_ ## N
+
+#define INT0_vect         _VECTOR(1)
+#define INT1_vect         _VECTOR(2)
+#define PCINT0_vect       _VECTOR(3)
+#define PCINT1_vect       _VECTOR(4)
+#define PCINT2_vect       _VECTOR(5)
+#define WDT_vect          _VECTOR(6)
+#define TIMER2_COMPA_vect _VECTOR(7)
+#define TIMER2_COMPB_vect _VECTOR(8)
+#define TIMER2_OVF_vect   _VECTOR(9)
+#define TIMER1_CAPT_vect  _VECTOR(10)
+#define TIMER1_COMPA_vect _VECTOR(11)
+#define TIMER1_COMPB_vect _VECTOR(12)
+#define TIMER1_OVF_vect   _VECTOR(13)
+#define TIMER0_COMPA_vect _VECTOR(14)
+#define TIMER0_COMPB_vect _VECTOR(15)
+#define TIMER0_OVF_vect   _VECTOR(16)
+#define SPI_STC_vect      _VECTOR(17)
+#define USART_RX_vect     _VECTOR(18)
+#define USART_UDRE_vect   _VECTOR(19)
+#define USART_TX_vect     _VECTOR(20)
+#define ADC_vect          _VECTOR(21)
+#define EE_READY_vect     _VECTOR(22)
+#define ANALOG_COMP_vect  _VECTOR(23)
+#define TWI_vect          _VECTOR(24)
+#define SPM_READY_vect    _VECTOR(25)
+
+#define _VECTORS_SIZE (26 * 4)
+
+#endif // HOST_AVR_IO_H
@@ -0,0 +1,46 @@
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+//============================================================
+// Host (Linux) replacement for <avr/pgmspace.h>.
+//
+// There is only one address space on the host, so PROGMEM
+// data is ordinary const data, the pgm_read_xxx() macros are
+// plain reads, and the xxx_P() functions are the standard
+// ones.
+//============================================================
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PGM_VOID_P const void *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_float(address) (*(const float *)(address))
+#define pgm_read_ptr(address) (*(void *const *)(address))
+
+#define pgm_read_byte_near(address) pgm_read_byte(address)
+#define pgm_read_word_near(address) pgm_read_word(address)
+#define pgm_read_dword_near(address) pgm_read_dword(address)
+#define pgm_read_byte_far(address) pgm_read_byte(address)
+#define pgm_read_word_far(address) pgm_read_word(address)
+#define pgm_read_dword_far(address) pgm_read_dword(address)
+
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strlen_P strlen
+#define strnlen_P strnlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strcat_P strcat
+#define strstr_P strstr
+
+#endif // HOST_AVR_PGMSPACE_H
@@ -0,0 +1,59 @@
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+//============================================================
+// Host (Linux) replacement for <avr/sleep.h>.
+//
+// sleep_cpu() with SE set in SMCR waits until the next ISR has
+// run, as on the AVR. Only idle mode is simulated. Whatever
+// mode is set, every peripheral carries on running.
+//
+// As on the AVR, the instruction after sei() always runs
+// before any interrupt, so this is safe from the race where
+// the interrupt that was to wake us arrives just before the
+// sleep:
+//
+// cli();
+// if (nothingToDo) {
+//     sleep_enable();
+//     sei();
+//     sleep_cpu();
+//     sleep_disable();
+// }
+// sei();
+//
+// Sleeping with interrupts off would be forever, so the
+// simulator reports it on stderr and exits.
+//============================================================
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE        (0)
+#define SLEEP_MODE_ADC         _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN    _BV(SM1)
+#define SLEEP_MODE_PWR_SAVE    (_BV(SM0) | _BV(SM1))
+#define SLEEP_MODE_STANDBY     (_BV(SM1) | _BV(SM2))
+#define SLEEP_MODE_EXT_STANDBY (_BV(SM0) | _BV(SM1) | _BV(SM2))
+
+void hostSleepCpu();
+
+#define set_sleep_mode(mode) \
+    do { \
+        SMCR = (SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode); \
+    } while (0)
+
+#define sleep_enable()  do { SMCR |= _BV(SE); } while (0)
+#define sleep_disable() do { SMCR &= ~_BV(SE); } while (0)
+#define sleep_cpu()     hostSleepCpu()
+
+#define sleep_mode() \
+    do { \
+        sleep_enable(); \
+        sleep_cpu(); \
+        sleep_disable(); \
+    } while (0)
+
+// There's no brown out detector to turn off.
+#define sleep_bod_disable() do { } while (0)
+
+#endif // HOST_AVR_SLEEP_H
@@ -0,0 +1,44 @@
+#ifndef HOST_AVR_WDT_H
+#define HOST_AVR_WDT_H
+
+//============================================================
+// Host (Linux) replacement for <avr/wdt.h>.
+//
+// A watchdog system reset cannot be simulated, so if the
+// watchdog times out in reset mode, the program reports it on
+// stderr and exits.
+//============================================================
+
+#include <avr/io.h>
+
+#define WDTO_15MS  0
+#define WDTO_30MS  1
+#define WDTO_60MS  2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S    6
+#define WDTO_2S    7
+#define WDTO_4S    8
+#define WDTO_8S    9
+
+void hostWDTReset();
+
+#define wdt_reset() hostWDTReset()
+
+#define wdt_enable(value) \
+    do { \
+        WDTCSR = (1 << WDCE) | (1 << WDE); \
+        WDTCSR = (1 << WDE) | \
+                 (((value) & 0x08) ? (1 << WDP3) : 0) | \
+                 ((value) & 0x07); \
+    } while (0)
+
+#define wdt_disable() \
+    do { \
+        MCUSR &= ~(1 << WDRF); \
+        WDTCSR = (1 << WDCE) | (1 << WDE); \
+        WDTCSR = 0; \
+    } while (0)
+
+#endif // HOST_AVR_WDT_H
@@ -0,0 +1,138 @@
+#ifndef HOSTREGISTER_H
+#define HOSTREGISTER_H
+
+#include <stdint.h>
+
+//============================================================
+// A simulated ATmega328P register for host (Linux) builds.
+//
+// On the AVR, UDR0, TWCR and friends are memory addresses. On
+// the host they are objects of this class, which behave like
+// a uint8_t (or uint16_t) when read, written or updated with
+// |=, &= and ^=, but let the peripheral model in hostSim.cpp
+// see every access. That way, writing UDR0 starts a simulated
+// transmission, reading TCNT1 returns the current count, and
+// so on, without any changes to the driver code.
+//
+// Every access takes the simulated data bus lock, so that the
+// main code and the interrupt thread never see a half updated
+// register.
+//============================================================
+
+
+//------------------------------------------------------------
+// The simulated data bus lock. Defined in hostSim.cpp.
+//------------------------------------------------------------
+void hostBusLock();
+void hostBusUnlock();
+
+
+template <typename T>
+class hostRegister {
+public:
+    //--------------------------------------------------------
+    // A read hook returns the value the CPU sees. A write
+    // hook is passed the new value and a mask of the bits
+    // that the CPU actually wrote - see "bitAddressable".
+    // Both are called with the bus lock held and must only
+    // use the raw "value" of any register they touch.
+    //--------------------------------------------------------
+    typedef T (*readHook)(hostRegister<T> *reg);
+    typedef void (*writeHook)(hostRegister<T> *reg, T data, T mask);
+
+    //--------------------------------------------------------
+    // bitAddressable is true for registers in the bottom 32
+    // I/O locations. There, "PORTB |= (1 << PORTB5)" compiles
+    // to an SBI instruction which writes one bit only. That
+    // matters for PINx (write one to toggle) and interrupt
+    // flag registers (write one to clear) where a full read-
+    // modify-write would affect other bits as well.
+    //--------------------------------------------------------
+    explicit constexpr hostRegister(readHook r = 0,
+                                    writeHook w = 0,
+                                    bool bitAddressable = false)
+        : value(0), onRead(r), onWrite(w),
+          sbiCapable(bitAddressable) {}
+
+    // Reading the register.
+    operator T() const {
+        hostBusLock();
+        T result = rawRead();
+        hostBusUnlock();
+        return result;
+    }
+
+    // Writing the register.
+    hostRegister &operator=(T data) {
+        hostBusLock();
+        rawWrite(data, T(~T(0)));
+        hostBusUnlock();
+        return *this;
+    }
+
+    // "OCR1A = ADCW;" must be a write, not a copy.
+    hostRegister &operator=(const hostRegister &other) {
+        return *this = T(other);
+    }
+
+    // These take an unsigned int, as "UCSR0B &= ~(1 << RXEN0)"
+    // is an int expression, as on the AVR.
+    hostRegister &operator|=(unsigned int value) {
+        T bits = T(value);
+        hostBusLock();
+        rawWrite(T(rawRead() | bits), rmwMask(bits));
+        hostBusUnlock();
+        return *this;
+    }
+
+    hostRegister &operator&=(unsigned int value) {
+        T bits = T(value);
+        hostBusLock();
+        rawWrite(T(rawRead() & bits), rmwMask(T(~bits)));
+        hostBusUnlock();
+        return *this;
+    }
+
+    hostRegister &operator^=(unsigned int value) {
+        T bits = T(value);
+        hostBusLock();
+        rawWrite(T(rawRead() ^ bits), T(~T(0)));
+        hostBusUnlock();
+        return *this;
+    }
+
+    // The simulated contents. Only for use by the model.
+    T value;
+
+private:
+    hostRegister(const hostRegister &);
+
+    T rawRead() const {
+        return onRead ? onRead(const_cast<hostRegister *>(this))
+                      : value;
+    }
+
+    void rawWrite(T data, T mask) {
+        if (onWrite) {
+            onWrite(this, data, mask);
+        } else {
+            value = data;
+        }
+    }
+
+    // SBI/CBI only touch a single bit, anything else is a
+    // full read-modify-write of the whole register.
+    T rmwMask(T bits) const {
+        bool singleBit = bits && !(bits & (bits - 1));
+        return (sbiCapable && singleBit) ? bits : T(~T(0));
+    }
+
+    readHook onRead;
+    writeHook onWrite;
+    bool sbiCapable;
+};
+
+typedef hostRegister<uint8_t> hostRegister8;
+typedef hostRegister<uint16_t> hostRegister16;
+
+#endif // HOSTREGISTER_H
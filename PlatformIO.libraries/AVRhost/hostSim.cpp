@@ -0,0 +1,2118 @@
+//============================================================
+// A simulated ATmega328P, just enough of one to run the book's
+// PlatformIO projects and libraries on a Linux host.
+//
+// The registers declared in <avr/io.h> are defined here, with
+// read and write hooks that drive a simple model of each
+// peripheral: GPIO, external and pin change interrupts, the
+// watchdog, EEPROM, Timer/counter 1, SPI, the analog
+// comparator, the ADC, TWI and USART0.
+//
+// A background thread, the "interrupt thread", keeps the
+// peripherals up to date with simulated time, which runs at
+// F_CPU cycles per real second, and calls the ISR()s, in
+// vector order, whenever the interrupt flag and enable bits
+// are set and global interrupts are on.
+//
+// Unlike the AVR, the main code carries on running while an
+// ISR executes, but cli() waits for a running ISR to finish,
+// so code which disables interrupts around shared data is
+// still safe.
+//
+// Norman Dunbar's drivers and sketches are used unchanged.
+//============================================================
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <avr/wdt.h>
+#include <avr/sleep.h>
+#include "hostSim.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#ifndef F_CPU
+    #define F_CPU 16000000UL
+#endif
+
+
+//============================================================
+// Interrupt handlers. Any the program doesn't define stay as
+// null pointers, thanks to the weak references.
+//============================================================
+#define HOST_VECTORS 26
+
+extern "C" {
+    void __vector_1(void) __attribute__((weak));
+    void __vector_2(void) __attribute__((weak));
+    void __vector_3(void) __attribute__((weak));
+    void __vector_4(void) __attribute__((weak));
+    void __vector_5(void) __attribute__((weak));
+    void __vector_6(void) __attribute__((weak));
+    void __vector_7(void) __attribute__((weak));
+    void __vector_8(void) __attribute__((weak));
+    void __vector_9(void) __attribute__((weak));
+    void __vector_10(void) __attribute__((weak));
+    void __vector_11(void) __attribute__((weak));
+    void __vector_12(void) __attribute__((weak));
+    void __vector_13(void) __attribute__((weak));
+    void __vector_14(void) __attribute__((weak));
+    void __vector_15(void) __attribute__((weak));
+    void __vector_16(void) __attribute__((weak));
+    void __vector_17(void) __attribute__((weak));
+    void __vector_18(void) __attribute__((weak));
+    void __vector_19(void) __attribute__((weak));
+    void __vector_20(void) __attribute__((weak));
+    void __vector_21(void) __attribute__((weak));
+    void __vector_22(void) __attribute__((weak));
+    void __vector_23(void) __attribute__((weak));
+    void __vector_24(void) __attribute__((weak));
+    void __vector_25(void) __attribute__((weak));
+}
+
+typedef void (*vectorFunction)(void);
+
+static vectorFunction const vectorTable[HOST_VECTORS] = {
+    0,           __vector_1,  __vector_2,  __vector_3,
+    __vector_4,  __vector_5,  __vector_6,  __vector_7,
+    __vector_8,  __vector_9,  __vector_10, __vector_11,
+    __vector_12, __vector_13, __vector_14, __vector_15,
+    __vector_16, __vector_17, __vector_18, __vector_19,
+    __vector_20, __vector_21, __vector_22, __vector_23,
+    __vector_24, __vector_25
+};
+
+static const char *const vectorNames[HOST_VECTORS] = {
+    "RESET",        "INT0",         "INT1",        "PCINT0",
+    "PCINT1",       "PCINT2",       "WDT",         "TIMER2_COMPA",
+    "TIMER2_COMPB", "TIMER2_OVF",   "TIMER1_CAPT", "TIMER1_COMPA",
+    "TIMER1_COMPB", "TIMER1_OVF",   "TIMER0_COMPA", "TIMER0_COMPB",
+    "TIMER0_OVF",   "SPI_STC",      "USART_RX",    "USART_UDRE",
+    "USART_TX",     "ADC",          "EE_READY",    "ANALOG_COMP",
+    "TWI",          "SPM_READY"
+};
+
+static hostVectorStats vectorStats[HOST_VECTORS];
+
+
+//============================================================
+// Locks, time and the interrupt thread's wake up call.
+//============================================================
+
+// Held for every register access and peripheral update. It
+// is recursive so that host side hooks, called by the model,
+// may call back into the host API.
+static std::recursive_mutex busMutex;
+
+// Held by the interrupt thread while an ISR runs.
+static std::mutex isrMutex;
+
+// The I bit in SREG, as seen by the main code.
+static std::atomic<bool> interruptsOn(false);
+
+// Set on the interrupt thread while running an ISR.
+static thread_local bool inISR = false;
+
+static std::mutex wakeMutex;
+static std::condition_variable wakeCondition;
+static bool wakeRequested = false;
+static std::atomic<bool> stopping(false);
+static std::thread interruptThread;
+
+// The earliest cycle at which a peripheral needs attention.
+static uint64_t nextEvent = UINT64_MAX;
+
+// ISRs run so far, and the wake up call for sleep_cpu().
+static std::atomic<uint32_t> isrCount(0);
+static std::atomic<bool> sleeping(false);
+static std::mutex sleepMutex;
+static std::condition_variable sleepCondition;
+
+void hostBusLock() {
+    busMutex.lock();
+}
+
+void hostBusUnlock() {
+    busMutex.unlock();
+}
+
+uint64_t hostCycles() {
+    static const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    return ns * (F_CPU / 1000) / 1000000;
+}
+
+// Something changed, have the interrupt thread look at it.
+static void kick() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wakeRequested = true;
+    }
+    wakeCondition.notify_one();
+}
+
+static void scheduleEvent(uint64_t when) {
+    if (when < nextEvent)
+        nextEvent = when;
+}
+
+static void update(uint64_t now);
+static void timer1Capture(bool rising);
+static void twiPinsChanged(uint8_t levels, uint8_t changed);
+
+
+//============================================================
+// SREG and global interrupts.
+//============================================================
+static uint8_t readSREG(hostRegister8 *reg) {
+    bool iBit = inISR ? false : interruptsOn.load();
+    return (reg->value & 0x7F) | (iBit ? (1 << SREG_I) : 0);
+}
+
+static uint8_t pendingVector();
+
+// Only wake the interrupt thread if the I bit has just been set
+// and an interrupt is waiting for it. Code that restores SREG
+// in a tight loop, with nothing pending, would otherwise keep a
+// single core host busy switching threads.
+static uint32_t seiIsrCount;
+static bool seiBeforeSleep = false;
+
+static void enableInterrupts() {
+    uint32_t count = isrCount;
+    if (interruptsOn.exchange(true))
+        return;
+
+    // Any ISR from here on wakes a following sleep_cpu().
+    seiIsrCount = count;
+    seiBeforeSleep = true;
+
+    bool pending;
+    {
+        std::lock_guard<std::recursive_mutex> bus(busMutex);
+        pending = pendingVector() != 0;
+    }
+
+    if (pending)
+        kick();
+}
+
+static void writeSREG(hostRegister8 *reg, uint8_t data, uint8_t) {
+    reg->value = data & 0x7F;
+
+    // Interrupts are always off inside an ISR, and don't nest.
+    if (inISR)
+        return;
+
+    if (data & (1 << SREG_I))
+        enableInterrupts();
+    else
+        interruptsOn = false;
+}
+
+void hostSei() {
+    if (inISR)
+        return;
+
+    enableInterrupts();
+}
+
+void hostCli() {
+    if (inISR)
+        return;
+
+    interruptsOn = false;
+
+    // Wait for any running ISR to finish.
+    std::lock_guard<std::mutex> lock(isrMutex);
+}
+
+//============================================================
+// Sleep. Only the main code sleeps, and it wakes when the
+// interrupt thread has run an ISR. If interrupts were just
+// enabled, any ISR since then counts, as the AVR would have
+// executed the sleep instruction before it.
+//============================================================
+static pthread_t mainThread;
+static uint32_t sleepCount;
+static uint64_t sleepCycles;
+
+void hostSleepCpu() {
+    if (!(SMCR.value & (1 << SE)))
+        return;
+
+    if (inISR || !interruptsOn) {
+        fflush(stdout);
+        fprintf(stderr, "\nAVRhost: sleep_cpu() with interrupts "
+                        "off, sleeping forever.\n");
+        _exit(1);
+    }
+
+    uint32_t from = seiBeforeSleep ? seiIsrCount : isrCount.load();
+    seiBeforeSleep = false;
+
+    uint64_t start = hostCycles();
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping = true;
+        sleepCondition.wait(lock, [from] {
+            return isrCount != from || stopping.load();
+        });
+        sleeping = false;
+
+        sleepCount++;
+        sleepCycles += hostCycles() - start;
+    }
+}
+
+// Called by the interrupt thread after every ISR.
+static void wakeSleeper() {
+    isrCount++;
+
+    if (sleeping) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_one();
+    }
+}
+
+hostSleepStats hostGetSleepStats() {
+    hostSleepStats result;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        result.sleeps = sleepCount;
+        result.asleepCycles = sleepCycles;
+    }
+
+    // What the main code has actually run, spinning included.
+    clockid_t clock;
+    timespec used = {0, 0};
+    if (!pthread_getcpuclockid(mainThread, &clock))
+        clock_gettime(clock, &used);
+
+    uint64_t ns = (uint64_t)used.tv_sec * 1000000000ULL + used.tv_nsec;
+    result.busyCycles = ns * (F_CPU / 1000) / 1000000;
+    result.totalCycles = hostCycles();
+    return result;
+}
+
+void hostPrintSleepStats() {
+    hostSleepStats stats = hostGetSleepStats();
+    if (!stats.totalCycles)
+        return;
+
+    fprintf(stderr, "\nMain code: %llu cycles, busy %llu (%u%%), "
+                    "asleep %llu (%u%%) in %u sleeps.\n",
+            (unsigned long long)stats.totalCycles,
+            (unsigned long long)stats.busyCycles,
+            (unsigned)(stats.busyCycles * 100 / stats.totalCycles),
+            (unsigned long long)stats.asleepCycles,
+            (unsigned)(stats.asleepCycles * 100 / stats.totalCycles),
+            stats.sleeps);
+}
+
+void hostDelayMicroseconds(double us) {
+    std::this_thread::sleep_for(
+        std::chrono::duration<double, std::micro>(us));
+}
+
+
+//============================================================
+// Registers with no side effects.
+//============================================================
+hostRegister8 SREG(readSREG, writeSREG);
+hostRegister8 GPIOR0(0, 0, true);
+hostRegister8 GPIOR1;
+hostRegister8 GPIOR2;
+hostRegister8 PRR;
+hostRegister8 MCUSR;
+hostRegister8 SMCR;
+hostRegister8 DIDR0;
+hostRegister8 DIDR1;
+hostRegister8 ADMUX;
+hostRegister8 ADCSRB;
+hostRegister8 TWAR;
+hostRegister8 TWAMR;
+hostRegister8 TWBR;
+hostRegister16 UBRR0;
+hostRegister8 UCSR0C;
+hostRegister8 SPCR;
+hostRegister8 TCCR1C;
+
+// Writes which may enable a pending interrupt.
+static void writeAndKick(hostRegister8 *reg, uint8_t data, uint8_t) {
+    reg->value = data;
+    kick();
+}
+
+// Interrupt flag registers. Writing a one clears the flag.
+static void writeFlags(hostRegister8 *reg, uint8_t data, uint8_t mask) {
+    reg->value &= ~(data & mask);
+}
+
+
+//============================================================
+// GPIO, INT0/INT1 and pin change interrupts.
+//============================================================
+static uint8_t readPIN(hostRegister8 *reg);
+static void writePIN(hostRegister8 *reg, uint8_t data, uint8_t mask);
+static void writePort(hostRegister8 *reg, uint8_t data, uint8_t);
+
+hostRegister8 PINB(readPIN, writePIN, true);
+hostRegister8 DDRB(0, writePort, true);
+hostRegister8 PORTB(0, writePort, true);
+hostRegister8 PINC(readPIN, writePIN, true);
+hostRegister8 DDRC(0, writePort, true);
+hostRegister8 PORTC(0, writePort, true);
+hostRegister8 PIND(readPIN, writePIN, true);
+hostRegister8 DDRD(0, writePort, true);
+hostRegister8 PORTD(0, writePort, true);
+
+hostRegister8 EICRA;
+hostRegister8 EIMSK(0, writeAndKick, true);
+hostRegister8 EIFR(0, writeFlags, true);
+hostRegister8 PCICR(0, writeAndKick);
+hostRegister8 PCIFR(0, writeFlags, true);
+hostRegister8 PCMSK0;
+hostRegister8 PCMSK1;
+hostRegister8 PCMSK2;
+
+typedef struct hostPort {
+    hostRegister8 *pin;
+    hostRegister8 *ddr;
+    hostRegister8 *port;
+    hostRegister8 *pcmsk;
+    uint8_t pcif;
+    uint8_t driven;     // Pins driven from outside.
+    uint8_t external;   // The levels they are driven to.
+    uint8_t levels;     // Last known pin levels.
+} hostPort;
+
+static hostPort ports[3] = {
+    {&PINB, &DDRB, &PORTB, &PCMSK0, PCIF0, 0, 0, 0},
+    {&PINC, &DDRC, &PORTC, &PCMSK1, PCIF1, 0, 0, 0},
+    {&PIND, &DDRD, &PORTD, &PCMSK2, PCIF2, 0, 0, 0}
+};
+
+static hostPort *findPort(hostRegister8 *reg) {
+    for (uint8_t x = 0; x < 3; x++) {
+        if (ports[x].pin == reg || ports[x].ddr == reg ||
+            ports[x].port == reg)
+            return &ports[x];
+    }
+
+    return &ports[0];
+}
+
+static hostPort *findPort(char name) {
+    switch (name) {
+        case 'B': case 'b': return &ports[0];
+        case 'C': case 'c': return &ports[1];
+        case 'D': case 'd': return &ports[2];
+    }
+
+    fprintf(stderr, "AVRhost: there is no port '%c'.\n", name);
+    abort();
+}
+
+// Outputs read back what they drive. Inputs read the outside
+// world if driven, else the pull-up if it's on.
+static uint8_t portLevels(const hostPort *p) {
+    uint8_t ddr = p->ddr->value;
+    uint8_t out = p->port->value;
+    uint8_t in = (p->external & p->driven) | (out & ~p->driven);
+    return (ddr & out) | (~ddr & in);
+}
+
+// INT0 is PD2 and INT1 is PD3.
+static void externalInterrupt(uint8_t intBit, bool level, bool was) {
+    uint8_t sense = (EICRA.value >> (intBit * 2)) & 3;
+
+    bool fire = (sense == 1 && level != was) ||
+                (sense == 2 && was && !level) ||
+                (sense == 3 && !was && level);
+
+    if (fire)
+        EIFR.value |= (1 << intBit);
+}
+
+static void pinsChanged(hostPort *p) {
+    uint8_t levels = portLevels(p);
+    uint8_t changed = levels ^ p->levels;
+    uint8_t was = p->levels;
+    p->levels = levels;
+
+    if (!changed)
+        return;
+
+    if (changed & p->pcmsk->value)
+        PCIFR.value |= (1 << p->pcif);
+
+    if (p == &ports[2]) {
+        if (changed & (1 << PD2))
+            externalInterrupt(INT0, levels & (1 << PD2), was & (1 << PD2));
+        if (changed & (1 << PD3))
+            externalInterrupt(INT1, levels & (1 << PD3), was & (1 << PD3));
+    }
+
+    // PC4 and PC5 are SDA and SCL.
+    if (p == &ports[1] && (changed & ((1 << PC4) | (1 << PC5))))
+        twiPinsChanged(levels, changed);
+
+    // PB0 is ICP1, unless the analog comparator is in use.
+    if (p == &ports[0] && (changed & (1 << PB0)) &&
+        !(ACSR.value & (1 << ACIC)))
+        timer1Capture(levels & (1 << PB0));
+
+    kick();
+}
+
+static uint8_t readPIN(hostRegister8 *reg) {
+    return portLevels(findPort(reg));
+}
+
+// Writing a one to PINx toggles the PORTx bit.
+static void writePIN(hostRegister8 *reg, uint8_t data, uint8_t mask) {
+    hostPort *p = findPort(reg);
+    p->port->value ^= (data & mask);
+    pinsChanged(p);
+}
+
+static void writePort(hostRegister8 *reg, uint8_t data, uint8_t) {
+    reg->value = data;
+    pinsChanged(findPort(reg));
+}
+
+void hostSetPin(char port, uint8_t pin, bool level) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    update(hostCycles());
+
+    hostPort *p = findPort(port);
+    p->driven |= (1 << pin);
+    if (level) {
+        p->external |= (1 << pin);
+    } else {
+        p->external &= ~(1 << pin);
+    }
+    pinsChanged(p);
+}
+
+void hostReleasePin(char port, uint8_t pin) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    update(hostCycles());
+
+    hostPort *p = findPort(port);
+    p->driven &= ~(1 << pin);
+    pinsChanged(p);
+}
+
+bool hostGetPin(char port, uint8_t pin) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    return portLevels(findPort(port)) & (1 << pin);
+}
+
+
+//============================================================
+// Watchdog. Runs from a 128 KHz oscillator, so the shortest
+// timeout is 2048 of its cycles, or 16 ms.
+//============================================================
+static void writeWDTCSR(hostRegister8 *reg, uint8_t data, uint8_t mask);
+
+hostRegister8 WDTCSR(0, writeWDTCSR);
+
+static uint64_t wdtStart;
+
+static uint64_t wdtPeriod() {
+    uint8_t wdp = (WDTCSR.value & 7) |
+                  ((WDTCSR.value & (1 << WDP3)) ? 8 : 0);
+    if (wdp > 9)
+        wdp = 9;
+
+    return (2048ULL << wdp) * F_CPU / 128000;
+}
+
+static void writeWDTCSR(hostRegister8 *reg, uint8_t data, uint8_t mask) {
+    uint8_t flag = reg->value & (1 << WDIF);
+    if (data & mask & (1 << WDIF))
+        flag = 0;
+
+    reg->value = (data & ~((1 << WDIF) | (1 << WDCE))) | flag;
+    wdtStart = hostCycles();
+    kick();
+}
+
+void hostWDTReset() {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    wdtStart = hostCycles();
+}
+
+static void wdtUpdate(uint64_t now) {
+    uint8_t control = WDTCSR.value;
+    if (!(control & ((1 << WDE) | (1 << WDIE))))
+        return;
+
+    uint64_t period = wdtPeriod();
+    while (now >= wdtStart + period) {
+        wdtStart += period;
+
+        bool reset = (control & (1 << WDE)) &&
+                     (!(control & (1 << WDIE)) ||
+                      (control & (1 << WDIF)));
+
+        if (reset) {
+            fflush(stdout);
+            fprintf(stderr, "\nAVRhost: watchdog system reset, "
+                            "exiting.\n");
+            _exit(1);
+        }
+
+        WDTCSR.value |= (1 << WDIF);
+    }
+
+    scheduleEvent(wdtStart + period);
+}
+
+
+//============================================================
+// EEPROM. A write takes 3.4 ms.
+//============================================================
+static uint8_t readEECR(hostRegister8 *reg);
+static void writeEECR(hostRegister8 *reg, uint8_t data, uint8_t mask);
+static void writeEEAR(hostRegister16 *reg, uint16_t data, uint16_t);
+
+hostRegister8 EECR(readEECR, writeEECR, true);
+hostRegister8 EEDR;
+hostRegister16 EEAR(0, writeEEAR);
+
+static uint8_t eeprom[E2END + 1];
+static uint64_t eempeTimeout;
+static bool eepromBusy;
+static uint64_t eepromDone;
+static uint16_t eepromAddress;
+static uint8_t eepromData;
+static uint8_t eepromMode;
+
+static void eepromUpdate(uint64_t now) {
+    if (now > eempeTimeout)
+        EECR.value &= ~(1 << EEMPE);
+
+    if (!eepromBusy)
+        return;
+
+    if (now < eepromDone) {
+        scheduleEvent(eepromDone);
+        return;
+    }
+
+    switch (eepromMode) {
+        case 0: eeprom[eepromAddress] = eepromData; break;
+        case 1: eeprom[eepromAddress] = 0xFF; break;
+        case 2: eeprom[eepromAddress] &= eepromData; break;
+    }
+
+    eepromBusy = false;
+    EECR.value &= ~(1 << EEPE);
+}
+
+static uint8_t readEECR(hostRegister8 *reg) {
+    eepromUpdate(hostCycles());
+    return reg->value;
+}
+
+static void writeEECR(hostRegister8 *reg, uint8_t data, uint8_t mask) {
+    uint64_t now = hostCycles();
+    eepromUpdate(now);
+
+    uint8_t written = data & mask;
+    bool armed = (reg->value & (1 << EEMPE)) && now <= eempeTimeout;
+
+    // EERIE is an ordinary bit, EEPM1:0 too, unless writing.
+    uint8_t writable = (1 << EERIE);
+    if (!eepromBusy)
+        writable |= (1 << EEPM1) | (1 << EEPM0);
+    reg->value = (reg->value & ~writable) | (data & writable);
+
+    if ((written & (1 << EEPE)) && armed && !eepromBusy) {
+        eepromBusy = true;
+        eepromDone = now + F_CPU * 34 / 10000;
+        eepromAddress = EEAR.value & E2END;
+        eepromData = EEDR.value;
+        eepromMode = (reg->value >> EEPM0) & 3;
+        reg->value |= (1 << EEPE);
+        reg->value &= ~(1 << EEMPE);
+        scheduleEvent(eepromDone);
+    } else if (written & (1 << EEMPE)) {
+        // The AVR allows four cycles to set EEPE. Host code is
+        // not cycle timed, so allow the next write, within 100
+        // microseconds.
+        reg->value |= (1 << EEMPE);
+        eempeTimeout = now + F_CPU / 10000;
+    } else {
+        reg->value &= ~(1 << EEMPE);
+    }
+
+    if ((written & (1 << EERE)) && !eepromBusy)
+        EEDR.value = eeprom[EEAR.value & E2END];
+
+    kick();
+}
+
+static void writeEEAR(hostRegister16 *reg, uint16_t data, uint16_t) {
+    reg->value = data & E2END;
+}
+
+uint8_t *hostEEPROM() {
+    return eeprom;
+}
+
+
+//============================================================
+// Timer/counter 1.
+//============================================================
+static uint16_t readTimer1(hostRegister16 *reg);
+static void writeTimer1(hostRegister16 *reg, uint16_t data, uint16_t);
+static void writeTimer1Control(hostRegister8 *reg, uint8_t data, uint8_t);
+
+hostRegister8 TCCR1A(0, writeTimer1Control);
+hostRegister8 TCCR1B(0, writeTimer1Control);
+hostRegister16 TCNT1(readTimer1, writeTimer1);
+hostRegister16 ICR1(0, writeTimer1);
+hostRegister16 OCR1A(0, writeTimer1);
+hostRegister16 OCR1B(0, writeTimer1);
+hostRegister8 TIMSK1(0, writeAndKick);
+hostRegister8 TIFR1(0, writeFlags, true);
+
+static uint64_t timer1Last;
+static bool timer1Down;
+
+static uint16_t timer1Divider() {
+    static const uint16_t dividers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    return dividers[TCCR1B.value & 7];
+}
+
+static uint8_t timer1Mode() {
+    return (TCCR1A.value & 3) | ((TCCR1B.value >> WGM12) & 3) << 2;
+}
+
+static uint16_t timer1Top() {
+    switch (timer1Mode()) {
+        case 1: case 5:   return 0x00FF;
+        case 2: case 6:   return 0x01FF;
+        case 3: case 7:   return 0x03FF;
+        case 4: case 9:
+        case 11: case 15: return OCR1A.value;
+        case 8: case 10:
+        case 12: case 14: return ICR1.value;
+    }
+
+    return 0xFFFF;
+}
+
+static bool timer1DualSlope() {
+    uint8_t mode = timer1Mode();
+    return (mode >= 1 && mode <= 3) || (mode >= 8 && mode <= 11);
+}
+
+static bool timer1FastPWM() {
+    uint8_t mode = timer1Mode();
+    return (mode >= 5 && mode <= 7) || mode == 14 || mode == 15;
+}
+
+static bool timer1IcrIsTop() {
+    uint8_t mode = timer1Mode();
+    return mode == 8 || mode == 10 || mode == 12 || mode == 14;
+}
+
+static void timer1Matched(uint16_t count) {
+    if (count == OCR1A.value)
+        TIFR1.value |= (1 << OCF1A);
+
+    if (count == OCR1B.value)
+        TIFR1.value |= (1 << OCF1B);
+}
+
+// How many timer clocks until the next interesting count.
+static uint32_t timer1Distance() {
+    uint16_t count = TCNT1.value;
+    uint16_t top = timer1Top();
+    uint32_t target;
+
+    if (!timer1Down) {
+        uint16_t limit = (count > top) ? 0xFFFF : top;
+        if (count >= limit)
+            return 1;
+
+        target = limit;
+        if (OCR1A.value > count && OCR1A.value < target)
+            target = OCR1A.value;
+        if (OCR1B.value > count && OCR1B.value < target)
+            target = OCR1B.value;
+
+        return target - count;
+    }
+
+    if (count == 0)
+        return 1;
+
+    target = 0;
+    if (OCR1A.value < count && OCR1A.value > target)
+        target = OCR1A.value;
+    if (OCR1B.value < count && OCR1B.value > target)
+        target = OCR1B.value;
+
+    return count - target;
+}
+
+static void timer1Step(uint64_t ticks) {
+    while (ticks) {
+        uint16_t count = TCNT1.value;
+        uint16_t top = timer1Top();
+
+        if (top == 0) {
+            // Degenerate, but don't hang.
+            TCNT1.value = 0;
+            timer1Matched(0);
+            return;
+        }
+
+        uint32_t distance = timer1Distance();
+        if (distance > ticks) {
+            TCNT1.value = timer1Down ? count - ticks : count + ticks;
+            return;
+        }
+
+        ticks -= distance;
+
+        if (!timer1Down) {
+            uint16_t limit = (count > top) ? 0xFFFF : top;
+
+            if (count >= limit) {
+                // One past TOP or MAX.
+                if (timer1DualSlope()) {
+                    timer1Down = true;
+                    count = top - 1;
+                } else {
+                    if (limit == 0xFFFF && !timer1FastPWM())
+                        TIFR1.value |= (1 << TOV1);
+                    count = 0;
+                }
+                TCNT1.value = count;
+                timer1Matched(count);
+                continue;
+            }
+
+            count += distance;
+            TCNT1.value = count;
+            timer1Matched(count);
+
+            if (count == top) {
+                if (timer1IcrIsTop())
+                    TIFR1.value |= (1 << ICF1);
+                if (timer1FastPWM())
+                    TIFR1.value |= (1 << TOV1);
+            }
+        } else {
+            if (count == 0) {
+                timer1Down = false;
+                TCNT1.value = 1;
+                timer1Matched(1);
+                continue;
+            }
+
+            count -= distance;
+            TCNT1.value = count;
+            timer1Matched(count);
+
+            if (count == 0) {
+                TIFR1.value |= (1 << TOV1);
+                timer1Down = false;
+            }
+        }
+    }
+}
+
+static void timer1Update(uint64_t now) {
+    uint16_t divider = timer1Divider();
+    if (!divider) {
+        timer1Last = now;
+        return;
+    }
+
+    uint64_t ticks = (now - timer1Last) / divider;
+    timer1Last += ticks * divider;
+    timer1Step(ticks);
+
+    if (TIMSK1.value)
+        scheduleEvent(timer1Last + (uint64_t)timer1Distance() * divider);
+}
+
+static void timer1Capture(bool rising) {
+    timer1Update(hostCycles());
+
+    bool wanted = (TCCR1B.value & (1 << ICES1)) ? rising : !rising;
+    if (!wanted || timer1IcrIsTop())
+        return;
+
+    ICR1.value = TCNT1.value;
+    TIFR1.value |= (1 << ICF1);
+    kick();
+}
+
+static uint16_t readTimer1(hostRegister16 *reg) {
+    timer1Update(hostCycles());
+    return reg->value;
+}
+
+static void writeTimer1(hostRegister16 *reg, uint16_t data, uint16_t) {
+    timer1Update(hostCycles());
+    reg->value = data;
+    kick();
+}
+
+static void writeTimer1Control(hostRegister8 *reg, uint8_t data, uint8_t) {
+    timer1Update(hostCycles());
+    reg->value = data;
+    if (!timer1DualSlope())
+        timer1Down = false;
+    kick();
+}
+
+
+//============================================================
+// SPI.
+//============================================================
+static uint8_t readSPSR(hostRegister8 *reg);
+static void writeSPSR(hostRegister8 *reg, uint8_t data, uint8_t);
+static uint8_t readSPDR(hostRegister8 *reg);
+static void writeSPDR(hostRegister8 *reg, uint8_t data, uint8_t);
+
+hostRegister8 SPSR(readSPSR, writeSPSR);
+hostRegister8 SPDR(readSPDR, writeSPDR);
+
+static uint8_t (*spiDevice)(uint8_t data);
+static bool spiBusy;
+static uint64_t spiDone;
+static uint8_t spiOut;
+static bool spifSeen;
+
+static void spiUpdate(uint64_t now) {
+    if (!spiBusy)
+        return;
+
+    if (now < spiDone) {
+        scheduleEvent(spiDone);
+        return;
+    }
+
+    SPDR.value = spiDevice ? spiDevice(spiOut) : 0xFF;
+    SPSR.value |= (1 << SPIF);
+    spiBusy = false;
+}
+
+// Reading SPSR with SPIF set, then accessing SPDR, clears
+// SPIF and WCOL.
+static void spiClearFlags() {
+    if (spifSeen) {
+        SPSR.value &= ~((1 << SPIF) | (1 << WCOL));
+        spifSeen = false;
+    }
+}
+
+static uint8_t readSPSR(hostRegister8 *reg) {
+    spiUpdate(hostCycles());
+    if (reg->value & (1 << SPIF))
+        spifSeen = true;
+    return reg->value;
+}
+
+static void writeSPSR(hostRegister8 *reg, uint8_t data, uint8_t) {
+    reg->value = (reg->value & ~(1 << SPI2X)) | (data & (1 << SPI2X));
+}
+
+static uint8_t readSPDR(hostRegister8 *reg) {
+    spiUpdate(hostCycles());
+    spiClearFlags();
+    return reg->value;
+}
+
+static void writeSPDR(hostRegister8 *reg, uint8_t data, uint8_t) {
+    uint64_t now = hostCycles();
+    spiUpdate(now);
+
+    if (spiBusy) {
+        SPSR.value |= (1 << WCOL);
+        return;
+    }
+
+    spiClearFlags();
+    reg->value = data;
+
+    if ((SPCR.value & (1 << SPE)) && (SPCR.value & (1 << MSTR))) {
+        static const uint8_t dividers[4] = {4, 16, 64, 128};
+        uint32_t divider = dividers[SPCR.value & 3];
+        if (SPSR.value & (1 << SPI2X))
+            divider /= 2;
+
+        spiBusy = true;
+        spiOut = data;
+        spiDone = now + 8 * divider;
+        scheduleEvent(spiDone);
+        kick();
+    }
+}
+
+void hostSPIsetDevice(uint8_t (*exchange)(uint8_t data)) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    spiDevice = exchange;
+}
+
+uint8_t hostSPITransfer(uint8_t data) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    update(hostCycles());
+
+    if (!(SPCR.value & (1 << SPE)) || (SPCR.value & (1 << MSTR)))
+        return 0xFF;
+
+    uint8_t out = SPDR.value;
+    SPDR.value = data;
+    SPSR.value |= (1 << SPIF);
+    kick();
+    return out;
+}
+
+
+//============================================================
+// Analog comparator.
+//============================================================
+static uint8_t readACSR(hostRegister8 *reg);
+static void writeACSR(hostRegister8 *reg, uint8_t data, uint8_t mask);
+
+hostRegister8 ACSR(readACSR, writeACSR);
+
+static bool acOutput;
+
+static uint8_t readACSR(hostRegister8 *reg) {
+    uint8_t result = reg->value & ~(1 << ACO);
+    if (acOutput && !(reg->value & (1 << ACD)))
+        result |= (1 << ACO);
+    return result;
+}
+
+static void writeACSR(hostRegister8 *reg, uint8_t data, uint8_t mask) {
+    uint8_t flag = reg->value & (1 << ACI);
+    if (data & mask & (1 << ACI))
+        flag = 0;
+
+    reg->value = (data & ~((1 << ACI) | (1 << ACO))) | flag;
+    kick();
+}
+
+void hostACSet(bool output) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    update(hostCycles());
+
+    bool was = acOutput;
+    acOutput = output;
+    if (was == output || (ACSR.value & (1 << ACD)))
+        return;
+
+    uint8_t sense = ACSR.value & 3;
+    if (sense == 0 || (sense == 2 && !output) || (sense == 3 && output))
+        ACSR.value |= (1 << ACI);
+
+    if (ACSR.value & (1 << ACIC))
+        timer1Capture(output);
+
+    kick();
+}
+
+
+//============================================================
+// ADC. 25 ADC clocks for the first conversion, 13 after.
+//============================================================
+static uint16_t readADCW(hostRegister16 *reg);
+static uint8_t readADCL(hostRegister8 *reg);
+static uint8_t readADCH(hostRegister8 *reg);
+static void writeADCSRA(hostRegister8 *reg, uint8_t data, uint8_t mask);
+
+hostRegister16 ADCW(readADCW);
+hostRegister8 ADCL(readADCL);
+hostRegister8 ADCH(readADCH);
+hostRegister8 ADCSRA(0, writeADCSRA);
+
+static uint16_t adcInputs[16];
+static bool adcBusy;
+static bool adcFirst = true;
+static uint64_t adcDone;
+
+static uint32_t adcPrescaler() {
+    static const uint8_t dividers[8] = {2, 2, 4, 8, 16, 32, 64, 128};
+    return dividers[ADCSRA.value & 7];
+}
+
+static void adcUpdate(uint64_t now) {
+    while (adcBusy && now >= adcDone) {
+        uint16_t result = adcInputs[ADMUX.value & 0x0F] & 0x3FF;
+        if (ADMUX.value & (1 << ADLAR))
+            result <<= 6;
+
+        ADCW.value = result;
+        ADCSRA.value |= (1 << ADIF);
+
+        // Free running mode starts the next one immediately.
+        if ((ADCSRA.value & (1 << ADATE)) && !(ADCSRB.value & 7)) {
+            adcDone += 13 * adcPrescaler();
+        } else {
+            adcBusy = false;
+            ADCSRA.value &= ~(1 << ADSC);
+        }
+    }
+
+    if (adcBusy)
+        scheduleEvent(adcDone);
+}
+
+static uint16_t readADCW(hostRegister16 *reg) {
+    adcUpdate(hostCycles());
+    return reg->value;
+}
+
+static uint8_t readADCL(hostRegister8 *) {
+    adcUpdate(hostCycles());
+    return ADCW.value & 0xFF;
+}
+
+static uint8_t readADCH(hostRegister8 *) {
+    return ADCW.value >> 8;
+}
+
+static void writeADCSRA(hostRegister8 *reg, uint8_t data, uint8_t mask) {
+    uint64_t now = hostCycles();
+    adcUpdate(now);
+
+    uint8_t flag = reg->value & (1 << ADIF);
+    if (data & mask & (1 << ADIF))
+        flag = 0;
+
+    uint8_t busy = reg->value & (1 << ADSC);
+    reg->value = (data & ~((1 << ADIF) | (1 << ADSC))) | flag | busy;
+
+    if (!(data & (1 << ADEN))) {
+        adcBusy = false;
+        adcFirst = true;
+        reg->value &= ~(1 << ADSC);
+    } else if ((data & (1 << ADSC)) && !adcBusy) {
+        adcBusy = true;
+        adcDone = now + (adcFirst ? 25 : 13) * adcPrescaler();
+        adcFirst = false;
+        reg->value |= (1 << ADSC);
+        scheduleEvent(adcDone);
+    }
+
+    kick();
+}
+
+void hostADCSet(uint8_t channel, uint16_t value) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    adcInputs[channel & 0x0F] = value;
+}
+
+
+//============================================================
+// TWI. The Uno as master, to host side slave devices, or as a
+// slave, to a host side master. Each byte takes nine SCL
+// periods, START and STOP take one.
+//============================================================
+static void writeTWCR(hostRegister8 *reg, uint8_t data, uint8_t);
+static void writeTWSR(hostRegister8 *reg, uint8_t data, uint8_t);
+static void writeTWDR(hostRegister8 *reg, uint8_t data, uint8_t);
+
+hostRegister8 TWCR(0, writeTWCR);
+hostRegister8 TWSR(0, writeTWSR);
+hostRegister8 TWDR(0, writeTWDR);
+
+typedef enum {
+    twiIdle,
+    twiAddress,
+    twiTransmit,
+    twiReceive,
+    twiNacked
+} twiPhase;
+
+static hostTWIDevice *twiDevices;
+static hostTWIDevice *twiDevice;
+static twiPhase twiState = twiIdle;
+static bool twiOwnBus;
+static bool twiPending;
+static uint64_t twiDone;
+static uint8_t twiStatus;
+static bool twiHaveData;
+static uint8_t twiData;
+
+// Status used internally for the end of a STOP condition.
+static const uint8_t twiStopDone = 0xF8;
+
+// The host side master, part way through a transfer to the
+// Uno as a slave. Each time the Uno clears TWINT, the master
+// takes the next step, from "status", the last one it set.
+static struct {
+    bool active;
+    bool repeatedStart;
+    uint8_t status;
+    uint8_t address;
+    const uint8_t *writeData;
+    uint8_t writeLen;
+    uint8_t *readData;
+    uint8_t readLen;
+    uint8_t index;
+    int count;
+    uint32_t clock;
+} twiHost = {false, false, 0, 0, 0, 0, 0, 0, 0, 0, 100000};
+
+// Set by hostTWIMasterContend(). The host master starts along
+// with the Uno's next START, and wins arbitration on SLA+R/W.
+static bool twiContend;
+
+static uint32_t twiBitCycles() {
+    if (twiHost.active)
+        return F_CPU / twiHost.clock;
+
+    return 16 + 2 * TWBR.value * (1 << (2 * (TWSR.value & 3)));
+}
+
+// While a slave holds SDA low, nothing the TWI starts ever
+// finishes.
+static uint8_t twiStuckClocks;
+
+static void twiSchedule(uint8_t status, uint32_t bits) {
+    if (twiStuckClocks) {
+        twiPending = false;
+        return;
+    }
+
+    twiPending = true;
+    twiStatus = status;
+    twiDone = hostCycles() + bits * twiBitCycles();
+    scheduleEvent(twiDone);
+}
+
+static void twiEndConversation() {
+    if (twiDevice && twiDevice->stop)
+        twiDevice->stop(twiDevice);
+    twiDevice = 0;
+}
+
+static void twiUpdate(uint64_t now) {
+    if (!twiPending)
+        return;
+
+    if (now < twiDone) {
+        scheduleEvent(twiDone);
+        return;
+    }
+
+    twiPending = false;
+
+    // The end of a STOP sets no flag, TWSTO just clears.
+    if (twiStatus == twiStopDone) {
+        TWCR.value &= ~(1 << TWSTO);
+        return;
+    }
+
+    if (twiHaveData) {
+        TWDR.value = twiData;
+        twiHaveData = false;
+    }
+
+    TWSR.value = (TWSR.value & 3) | twiStatus;
+    TWCR.value |= (1 << TWINT);
+}
+
+static hostTWIDevice *twiFind(uint8_t address) {
+    for (hostTWIDevice *d = twiDevices; d; d = d->next) {
+        if (d->address == address)
+            return d;
+    }
+
+    return 0;
+}
+
+// The Uno answers to its own address in TWAR, or to the
+// general call if TWGCE is set, but only with TWEA set.
+static bool twiHostAddressed(uint8_t address) {
+    if ((TWCR.value & ((1 << TWEN) | (1 << TWEA))) !=
+        ((1 << TWEN) | (1 << TWEA)))
+        return false;
+
+    if (address == 0)
+        return TWAR.value & (1 << TWGCE);
+
+    return (TWAR.value >> 1) == address;
+}
+
+static void twiHostSend(uint8_t status, uint32_t bits) {
+    twiHost.status = status;
+    twiSchedule(status, bits);
+}
+
+static void twiHostAddress(bool read) {
+    if (!twiHostAddressed(twiHost.address)) {
+        twiHost.active = false;
+        return;
+    }
+
+    twiHost.index = 0;
+    twiHostSend(read ? 0xA8 : 0x60, 10);
+}
+
+// The Uno has sent its SLA+R/W, and lost arbitration to the
+// host's. With TWEA set, and its own address, the Uno carries
+// on as slave, with 0x68 or 0xB0, otherwise it gets 0x38, and
+// the host's transfer is to some other slave.
+static void twiHostArbitrate() {
+    twiContend = false;
+    twiOwnBus = false;
+    twiState = twiIdle;
+
+    if (!twiHostAddressed(twiHost.address)) {
+        twiHost.count = -1;
+        twiSchedule(0x38, 9);
+        return;
+    }
+
+    twiHost.active = true;
+    twiHost.index = 0;
+    twiHostSend(twiHost.writeLen ? 0x68 : 0xB0, 9);
+}
+
+// The Uno, as slave, has dealt with "twiHost.status" and
+// cleared TWINT, with "data" written to TWCR.
+static void twiHostNext(uint8_t data) {
+    bool ack = data & (1 << TWEA);
+
+    switch (twiHost.status) {
+        case 0x60:
+        case 0x68:
+        case 0x80:
+            if (twiHost.index < twiHost.writeLen) {
+                twiData = twiHost.writeData[twiHost.index++];
+                twiHaveData = true;
+                if (ack)
+                    twiHost.count++;
+                twiHostSend(ack ? 0x80 : 0x88, 9);
+            } else {
+                // A repeated START, or a STOP, either way the
+                // slave sees 0xA0.
+                twiHost.repeatedStart = twiHost.readLen;
+                twiHostSend(0xA0, 1);
+            }
+            break;
+
+        case 0xA0:
+            if (twiHost.repeatedStart) {
+                twiHost.repeatedStart = false;
+                twiHostAddress(true);
+            } else {
+                twiHost.active = false;
+            }
+            break;
+
+        case 0xA8:
+        case 0xB0:
+        case 0xB8: {
+            // The slave put the byte in TWDR before clearing
+            // TWINT. The master ACKs all but the last one.
+            twiHost.readData[twiHost.index++] = TWDR.value;
+            twiHost.count++;
+            bool more = twiHost.index < twiHost.readLen;
+            twiHostSend(!more ? 0xC0 : ack ? 0xB8 : 0xC8, 9);
+            break;
+        }
+
+        case 0xC8:
+            // The slave said it had no more, the master gets
+            // an idle bus, all 1s, for the rest.
+            while (twiHost.index < twiHost.readLen)
+                twiHost.readData[twiHost.index++] = 0xFF;
+            twiHost.active = false;
+            break;
+
+        default:
+            // 0x88 and 0xC0, the slave is done, the master
+            // sends a STOP that the slave doesn't see.
+            twiHost.active = false;
+            break;
+    }
+}
+
+static void writeTWCR(hostRegister8 *reg, uint8_t data, uint8_t) {
+    twiUpdate(hostCycles());
+
+    if (!(data & (1 << TWEN))) {
+        // Disabling TWI aborts everything.
+        twiEndConversation();
+        twiOwnBus = false;
+        twiPending = false;
+        twiState = twiIdle;
+        twiHost.active = false;
+        reg->value = data & ~((1 << TWINT) | (1 << TWWC));
+        TWSR.value = (TWSR.value & 3) | 0xF8;
+        return;
+    }
+
+    uint8_t flag = reg->value & (1 << TWINT);
+    bool go = data & (1 << TWINT);
+    if (go)
+        flag = 0;
+
+    reg->value = (data & ~((1 << TWINT) | (1 << TWWC))) | flag;
+    kick();
+
+    if (!go)
+        return;
+
+    TWSR.value = (TWSR.value & 3) | 0xF8;
+
+    // A slave asking for a START, when it's done, gets one.
+    if (twiHost.active) {
+        twiHostNext(data);
+        if (twiHost.active || !(data & (1 << TWSTA)))
+            return;
+    }
+
+    if (data & (1 << TWSTO)) {
+        twiEndConversation();
+        twiOwnBus = false;
+        twiState = twiIdle;
+
+        // TWSTA as well is a STOP, then a START.
+        if (data & (1 << TWSTA)) {
+            reg->value &= ~(1 << TWSTO);
+            twiSchedule(0x08, 2);
+            twiOwnBus = true;
+            twiState = twiAddress;
+            return;
+        }
+
+        twiSchedule(twiStopDone, 1);
+        return;
+    }
+
+    if (data & (1 << TWSTA)) {
+        twiEndConversation();
+        twiSchedule(twiOwnBus ? 0x10 : 0x08, 1);
+        twiOwnBus = true;
+        twiState = twiAddress;
+        return;
+    }
+
+    switch (twiState) {
+        case twiAddress: {
+            if (twiContend) {
+                twiHostArbitrate();
+                break;
+            }
+
+            uint8_t sla = TWDR.value;
+            bool read = sla & 1;
+            hostTWIDevice *d = twiFind(sla >> 1);
+            bool ack = d && (!d->start || d->start(d, read));
+
+            twiDevice = ack ? d : 0;
+            twiState = ack ? (read ? twiReceive : twiTransmit) : twiNacked;
+            if (read) {
+                twiSchedule(ack ? 0x40 : 0x48, 9);
+            } else {
+                twiSchedule(ack ? 0x18 : 0x20, 9);
+            }
+            break;
+        }
+
+        case twiTransmit: {
+            bool ack = !twiDevice->write ||
+                       twiDevice->write(twiDevice, TWDR.value);
+            twiSchedule(ack ? 0x28 : 0x30, 9);
+            break;
+        }
+
+        case twiReceive: {
+            bool ack = data & (1 << TWEA);
+            twiData = twiDevice->read ? twiDevice->read(twiDevice, ack)
+                                      : 0xFF;
+            twiHaveData = true;
+            twiSchedule(ack ? 0x50 : 0x58, 9);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void writeTWSR(hostRegister8 *reg, uint8_t data, uint8_t) {
+    reg->value = (reg->value & 0xF8) | (data & 3);
+}
+
+// Writing TWDR while the TWI is busy is a write collision.
+static void writeTWDR(hostRegister8 *reg, uint8_t data, uint8_t) {
+    twiUpdate(hostCycles());
+
+    if ((TWCR.value & (1 << TWEN)) && !(TWCR.value & (1 << TWINT)) &&
+        twiPending) {
+        TWCR.value |= (1 << TWWC);
+        return;
+    }
+
+    reg->value = data;
+}
+
+// The stuck slave counts rising edges on SCL, driven as GPIO
+// by a bus recovery, and lets go of SDA after enough of them.
+static void twiPinsChanged(uint8_t levels, uint8_t changed) {
+    if (!twiStuckClocks)
+        return;
+
+    if ((changed & (1 << PC5)) && (levels & (1 << PC5))) {
+        if (--twiStuckClocks == 0) {
+            ports[1].driven &= ~(1 << PC4);
+            pinsChanged(&ports[1]);
+        }
+    }
+}
+
+void hostTWIHoldSDA(uint8_t clocks) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    update(hostCycles());
+
+    twiStuckClocks = clocks;
+    if (clocks) {
+        twiPending = false;
+        ports[1].driven |= (1 << PC4);
+        ports[1].external &= ~(1 << PC4);
+    } else {
+        ports[1].driven &= ~(1 << PC4);
+    }
+    pinsChanged(&ports[1]);
+}
+
+void hostTWIAttach(hostTWIDevice *device) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    device->next = twiDevices;
+    twiDevices = device;
+}
+
+static bool registerStart(hostTWIDevice *device, bool read) {
+    if (!read) {
+        device->pointerSet = false;
+    } else if (!device->autoIncrement) {
+        device->pointer = device->selected;
+    }
+    return true;
+}
+
+static bool registerWrite(hostTWIDevice *device, uint8_t data) {
+    if (!device->pointerSet) {
+        device->pointer = data;
+        device->selected = data;
+        device->pointerSet = true;
+    } else {
+        device->bank[device->pointer++ % device->bankSize] = data;
+    }
+    return true;
+}
+
+static uint8_t registerRead(hostTWIDevice *device, bool) {
+    return device->bank[device->pointer++ % device->bankSize];
+}
+
+void hostTWIRegisterDevice(hostTWIDevice *device,
+                           uint8_t address,
+                           uint8_t *bank,
+                           uint8_t size,
+                           bool autoIncrement) {
+    memset(device, 0, sizeof(*device));
+    device->address = address;
+    device->start = registerStart;
+    device->write = registerWrite;
+    device->read = registerRead;
+    device->bank = bank;
+    device->bankSize = size;
+    device->autoIncrement = autoIncrement;
+    hostTWIAttach(device);
+}
+
+void hostTWIMasterClock(uint32_t hz) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    twiHost.clock = hz;
+}
+
+int hostTWIMasterTransfer(uint8_t address,
+                          const uint8_t *writeData, uint8_t writeLen,
+                          uint8_t *readData, uint8_t readLen) {
+    {
+        std::lock_guard<std::recursive_mutex> lock(busMutex);
+        update(hostCycles());
+
+        twiHost.active = true;
+        twiHost.repeatedStart = false;
+        twiHost.address = address;
+        twiHost.writeData = writeData;
+        twiHost.writeLen = writeLen;
+        twiHost.readData = readData;
+        twiHost.readLen = readLen;
+        twiHost.count = 0;
+
+        twiHostAddress(writeLen == 0);
+        if (!twiHost.active)
+            return -1;
+    }
+
+    return hostTWIMasterWait();
+}
+
+void hostTWIMasterContend(uint8_t address,
+                          const uint8_t *writeData, uint8_t writeLen,
+                          uint8_t *readData, uint8_t readLen) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    update(hostCycles());
+
+    twiContend = true;
+    twiHost.repeatedStart = false;
+    twiHost.address = address;
+    twiHost.writeData = writeData;
+    twiHost.writeLen = writeLen;
+    twiHost.readData = readData;
+    twiHost.readLen = readLen;
+    twiHost.count = 0;
+}
+
+int hostTWIMasterWait() {
+    // The Uno's ISR does the rest, on the interrupt thread.
+    for (;;) {
+        {
+            std::lock_guard<std::recursive_mutex> lock(busMutex);
+            if (!twiHost.active && !twiContend)
+                return twiHost.count;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(10));
+    }
+}
+
+
+//============================================================
+// USART0. Double buffered transmitter, two byte receive FIFO.
+//============================================================
+static uint8_t readUCSR0A(hostRegister8 *reg);
+static void writeUCSR0A(hostRegister8 *reg, uint8_t data, uint8_t mask);
+static void writeUCSR0B(hostRegister8 *reg, uint8_t data, uint8_t);
+static uint8_t readUDR0(hostRegister8 *reg);
+static void writeUDR0(hostRegister8 *reg, uint8_t data, uint8_t);
+
+hostRegister8 UCSR0A(readUCSR0A, writeUCSR0A);
+hostRegister8 UCSR0B(0, writeUCSR0B);
+hostRegister8 UDR0(readUDR0, writeUDR0);
+
+typedef struct usartFrame {
+    uint8_t data;
+    uint8_t errors;
+} usartFrame;
+
+static bool usartStdio = true;
+static bool usartReaderStarted;
+static void (*usartTxHook)(uint8_t data);
+
+static bool txHolding;
+static uint8_t txHoldingData;
+static bool txShifting;
+static uint8_t txShiftData;
+static uint64_t txShiftDone;
+
+static std::deque<usartFrame> rxWire;
+static uint64_t rxWireDone;
+static uint64_t rxWireFree;
+static usartFrame rxFifo[2];
+static uint8_t rxFifoCount;
+
+static uint32_t usartFrameCycles() {
+    uint32_t bitCycles = ((UCSR0A.value & (1 << U2X0)) ? 8 : 16) *
+                         ((UBRR0.value & 0x0FFF) + 1);
+
+    uint8_t size = ((UCSR0C.value >> UCSZ00) & 3) |
+                   ((UCSR0B.value & (1 << UCSZ02)) ? 4 : 0);
+    uint8_t dataBits = (size == 7) ? 9 : 5 + (size & 3);
+    uint8_t parityBits = (UCSR0C.value & (1 << UPM01)) ? 1 : 0;
+    uint8_t stopBits = (UCSR0C.value & (1 << USBS0)) ? 2 : 1;
+
+    return (1 + dataBits + parityBits + stopBits) * bitCycles;
+}
+
+static void usartEmit(uint8_t data) {
+    if (usartTxHook) {
+        usartTxHook(data);
+    } else if (usartStdio) {
+        ssize_t ignored = write(STDOUT_FILENO, &data, 1);
+        (void)ignored;
+    }
+}
+
+static void usartStartShift(uint64_t when) {
+    txShifting = true;
+    txShiftData = txHoldingData;
+    txHolding = false;
+    txShiftDone = when + usartFrameCycles();
+    UCSR0A.value |= (1 << UDRE0);
+}
+
+static void usartUpdate(uint64_t now) {
+    while (txShifting && now >= txShiftDone) {
+        txShifting = false;
+        usartEmit(txShiftData);
+
+        if (txHolding) {
+            usartStartShift(txShiftDone);
+        } else {
+            UCSR0A.value |= (1 << TXC0);
+        }
+    }
+
+    if (txShifting)
+        scheduleEvent(txShiftDone);
+
+    while (!rxWire.empty() && now >= rxWireDone) {
+        // With the RX interrupt on, a full FIFO means the host
+        // was late running the ISR, not that the AVR would have
+        // been. Hold the next frame back rather than overrun.
+        if (rxFifoCount == 2 && (UCSR0B.value & (1 << RXCIE0))) {
+            rxWireDone = now + 1;
+            break;
+        }
+
+        usartFrame frame = rxWire.front();
+        rxWire.pop_front();
+        rxWireFree = rxWireDone;
+
+        if (UCSR0B.value & (1 << RXEN0)) {
+            if (rxFifoCount < 2) {
+                rxFifo[rxFifoCount++] = frame;
+            } else {
+                // Lost. DOR0 shows up with the last byte kept.
+                rxFifo[1].errors |= (1 << DOR0);
+            }
+        }
+
+        if (!rxWire.empty())
+            rxWireDone += usartFrameCycles();
+    }
+
+    if (!rxWire.empty())
+        scheduleEvent(rxWireDone);
+}
+
+static void usartQueue(usartFrame frame) {
+    uint64_t now = hostCycles();
+    update(now);
+
+    if (rxWire.empty()) {
+        uint64_t start = (rxWireFree > now) ? rxWireFree : now;
+        rxWireDone = start + usartFrameCycles();
+        scheduleEvent(rxWireDone);
+    }
+
+    rxWire.push_back(frame);
+    kick();
+}
+
+void hostUSARTreceive(const uint8_t *data, size_t length) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+
+    for (size_t x = 0; x < length; x++) {
+        usartFrame frame = {data[x], 0};
+        usartQueue(frame);
+    }
+}
+
+void hostUSARTreceiveError(uint8_t data, uint8_t errors) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+
+    usartFrame frame = {
+        data,
+        (uint8_t)(errors & ((1 << FE0) | (1 << UPE0)))
+    };
+    usartQueue(frame);
+}
+
+void hostUSARTuseStdio(bool useStdio) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    usartStdio = useStdio;
+}
+
+void hostUSARTsetTxHook(void (*hook)(uint8_t data)) {
+    std::lock_guard<std::recursive_mutex> lock(busMutex);
+    usartTxHook = hook;
+}
+
+// Feeds stdin to the receiver, like a serial monitor.
+static void usartReader() {
+    uint8_t buffer[64];
+    ssize_t count;
+
+    while ((count = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0)
+        hostUSARTreceive(buffer, count);
+}
+
+static uint8_t readUCSR0A(hostRegister8 *reg) {
+    usartUpdate(hostCycles());
+
+    uint8_t result = reg->value &
+        ((1 << TXC0) | (1 << UDRE0) | (1 << U2X0) | (1 << MPCM0));
+
+    if (rxFifoCount)
+        result |= (1 << RXC0) | rxFifo[0].errors;
+
+    return result;
+}
+
+static void writeUCSR0A(hostRegister8 *reg, uint8_t data, uint8_t mask) {
+    usartUpdate(hostCycles());
+
+    uint8_t writable = (1 << U2X0) | (1 << MPCM0);
+    reg->value = (reg->value & ~writable) | (data & writable);
+
+    if (data & mask & (1 << TXC0))
+        reg->value &= ~(1 << TXC0);
+}
+
+static void writeUCSR0B(hostRegister8 *reg, uint8_t data, uint8_t) {
+    usartUpdate(hostCycles());
+    reg->value = data;
+
+    if (!(data & (1 << RXEN0)))
+        rxFifoCount = 0;
+
+    if ((data & (1 << RXEN0)) && usartStdio && !usartReaderStarted) {
+        usartReaderStarted = true;
+        std::thread(usartReader).detach();
+    }
+
+    kick();
+}
+
+static uint8_t readUDR0(hostRegister8 *reg) {
+    usartUpdate(hostCycles());
+
+    if (rxFifoCount) {
+        reg->value = rxFifo[0].data;
+        rxFifo[0] = rxFifo[1];
+        rxFifoCount--;
+    }
+
+    return reg->value;
+}
+
+static void writeUDR0(hostRegister8 *, uint8_t data, uint8_t) {
+    uint64_t now = hostCycles();
+    usartUpdate(now);
+
+    // Ignored if the transmitter is off, or UDRE0 is clear.
+    if (!(UCSR0B.value & (1 << TXEN0)) || txHolding)
+        return;
+
+    txHolding = true;
+    txHoldingData = data;
+    UCSR0A.value &= ~(1 << UDRE0);
+
+    if (!txShifting)
+        usartStartShift(now);
+
+    scheduleEvent(txShiftDone);
+    kick();
+}
+
+
+//============================================================
+// Interrupt dispatch.
+//============================================================
+
+// Bring every peripheral up to date.
+static void update(uint64_t now) {
+    nextEvent = UINT64_MAX;
+    wdtUpdate(now);
+    eepromUpdate(now);
+    timer1Update(now);
+    spiUpdate(now);
+    adcUpdate(now);
+    twiUpdate(now);
+    usartUpdate(now);
+}
+
+// Returns the highest priority pending interrupt, or zero.
+static uint8_t pendingVector() {
+    uint8_t eimsk = EIMSK.value;
+    uint8_t pcicr = PCICR.value;
+    uint8_t timsk = TIMSK1.value;
+    uint8_t tifr = TIFR1.value;
+    uint8_t ucsr0b = UCSR0B.value;
+
+    bool int0Low = !(EICRA.value & 3) && !(ports[2].levels & (1 << PD2));
+    bool int1Low = !(EICRA.value & 12) && !(ports[2].levels & (1 << PD3));
+
+    if ((eimsk & (1 << INT0)) && (int0Low || (EIFR.value & (1 << INTF0))))
+        return 1;
+    if ((eimsk & (1 << INT1)) && (int1Low || (EIFR.value & (1 << INTF1))))
+        return 2;
+
+    for (uint8_t x = 0; x < 3; x++) {
+        if ((pcicr & (1 << x)) && (PCIFR.value & (1 << x)))
+            return 3 + x;
+    }
+
+    if ((WDTCSR.value & (1 << WDIE)) && (WDTCSR.value & (1 << WDIF)))
+        return 6;
+
+    if ((timsk & (1 << ICIE1)) && (tifr & (1 << ICF1)))
+        return 10;
+    if ((timsk & (1 << OCIE1A)) && (tifr & (1 << OCF1A)))
+        return 11;
+    if ((timsk & (1 << OCIE1B)) && (tifr & (1 << OCF1B)))
+        return 12;
+    if ((timsk & (1 << TOIE1)) && (tifr & (1 << TOV1)))
+        return 13;
+
+    if ((SPCR.value & (1 << SPIE)) && (SPSR.value & (1 << SPIF)))
+        return 17;
+
+    if ((ucsr0b & (1 << RXCIE0)) && rxFifoCount)
+        return 18;
+    if ((ucsr0b & (1 << UDRIE0)) && (UCSR0A.value & (1 << UDRE0)))
+        return 19;
+    if ((ucsr0b & (1 << TXCIE0)) && (UCSR0A.value & (1 << TXC0)))
+        return 20;
+
+    if ((ADCSRA.value & (1 << ADIE)) && (ADCSRA.value & (1 << ADIF)))
+        return 21;
+
+    if ((EECR.value & (1 << EERIE)) && !(EECR.value & (1 << EEPE)))
+        return 22;
+
+    if ((ACSR.value & (1 << ACIE)) && (ACSR.value & (1 << ACI)))
+        return 23;
+
+    if ((TWCR.value & (1 << TWIE)) && (TWCR.value & (1 << TWEN)) &&
+        (TWCR.value & (1 << TWINT)))
+        return 24;
+
+    return 0;
+}
+
+// Flags that the hardware clears when the vector executes.
+static void acknowledge(uint8_t vector) {
+    switch (vector) {
+        case 1:  EIFR.value &= ~(1 << INTF0); break;
+        case 2:  EIFR.value &= ~(1 << INTF1); break;
+        case 3:
+        case 4:
+        case 5:  PCIFR.value &= ~(1 << (vector - 3)); break;
+        case 6:
+            WDTCSR.value &= ~(1 << WDIF);
+            if (WDTCSR.value & (1 << WDE))
+                WDTCSR.value &= ~(1 << WDIE);
+            break;
+        case 10: TIFR1.value &= ~(1 << ICF1); break;
+        case 11: TIFR1.value &= ~(1 << OCF1A); break;
+        case 12: TIFR1.value &= ~(1 << OCF1B); break;
+        case 13: TIFR1.value &= ~(1 << TOV1); break;
+        case 17: SPSR.value &= ~(1 << SPIF); break;
+        case 20: UCSR0A.value &= ~(1 << TXC0); break;
+        case 21: ADCSRA.value &= ~(1 << ADIF); break;
+        case 23: ACSR.value &= ~(1 << ACI); break;
+    }
+}
+
+static void dispatchInterrupts() {
+    bool again = false;
+
+    while (!stopping) {
+        // The AVR runs at least one instruction of main()
+        // between two interrupts. If an ISR left its own
+        // interrupt pending, give main() a moment to run.
+        if (again)
+            std::this_thread::sleep_for(std::chrono::microseconds(1));
+
+        std::lock_guard<std::mutex> isr(isrMutex);
+        if (!interruptsOn)
+            return;
+
+        uint8_t vector;
+        {
+            std::lock_guard<std::recursive_mutex> bus(busMutex);
+            update(hostCycles());
+            vector = pendingVector();
+            if (vector)
+                acknowledge(vector);
+        }
+
+        if (!vector)
+            return;
+
+        if (!vectorTable[vector]) {
+            // The AVR would jump to __bad_interrupt and reset.
+            fflush(stdout);
+            fprintf(stderr, "\nAVRhost: no ISR for %s_vect, "
+                            "exiting.\n", vectorNames[vector]);
+            _exit(1);
+        }
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+
+        inISR = true;
+        vectorTable[vector]();
+        inISR = false;
+        wakeSleeper();
+
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        hostVectorStats &stats = vectorStats[vector];
+        stats.calls++;
+        stats.nanoseconds += ns;
+        if (ns > stats.maxNanoseconds)
+            stats.maxNanoseconds = ns;
+
+        std::lock_guard<std::recursive_mutex> bus(busMutex);
+        again = (pendingVector() == vector);
+    }
+}
+
+static void interruptThreadMain() {
+    // Ask for accurate sleeps, rather than the default 50 us
+    // of timer slack.
+    prctl(PR_SET_TIMERSLACK, 1000UL);
+
+    // AVR interrupts pre-empt main(). On a single core host, a
+    // busy main() could otherwise hold off this thread for
+    // milliseconds, and the USART would overrun. This needs
+    // CAP_SYS_NICE or an RLIMIT_RTPRIO; without it, we carry
+    // on at normal priority.
+    sched_param param;
+    param.sched_priority = 1;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    while (!stopping) {
+        uint64_t wakeAt;
+        {
+            std::lock_guard<std::recursive_mutex> bus(busMutex);
+            update(hostCycles());
+            wakeAt = nextEvent;
+        }
+
+        dispatchInterrupts();
+
+        // Sleep until the next peripheral event, at most 1 ms,
+        // or until something interesting is written.
+        uint64_t now = hostCycles();
+        uint64_t cycles = (wakeAt > now) ? wakeAt - now : 0;
+        uint64_t us = cycles / (F_CPU / 1000000);
+        if (us > 1000)
+            us = 1000;
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        if (cycles) {
+            wakeCondition.wait_for(lock, std::chrono::microseconds(us),
+                                   [] { return wakeRequested ||
+                                               stopping.load(); });
+        }
+        wakeRequested = false;
+    }
+}
+
+
+//============================================================
+// Statistics.
+//============================================================
+hostVectorStats hostGetVectorStats(uint8_t vector) {
+    std::lock_guard<std::mutex> isr(isrMutex);
+
+    hostVectorStats result = {0, 0, 0};
+    if (vector < HOST_VECTORS)
+        result = vectorStats[vector];
+    return result;
+}
+
+void hostPrintVectorStats() {
+    fprintf(stderr, "\n%-14s %10s %12s %12s\n",
+            "Vector", "Calls", "Average ns", "Max ns");
+
+    for (uint8_t x = 1; x < HOST_VECTORS; x++) {
+        hostVectorStats stats = hostGetVectorStats(x);
+        if (!stats.calls)
+            continue;
+
+        fprintf(stderr, "%-14s %10u %12llu %12llu\n",
+                vectorNames[x], stats.calls,
+                (unsigned long long)(stats.nanoseconds / stats.calls),
+                (unsigned long long)stats.maxNanoseconds);
+    }
+}
+
+
+//============================================================
+// Power on. Set the reset values of the registers, call the
+// program's hostSetup(), if any, and start the interrupt
+// thread. It is stopped again when main() returns. Setting
+// the environment variable AVRHOST_STATS prints the ISR and
+// sleep statistics at exit.
+//============================================================
+extern "C" void hostSetup(void) __attribute__((weak));
+
+static void powerOff() {
+    stopping = true;
+    kick();
+    if (interruptThread.joinable())
+        interruptThread.join();
+
+    if (getenv("AVRHOST_STATS")) {
+        hostPrintVectorStats();
+        hostPrintSleepStats();
+    }
+}
+
+static struct hostPowerOn {
+    hostPowerOn() {
+        hostCycles();
+        mainThread = pthread_self();
+        memset(eeprom, 0xFF, sizeof(eeprom));
+
+        MCUSR.value = (1 << PORF);
+        UCSR0A.value = (1 << UDRE0);
+        UCSR0C.value = (1 << UCSZ01) | (1 << UCSZ00);
+        TWAR.value = 0xFE;
+        TWDR.value = 0xFF;
+        TWSR.value = 0xF8;
+        for (uint8_t x = 0; x < 3; x++)
+            ports[x].levels = portLevels(&ports[x]);
+
+        if (hostSetup)
+            hostSetup();
+
+        interruptThread = std::thread(interruptThreadMain);
+        atexit(powerOff);
+    }
+} powerOn;
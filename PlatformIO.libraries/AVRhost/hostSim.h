@@ -0,0 +1,202 @@
+#ifndef HOSTSIM_H
+#define HOSTSIM_H
+
+//============================================================
+// The host side of the ATmega328P simulation.
+//
+// The book's code never includes this file, it only sees the
+// registers in <avr/io.h>. This is the "outside world" of the
+// simulated Uno: feeding characters into the USART, attaching
+// TWI devices, setting input pins and analog voltages, and
+// measuring what the interrupt handlers cost.
+//
+// If the program defines hostSetup(), it is called once, just
+// before main(), and is the place to attach devices etc.
+//
+// Simulated time runs at F_CPU cycles per real second, from
+// program start. Peripheral events are processed and ISRs
+// dispatched by a background "interrupt thread".
+//============================================================
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+//------------------------------------------------------------
+// Optional hook, called once before main().
+//------------------------------------------------------------
+extern "C" void hostSetup(void);
+
+
+//------------------------------------------------------------
+// Simulated clock cycles since the program started.
+//------------------------------------------------------------
+uint64_t hostCycles();
+
+
+//============================================================
+// GPIO. Ports are 'B', 'C' or 'D'. An input pin which is not
+// driven externally reads high if its pull-up is on, low if
+// not. Driving a pin fires pin change, INT0/INT1 and input
+// capture (PB0) interrupts as appropriate.
+//============================================================
+void hostSetPin(char port, uint8_t pin, bool level);
+void hostReleasePin(char port, uint8_t pin);
+bool hostGetPin(char port, uint8_t pin);
+
+
+//============================================================
+// USART0. Transmitted bytes go to stdout, and stdin is fed to
+// the receiver, unless hostUSARTuseStdio(false) is called, or
+// a TX hook is installed. Received bytes arrive one frame time
+// apart at the configured baud rate.
+//============================================================
+void hostUSARTuseStdio(bool useStdio);
+void hostUSARTsetTxHook(void (*hook)(uint8_t data));
+void hostUSARTreceive(const uint8_t *data, size_t length);
+
+// Receive a byte with FE0 and/or UPE0 set in "errors".
+void hostUSARTreceiveError(uint8_t data, uint8_t errors);
+
+
+//============================================================
+// TWI. The simulated Uno is the master, and any number of
+// host side slave devices may be attached, or the Uno is a
+// slave, and the host is the master.
+//============================================================
+typedef struct hostTWIDevice {
+    uint8_t address;    // 7 bit address.
+
+    // Addressed by SLA+R or SLA+W. Return true to ACK.
+    bool (*start)(struct hostTWIDevice *device, bool read);
+
+    // Master sent a data byte. Return true to ACK.
+    bool (*write)(struct hostTWIDevice *device, uint8_t data);
+
+    // Master wants a data byte, and will ACK it if "ack".
+    uint8_t (*read)(struct hostTWIDevice *device, bool ack);
+
+    // STOP, or a repeated START, ended the conversation.
+    void (*stop)(struct hostTWIDevice *device);
+
+    // For the device's own use.
+    uint8_t *bank;
+    uint8_t bankSize;
+    uint8_t pointer;
+    uint8_t selected;
+    bool pointerSet;
+    bool autoIncrement;
+
+    struct hostTWIDevice *next;
+} hostTWIDevice;
+
+void hostTWIAttach(hostTWIDevice *device);
+
+// A ready made device, with "size" registers in "bank". The
+// first byte written after SLA+W selects a register, and the
+// pointer moves on after every byte read or written. Unless
+// "autoIncrement" is true, each new read starts again at the
+// selected register, as with the LM75A.
+void hostTWIRegisterDevice(hostTWIDevice *device,
+                           uint8_t address,
+                           uint8_t *bank,
+                           uint8_t size,
+                           bool autoIncrement = true);
+
+
+// A slave, part way through a byte, holds SDA (PC4) low until
+// SCL (PC5) has been clocked "clocks" times, as GPIO, by a bus
+// recovery. Until then, no START, STOP or byte ever finishes,
+// so TWINT is never set. Zero lets go at once.
+void hostTWIHoldSDA(uint8_t clocks);
+
+
+// The host as master, at "hz" SCL, 100 kHz by default. The Uno
+// as slave stretches the clock, for as long as TWINT is set.
+void hostTWIMasterClock(uint32_t hz);
+
+// Write "writeLen" bytes to the Uno at "address", then, after
+// a repeated START, read "readLen" bytes. Either length may be
+// zero, not both. Waits until it's done, and returns how many
+// bytes were sent and received, or -1 if the Uno didn't ACK
+// its address. Not from an ISR, or with interrupts off.
+int hostTWIMasterTransfer(uint8_t address,
+                          const uint8_t *writeData, uint8_t writeLen,
+                          uint8_t *readData, uint8_t readLen);
+
+// The same transfer, but started at the same moment as the
+// Uno's next START, as master, so the two contend for the bus.
+// The host wins arbitration on SLA+R/W. If it's addressing the
+// Uno, and the Uno has TWEA set, the Uno sees 0x68 or 0xB0 and
+// carries on as slave. If not, the Uno sees 0x38, and the
+// transfer counts as -1. Returns at once, wait for it with
+// hostTWIMasterWait().
+void hostTWIMasterContend(uint8_t address,
+                          const uint8_t *writeData, uint8_t writeLen,
+                          uint8_t *readData, uint8_t readLen);
+
+// Wait for the transfer above, or the one in progress, to
+// finish, and return what hostTWIMasterTransfer() would.
+int hostTWIMasterWait();
+
+
+//============================================================
+// EEPROM contents, E2END + 1 bytes, initially all 0xFF.
+//============================================================
+uint8_t *hostEEPROM();
+
+
+//============================================================
+// ADC input voltages, as 10 bit readings, per MUX channel.
+//============================================================
+void hostADCSet(uint8_t channel, uint16_t value);
+
+
+//============================================================
+// Analog comparator output. True if AIN0 > AIN1 (or ADC mux).
+//============================================================
+void hostACSet(bool output);
+
+
+//============================================================
+// SPI. As a controller, every byte sent is passed to the
+// device function, which returns the byte clocked back. As a
+// peripheral, hostSPITransfer() acts as the controller.
+//============================================================
+void hostSPIsetDevice(uint8_t (*exchange)(uint8_t data));
+uint8_t hostSPITransfer(uint8_t data);
+
+
+//============================================================
+// Interrupt handler statistics, per vector number.
+//============================================================
+typedef struct hostVectorStats {
+    uint32_t calls;          // How many times it ran.
+    uint64_t nanoseconds;    // Total host time spent in it.
+    uint64_t maxNanoseconds; // Slowest single call.
+} hostVectorStats;
+
+hostVectorStats hostGetVectorStats(uint8_t vector);
+
+// Print a table of all vectors that have run, to stderr.
+void hostPrintVectorStats();
+
+
+//============================================================
+// Sleep statistics, for the main code. "busyCycles" is the
+// host CPU time main() has actually used, as cycles, so
+// busy waits show up there, and sleep_cpu() in asleepCycles.
+//============================================================
+typedef struct hostSleepStats {
+    uint32_t sleeps;         // How many times it slept.
+    uint64_t asleepCycles;   // Cycles spent in sleep_cpu().
+    uint64_t busyCycles;     // Cycles spent running.
+    uint64_t totalCycles;    // Cycles since program start.
+} hostSleepStats;
+
+hostSleepStats hostGetSleepStats();
+
+// Print the above, to stderr.
+void hostPrintSleepStats();
+
+#endif // HOSTSIM_H
@@ -0,0 +1,162 @@
+//============================================================
+// RingBuffer in full capacity mode, with uint8_t indexes,
+// which roll over every 256 bytes. At each fill level, from
+// empty to full, over a thousand bytes go in and out, a byte
+// at a time and in bulk, and the order, cBufferFree(),
+// cBufferAvailable(), and the full and empty flags are checked
+// after every step against a plain count. The usual mode, at
+// 256 bytes, gets the same.
+//
+// Libraries: USARTbuffer
+//============================================================
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "USARTbuffer.h"
+
+static int failures;
+
+static void check(bool ok, const char *what, uint16_t size,
+                  uint16_t level, uint32_t step) {
+    if (!ok && failures++ < 20)
+        printf("ringBuffer: Size %u, level %u, step %lu: %s\n",
+               size, level, (unsigned long)step, what);
+}
+
+
+//------------------------------------------------------------
+// The buffer should hold "count" bytes, the oldest of which
+// is "next".
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+static void checkState(volatile RingBuffer<Size, IndexT, FullCapacity> *buf,
+                       uint16_t count, uint16_t level, uint32_t step) {
+    const uint16_t capacity = FullCapacity ? Size : Size - 1;
+
+    check(cBufferAvailable(buf) == count, "cBufferAvailable", Size, level,
+          step);
+    check(cBufferFree(buf) == capacity - count, "cBufferFree", Size, level,
+          step);
+    check(cBufferFull(buf) == (count == capacity), "cBufferFull", Size,
+          level, step);
+    check(cBufferEmpty(buf) == (count == 0), "cBufferEmpty", Size, level,
+          step);
+}
+
+
+//------------------------------------------------------------
+// Fill to "level", then stream "total" bytes through, keeping
+// it at that level, so head and tail both roll over several
+// times. Bytes are numbered, so order is easy to check.
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+static void stream(uint16_t level, uint32_t total) {
+    static volatile RingBuffer<Size, IndexT, FullCapacity> buf;
+    const uint16_t capacity = FullCapacity ? Size : Size - 1;
+    uint8_t in = 0;
+    uint8_t out = 0;
+    uint16_t count = 0;
+
+    cBufferInit(&buf);
+    cBufferSetPolicy(&buf, BUFFER_RETURN_ERROR);
+    checkState(&buf, 0, level, 0);
+
+    for (uint16_t x = 0; x < level; x++) {
+        check(cBufferAdd(&buf, in++) == ERR_BUFFER_OK, "fill", Size, level, x);
+        checkState(&buf, ++count, level, x);
+    }
+
+    for (uint32_t step = 0; step < total; step++) {
+        // One in, one out, a byte at a time.
+        if (count < capacity) {
+            check(cBufferAdd(&buf, in++) == ERR_BUFFER_OK, "add", Size,
+                  level, step);
+            count++;
+        } else {
+            check(cBufferAdd(&buf, 0xEE) == ERR_BUFFER_FULL, "add when full",
+                  Size, level, step);
+        }
+        checkState(&buf, count, level, step);
+
+        if (count > level || count == capacity) {
+            int got = cBufferGet(&buf);
+            check(got == out++, "order, cBufferGet", Size, level, step);
+            checkState(&buf, --count, level, step);
+        }
+
+        // Now and then, a few in and out in bulk, across the
+        // end of cBuffer.
+        if (step % 37 == 0) {
+            uint8_t data[7];
+            uint16_t room = capacity - count;
+            uint16_t want = room < sizeof(data) ? room : sizeof(data);
+
+            for (uint8_t y = 0; y < sizeof(data); y++)
+                data[y] = in + y;
+
+            uint16_t wrote = cBufferWrite(&buf, data, sizeof(data));
+            check(wrote == want, "cBufferWrite count", Size, level, step);
+            in += wrote;
+            count += wrote;
+            checkState(&buf, count, level, step);
+
+            uint16_t extra = count > level ? count - level : 0;
+            uint16_t read = cBufferRead(&buf, data, extra);
+            check(read == extra, "cBufferRead count", Size, level, step);
+            for (uint16_t y = 0; y < read; y++)
+                check(data[y] == out++, "order, cBufferRead", Size, level,
+                      step);
+            count -= read;
+            checkState(&buf, count, level, step);
+        }
+
+        // And the zero copy way, one run at a time.
+        if (step % 53 == 0 && count) {
+            const uint8_t *run;
+            uint16_t length = cBufferPeekContiguous(&buf, &run);
+
+            check(length && length <= count, "cBufferPeekContiguous", Size,
+                  level, step);
+            for (uint16_t y = 0; y < length; y++)
+                check(run[y] == uint8_t(out + y), "order, peek", Size, level,
+                      step);
+
+            uint16_t drop = length < count - level ? length : 0;
+            check(cBufferConsume(&buf, drop) == drop, "cBufferConsume", Size,
+                  level, step);
+            out += drop;
+            count -= drop;
+            checkState(&buf, count, level, step);
+        }
+    }
+
+    // Empty it, in order.
+    while (count) {
+        check(cBufferGet(&buf) == out++, "order, emptying", Size, level, total);
+        checkState(&buf, --count, level, total);
+    }
+
+    check(cBufferGet(&buf) == -1, "cBufferGet when empty", Size, level, total);
+    check(in == out, "bytes lost", Size, level, total);
+}
+
+
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+static void allLevels() {
+    const uint16_t capacity = FullCapacity ? Size : Size - 1;
+    const uint16_t levels[] = {0, 1, Size / 2, capacity - 1, capacity};
+
+    for (uint8_t x = 0; x < sizeof(levels) / sizeof(levels[0]); x++)
+        stream<Size, IndexT, FullCapacity>(levels[x], 1000);
+}
+
+
+int main() {
+    allLevels<2, uint8_t, true>();
+    allLevels<16, uint8_t, true>();
+    allLevels<64, uint8_t, true>();
+    allLevels<128, uint8_t, true>();
+    allLevels<256, uint8_t, false>();
+
+    return failures ? 1 : 0;
+}
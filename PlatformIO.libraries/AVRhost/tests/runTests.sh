@@ -0,0 +1,88 @@
+#!/bin/sh
+#--------------------------------------------------------------
+# Builds and runs the host tests, on the simulated ATmega328P.
+#
+# Each test is a .cpp file here, with a main() that returns 0
+# if all went well. A line like
+#
+#   // Libraries: TWI printf
+#
+# says which of the PlatformIO.libraries it needs, besides
+# AVRhost, and one like
+#
+#   // Flags: -DFRAME_MAX_PAYLOAD=255
+#
+# adds to the compiler flags, as build_flags would.
+#
+# A test named *_fail.cpp must NOT compile, it checks that a
+# static_assert catches something, and fails if the compiler
+# stops for any other reason.
+#
+# Run from anywhere, with an optional list of tests:
+#
+#   ./runTests.sh
+#   ./runTests.sh twiSlave ringBuffer
+#
+# Set CXX to use another compiler. Exits non-zero if any test
+# fails.
+#--------------------------------------------------------------
+
+TESTS=$(cd "$(dirname "$0")" && pwd)
+LIBS=$(cd "$TESTS/../.." && pwd)
+CXX=${CXX:-g++}
+FLAGS="-std=gnu++11 -O2 -Wall -Wextra -DF_CPU=16000000UL -pthread"
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+if [ $# -eq 0 ]; then
+    set -- $(cd "$TESTS" && ls *.cpp | sed 's/\.cpp$//')
+fi
+
+failed=0
+
+for test in "$@"; do
+    source="$TESTS/$test.cpp"
+    includes="-I$LIBS/AVRhost"
+    sources="$LIBS/AVRhost/hostSim.cpp"
+    flags="$FLAGS $(sed -n 's|^// Flags:||p' "$source")"
+
+    for lib in $(sed -n 's|^// Libraries:||p' "$source"); do
+        includes="$includes -I$LIBS/$lib"
+        sources="$sources $(ls "$LIBS/$lib"/*.cpp 2>/dev/null)"
+    done
+
+    case "$test" in
+    *_fail)
+        if $CXX $flags $includes -c "$source" -o "$OUT/$test.o" \
+                2>"$OUT/$test.log"; then
+            echo "FAIL $test: compiled, but shouldn't have"
+            failed=$((failed + 1))
+        elif ! grep -q "static assertion failed" "$OUT/$test.log"; then
+            echo "FAIL $test: didn't compile, but not for a static_assert"
+            cat "$OUT/$test.log"
+            failed=$((failed + 1))
+        else
+            echo "PASS $test"
+        fi
+        ;;
+
+    *)
+        if ! $CXX $flags $includes "$source" $sources -o "$OUT/$test"; then
+            echo "FAIL $test: didn't compile"
+            failed=$((failed + 1))
+        elif ! "$OUT/$test"; then
+            echo "FAIL $test"
+            failed=$((failed + 1))
+        else
+            echo "PASS $test"
+        fi
+        ;;
+    esac
+done
+
+if [ $failed -ne 0 ]; then
+    echo "$failed failed."
+    exit 1
+fi
+
+echo "All passed."
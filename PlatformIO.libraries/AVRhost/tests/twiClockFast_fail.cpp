@@ -0,0 +1,15 @@
+//============================================================
+// TWIInit<hz>() mustn't compile if the SCL clock is faster
+// than F_CPU / 16, as TWBR would have to be negative. 2 MHz,
+// at 16 MHz.
+//
+// Libraries: TWI
+//============================================================
+#include <avr/io.h>
+#include "TWIlib.h"
+
+int main() {
+    TWIInit<2000000>();
+
+    return 0;
+}
@@ -0,0 +1,15 @@
+//============================================================
+// TWIInit<hz>() mustn't compile if the SCL clock is slower
+// than TWBR = 255, with a prescaler of 64, allows. 400 Hz, at
+// 16 MHz.
+//
+// Libraries: TWI
+//============================================================
+#include <avr/io.h>
+#include "TWIlib.h"
+
+int main() {
+    TWIInit<400>();
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+//============================================================
+// TWIGetLastError() for every code from 0x00 to 0xFF. Each
+// status code the TWI sets gets its own message, any other
+// multiple of 8 and anything that isn't a multiple of 8 gets
+// "Unknown Error", and TWI_TIMEOUT gets the timeout message.
+//
+// Libraries: TWI
+//============================================================
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "TWIlib.h"
+#include "twiErrors.h"
+
+//------------------------------------------------------------
+// The status codes, from the data sheet, and their messages.
+//------------------------------------------------------------
+static const struct {
+    uint8_t code;
+    const char *message;
+} expected[] = {
+    {0x00, twiMsg00}, {0x08, twiMsg08}, {0x10, twiMsg10},
+    {0x18, twiMsg18}, {0x20, twiMsg20}, {0x28, twiMsg28},
+    {0x30, twiMsg30}, {0x38, twiMsg38}, {0x40, twiMsg40},
+    {0x48, twiMsg48}, {0x50, twiMsg50}, {0x58, twiMsg58},
+    {0x60, twiMsg60}, {0x68, twiMsg68}, {0x70, twiMsg70},
+    {0x78, twiMsg78}, {0x80, twiMsg80}, {0x88, twiMsg88},
+    {0x90, twiMsg90}, {0x98, twiMsg98}, {0xA0, twiMsgA0},
+    {0xA8, twiMsgA8}, {0xB0, twiMsgB0}, {0xB8, twiMsgB8},
+    {0xC0, twiMsgC0}, {0xC8, twiMsgC8}, {0xF8, twiMsgF8},
+    {TWI_TIMEOUT, twiMsgTimeout}
+};
+
+static const char *expectedMessage(uint8_t code) {
+    for (uint8_t x = 0; x < sizeof(expected) / sizeof(expected[0]); x++) {
+        if (expected[x].code == code)
+            return expected[x].message;
+    }
+
+    return twiMsgFF;
+}
+
+
+int main() {
+    int failures = 0;
+
+    for (int code = 0; code <= 0xFF; code++) {
+        const char *want = expectedMessage(code);
+        const char *got = TWIGetLastError(code);
+
+        if (!got || strcmp(got, want)) {
+            printf("twiErrors: 0x%02X is \"%s\", should be \"%s\"\n",
+                   code, got ? got : "(null)", want);
+            failures++;
+        }
+    }
+
+    // The edge cases, spelled out.
+    if (strcmp(TWIGetLastError(0xF8), "No relevant state information") ||
+        strcmp(TWIGetLastError(0xFF), "Unknown Error") ||
+        strcmp(TWIGetLastError(0xFE), "Timed out, bus recovered") ||
+        strcmp(TWIGetLastError(0x01), "Unknown Error") ||
+        strcmp(TWIGetLastError(0xD0), "Unknown Error")) {
+        printf("twiErrors: 0xF8, 0xFF, 0xFE, 0x01 or 0xD0 is wrong\n");
+        failures++;
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+//============================================================
+// TWIscheduler. Which devices TWIschedAdd() accepts, right at
+// the limit, and where periodMs * perTick would overflow. Then
+// three LM75As, read from a 1 ms Timer1 tick for two seconds,
+// while the main code reads another device with the legacy
+// TWITransmitData() and TWIReadData(), as fast as it can. No
+// read may fail, and the rates must match the periods.
+//
+// Libraries: TWI TWIscheduler
+//============================================================
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "hostSim.h"
+#include "TWIlib.h"
+#include "TWIscheduler.h"
+
+static int failures;
+
+static void check(bool ok, const char *what, long got) {
+    if (!ok) {
+        printf("twiScheduler: %s, got %ld\n", what, got);
+        failures++;
+    }
+}
+
+static hostTWIDevice lm75[3];
+static uint8_t lm75Registers[3][4];
+static hostTWIDevice eeprom;
+static uint8_t eepromRegisters[16];
+
+ISR(TIMER1_COMPA_vect) {
+    TWITick();
+    TWIschedTick();
+}
+
+
+//------------------------------------------------------------
+// At 100 kHz, and 50%, there are 50 bits a millisecond. One
+// step reading two bytes is 48 bits, three bytes 57. At 1 MHz,
+// and 500 bits a millisecond, 255 steps of a byte each are
+// 9945 bits, too many for 19 ms. Every 8.6 s fits easily, but
+// 8600 * 500000 millibits doesn't fit in 32 bits. More than
+// 255 bytes in all never fits the device.
+//------------------------------------------------------------
+static void adding() {
+    static TWIschedDevice device;
+    static uint8_t buffer[400];
+    static const TWIschedStep twoBytes[] = {{0, 2}};
+    static const TWIschedStep threeBytes[] = {{0, 3}};
+    static const TWIschedStep justFits[] = {{0, 200}, {0, 55}};
+    static const TWIschedStep tooBig[] = {{0, 200}, {0, 200}};
+    static const TWIschedStep oneOver[] = {{0, 255}, {0, 1}};
+    static TWIschedStep large[255];
+
+    for (uint16_t x = 0; x < 255; x++)
+        large[x] = {uint8_t(x), 1};
+
+    TWIInit<100000>();
+    TWIschedInit();
+    check(TWIschedAdd(&device, 0x48, 1, twoBytes, 1, buffer),
+          "48 bits in 50 refused", 0);
+    TWIschedInit();
+    check(!TWIschedAdd(&device, 0x48, 1, threeBytes, 1, buffer),
+          "57 bits in 50 accepted", 0);
+    check(TWIschedAdd(&device, 0x48, 2, threeBytes, 1, buffer),
+          "57 bits in 100 refused", 0);
+
+    TWIInit<1000000>();
+    TWIschedInit();
+    check(TWIschedAdd(&device, 0x48, 8600, large, 255, buffer),
+          "overflowed, large read refused", 0);
+    TWIschedInit();
+    check(!TWIschedAdd(&device, 0x48, 19, large, 255, buffer),
+          "large read too often accepted", 0);
+    check(TWIschedAdd(&device, 0x48, 20, large, 255, buffer),
+          "large read just often enough refused", 0);
+
+    TWIschedInit();
+    check(TWIschedAdd(&device, 0x48, 100, justFits, 2, buffer),
+          "255 bytes refused", 0);
+    TWIschedInit();
+    check(!TWIschedAdd(&device, 0x48, 100, tooBig, 2, buffer),
+          "400 bytes accepted", 0);
+    check(!TWIschedAdd(&device, 0x48, 100, oneOver, 2, buffer),
+          "256 bytes accepted", 0);
+}
+
+
+//------------------------------------------------------------
+// Select "reg" on the legacy device, then read "count" bytes
+// from it, the old way, as two transfers. Returns the result.
+// Not with a repeated START, as the legacy ISR leaves TWINT
+// set after one, and on the host, the interrupt thread would
+// then hog the CPU until this noticed. The waits are delay
+// loops, for the same reason.
+//------------------------------------------------------------
+static uint8_t legacyRead(uint8_t reg, uint8_t *data, uint8_t count) {
+    uint8_t select[2] = {0x50 << 1, reg};
+
+    TWIInfo.errorCode = TWI_NO_RELEVANT_INFO;
+    while (TWITransmitData(select, 2, false) == TWI_TX_RX_NOT_READY)
+        _delay_us(20);
+    while (TWIInfo.errorCode == TWI_NO_RELEVANT_INFO)
+        _delay_us(20);
+    if (TWIInfo.errorCode != TWI_SUCCESS)
+        return TWIInfo.errorCode;
+
+    TWIInfo.errorCode = TWI_NO_RELEVANT_INFO;
+    while (TWIReadData(0x50, count, data, false) == TWI_TX_RX_NOT_READY)
+        _delay_us(20);
+    while (TWIInfo.errorCode == TWI_NO_RELEVANT_INFO)
+        _delay_us(20);
+
+    return TWIInfo.errorCode;
+}
+
+
+static void sharing() {
+    static const TWIschedStep script[] = {{0, 2}, {1, 1}};
+    static const uint16_t periods[] = {20, 50, 100};
+    static TWIschedDevice devices[3];
+    static uint8_t buffers[3][3];
+
+    TWIInit<100000>();
+    TWIschedInit();
+
+    for (uint8_t x = 0; x < 3; x++)
+        check(TWIschedAdd(&devices[x], 0x48 + x, periods[x], script, 2,
+                          buffers[x]), "LM75A refused", x);
+
+    // 1 ms ticks, CTC mode, divide by 64.
+    OCR1A = F_CPU / 64 / 1000 - 1;
+    TIMSK1 = (1 << OCIE1A);
+    TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10);
+
+    uint64_t end = hostCycles() + 2 * F_CPU;
+    long legacyReads = 0;
+
+    while (hostCycles() < end) {
+        uint8_t data[4];
+        uint8_t reg = legacyReads & 7;
+        uint8_t result = legacyRead(reg, data, 4);
+
+        if (result != TWI_SUCCESS ||
+            memcmp(data, eepromRegisters + reg, 4)) {
+            check(false, "legacy read", result);
+            break;
+        }
+
+        legacyReads++;
+    }
+
+    TCCR1B = 0;
+
+    printf("twiScheduler: %ld legacy reads alongside\n", legacyReads);
+    check(legacyReads > 100, "too few legacy reads", legacyReads);
+
+    for (uint8_t x = 0; x < 3; x++) {
+        TWIschedStatsStruct stats;
+        uint8_t data[3];
+
+        TWIschedStats(&devices[x], &stats);
+        uint32_t rate = 1000000UL / periods[x];
+
+        printf("twiScheduler: %3u ms, %4u reads, %lu.%03lu Hz, "
+               "jitter %lu us max, %u skipped\n",
+               periods[x], stats.samples,
+               (unsigned long)stats.rateMilliHz / 1000,
+               (unsigned long)stats.rateMilliHz % 1000,
+               (unsigned long)stats.jitterMaxUs, stats.skipped);
+
+        check(stats.errors == 0, "scheduled read failed", stats.errors);
+        check(stats.samples >= 2000 / periods[x] - 2, "too few reads",
+              stats.samples);
+        check(stats.rateMilliHz > rate * 95 / 100 &&
+              stats.rateMilliHz < rate * 105 / 100,
+              "rate", (long)stats.rateMilliHz);
+
+        check(TWIschedFetch(&devices[x], data) == TWI_SUCCESS, "fetch", x);
+        check(data[0] == 20 + x && data[1] == 0x80 && data[2] == 0x80,
+              "fetched data", data[0]);
+    }
+}
+
+
+int main() {
+    for (uint8_t x = 0; x < 3; x++) {
+        lm75Registers[x][0] = 20 + x;
+        lm75Registers[x][1] = 0x80;
+        hostTWIRegisterDevice(&lm75[x], 0x48 + x, lm75Registers[x], 4,
+                              false);
+    }
+
+    for (uint8_t x = 0; x < sizeof(eepromRegisters); x++)
+        eepromRegisters[x] = 0xA0 + x;
+    hostTWIRegisterDevice(&eeprom, 0x50, eepromRegisters,
+                          sizeof(eepromRegisters));
+
+    sei();
+    adding();
+    sharing();
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+//============================================================
+// TWIlib's slave mode, against the host as master. Register
+// selection, auto increment, the end of the bank, the
+// callback, arbitration lost to a master addressing us, and
+// the throughput at 100 kHz, 400 kHz and 1 MHz.
+//
+// Libraries: TWI
+//============================================================
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "hostSim.h"
+#include "TWIlib.h"
+
+static const uint8_t slaveAddress = 0x20;
+static volatile uint8_t registers[32];
+static volatile int calls;
+static volatile int lastRegister;
+static volatile int lastCount;
+
+static hostTWIDevice lm75;
+static uint8_t lm75Registers[4] = {0x19, 0x80, 0x00, 0x00};
+
+static int failures;
+
+static void check(bool ok, const char *what, int got) {
+    if (!ok) {
+        printf("twiSlave: %s, got %d\n", what, got);
+        failures++;
+    }
+}
+
+static void written(uint8_t reg, uint8_t count) {
+    calls++;
+    lastRegister = reg;
+    lastCount = count;
+}
+
+
+//------------------------------------------------------------
+// The host reads and writes the register bank.
+//------------------------------------------------------------
+static void registerBank() {
+    uint8_t data[8];
+
+    uint8_t write[] = {2, 0x11, 0x22, 0x33, 0x44};
+    int n = hostTWIMasterTransfer(slaveAddress, write, 5, 0, 0);
+    check(n == 5, "write count", n);
+    check(registers[2] == 0x11 && registers[5] == 0x44, "written", n);
+    check(calls == 1 && lastRegister == 2 && lastCount == 4,
+          "callback", calls);
+
+    uint8_t reg = 2;
+    n = hostTWIMasterTransfer(slaveAddress, &reg, 1, data, 4);
+    check(n == 5, "read count", n);
+    check(!memcmp(data, write + 1, 4), "read back", data[0]);
+    check(calls == 1, "no callback for a read", calls);
+
+    // A current address read carries on from register 6.
+    registers[6] = 0x66;
+    n = hostTWIMasterTransfer(slaveAddress, 0, 0, data, 2);
+    check(n == 2 && data[0] == 0x66, "current address read", data[0]);
+
+    n = hostTWIMasterTransfer(slaveAddress + 1, &reg, 1, 0, 0);
+    check(n == -1, "wrong address", n);
+
+    // Only two of the four fit, the third is NACKed.
+    uint8_t pastEnd[] = {30, 1, 2, 3, 4};
+    n = hostTWIMasterTransfer(slaveAddress, pastEnd, 5, 0, 0);
+    check(n == 3 && registers[31] == 2 && lastCount == 2, "write end", n);
+
+    // Reading off the end gets 0xFF.
+    reg = 31;
+    n = hostTWIMasterTransfer(slaveAddress, &reg, 1, data, 3);
+    check(n == 4 && data[0] == 2 && data[1] == 0xFF, "read end", data[1]);
+}
+
+
+//------------------------------------------------------------
+// Queue a read of the LM75A, and have the host start its own
+// transfer at the same moment, which wins arbitration. The
+// master is "address", and it writes "writeLen" bytes, or
+// reads two. Returns what the host got, the Uno's result is
+// in "result".
+//------------------------------------------------------------
+static int contend(uint8_t address, uint8_t writeLen, uint8_t *result) {
+    static uint8_t write[] = {8, 0xA5, 0x5A};
+    static uint8_t read[2];
+    static uint8_t temperature[2];
+    static const uint8_t reg = 0;
+    TWIHandle handle;
+
+    hostTWIMasterContend(address, write, writeLen, read, writeLen ? 0 : 2);
+    TWIWriteRead(0x48, &reg, 1, temperature, 2, TWISignal, (void *)&handle);
+
+    int n = hostTWIMasterWait();
+    *result = TWIWait(&handle);
+
+    if (*result == TWI_SUCCESS)
+        check(temperature[0] == 0x19 && temperature[1] == 0x80,
+              "temperature after arbitration", temperature[0]);
+
+    return n;
+}
+
+static void arbitration() {
+    uint8_t result;
+
+    // Lost to a master writing to us. We answer as slave, 0x68,
+    // then start our own again.
+    int n = contend(slaveAddress, 3, &result);
+    check(n == 3, "0x68 write count", n);
+    check(registers[8] == 0xA5 && registers[9] == 0x5A, "0x68 written", n);
+    check(result == TWI_SUCCESS, "0x68 queued read", result);
+
+    // Lost to a master reading from us, 0xB0.
+    registers[10] = 0x77;
+    n = contend(slaveAddress, 0, &result);
+    check(n == 2, "0xB0 read count", n);
+    check(result == TWI_SUCCESS, "0xB0 queued read", result);
+
+    // Lost to a master addressing someone else. Ours fails.
+    n = contend(slaveAddress + 1, 3, &result);
+    check(n == -1, "0x38 host", n);
+    check(result == TWI_LOST_ARBIT, "0x38 queued read", result);
+}
+
+
+//------------------------------------------------------------
+// Write 16 bytes, and read them back, 200 times, at each SCL
+// frequency. The Uno stretches SCL while its ISR runs, so it's
+// never as quick as the clock alone would allow, but mustn't
+// get any slower than it was.
+//------------------------------------------------------------
+static void throughput() {
+    static const struct {
+        uint32_t clock;
+        uint32_t least;         // Bytes/s.
+    } rates[] = {
+        { 100000,  5000},
+        { 400000,  9000},
+        {1000000, 10000}
+    };
+
+    for (uint8_t x = 0; x < sizeof(rates) / sizeof(rates[0]); x++) {
+        uint8_t write[17];
+        uint8_t read[16];
+        uint8_t reg = 0;
+        long bytes = 0;
+
+        hostTWIMasterClock(rates[x].clock);
+        uint64_t start = hostCycles();
+
+        for (int pass = 0; pass < 200; pass++) {
+            write[0] = 0;
+            for (int y = 1; y < 17; y++)
+                write[y] = pass + y;
+
+            bytes += hostTWIMasterTransfer(slaveAddress, write, 17, 0, 0);
+            bytes += hostTWIMasterTransfer(slaveAddress, &reg, 1, read, 16);
+            if (memcmp(read, write + 1, 16)) {
+                check(false, "throughput data", pass);
+                break;
+            }
+        }
+
+        uint64_t cycles = hostCycles() - start;
+        uint32_t rate = (uint32_t)(bytes * F_CPU / cycles);
+
+        printf("twiSlave: %7lu Hz SCL, %5lu bytes/s\n",
+               (unsigned long)rates[x].clock, (unsigned long)rate);
+        check(rate >= rates[x].least, "throughput", (int)rate);
+    }
+
+    hostTWIMasterClock(100000);
+}
+
+
+int main() {
+    hostTWIRegisterDevice(&lm75, 0x48, lm75Registers, sizeof(lm75Registers),
+                          false);
+    sei();
+    TWIInit();
+    TWISlaveInit(slaveAddress, registers, sizeof(registers), written);
+
+    registerBank();
+    arbitration();
+    throughput();
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+//============================================================
+// TWITick() timing out a TWITransmitData() with the queue
+// full behind it. A slave holds SDA low, so the legacy write
+// never gets its START, and the queued reads can't start
+// either. After the timeout and bus recovery, the legacy call
+// gets TWI_TIMEOUT, and every queued read must still happen.
+//
+// Libraries: TWI
+//============================================================
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "hostSim.h"
+#include "TWIlib.h"
+
+static int failures;
+
+static void check(bool ok, const char *what, int got) {
+    if (!ok) {
+        printf("twiTimeout: %s, got %d\n", what, got);
+        failures++;
+    }
+}
+
+static hostTWIDevice lm75;
+static uint8_t lm75Registers[4] = {0x19, 0x80, 0x00, 0x00};
+
+ISR(TIMER1_COMPA_vect) {
+    TWITick();
+}
+
+
+//------------------------------------------------------------
+// Wait for "*result" to change, for up to a second.
+//------------------------------------------------------------
+static uint8_t waitFor(volatile uint8_t *result) {
+    uint64_t end = hostCycles() + F_CPU;
+
+    while (*result == TWI_NO_RELEVANT_INFO && hostCycles() < end)
+        _delay_us(20);
+
+    return *result;
+}
+
+
+int main() {
+    static uint8_t select[] = {0x48 << 1, 0};
+    static const uint8_t reg = 0;
+    static uint8_t temperatures[TWI_QUEUE_SIZE][2];
+    static TWIHandle handles[TWI_QUEUE_SIZE];
+    static uint8_t spare[2];
+    static TWIHandle spareHandle;
+
+    hostTWIRegisterDevice(&lm75, 0x48, lm75Registers, sizeof(lm75Registers),
+                          false);
+    sei();
+    TWIInit();
+
+    // 1 ms ticks, CTC mode, divide by 64.
+    OCR1A = F_CPU / 64 / 1000 - 1;
+    TIMSK1 = (1 << OCIE1A);
+    TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10);
+
+    hostTWIHoldSDA(5);
+
+    TWIInfo.errorCode = TWI_NO_RELEVANT_INFO;
+    uint8_t result = TWITransmitData(select, 2, false);
+    check(result == TWI_TX_RX_SUCCESS, "legacy write refused", result);
+
+    // Fill the queue behind it.
+    for (uint8_t x = 0; x < TWI_QUEUE_SIZE; x++) {
+        result = TWIWriteRead(0x48, &reg, 1, temperatures[x], 2, TWISignal,
+                              (void *)&handles[x]);
+        check(result == TWI_TX_RX_SUCCESS, "queueing refused", x);
+    }
+
+    result = TWIWriteRead(0x48, &reg, 1, spare, 2, TWISignal,
+                          (void *)&spareHandle);
+    check(result == TWI_TX_RX_NOT_READY, "full queue accepted", result);
+
+    result = waitFor(&TWIInfo.errorCode);
+    check(result == TWI_TIMEOUT, "legacy write", result);
+
+    for (uint8_t x = 0; x < TWI_QUEUE_SIZE; x++) {
+        result = waitFor(&handles[x]);
+        check(result == TWI_SUCCESS, "queued read", result);
+        check(temperatures[x][0] == 0x19 && temperatures[x][1] == 0x80,
+              "queued read data", temperatures[x][0]);
+    }
+
+    // And the queue still works.
+    result = TWIWriteRead(0x48, &reg, 1, spare, 2, TWISignal,
+                          (void *)&spareHandle);
+    check(result == TWI_TX_RX_SUCCESS, "queueing afterwards", result);
+    result = waitFor(&spareHandle);
+    check(result == TWI_SUCCESS && spare[0] == 0x19, "read afterwards",
+          result);
+
+    TWIStatsStruct stats;
+    TWIStats(&stats, false);
+    check(stats.timeouts == 1 && stats.recoveries == 1 && stats.stuck == 0,
+          "timeouts", stats.timeouts);
+
+    TCCR1B = 0;
+
+    return failures ? 1 : 0;
+}
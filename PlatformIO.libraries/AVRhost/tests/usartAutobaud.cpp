@@ -0,0 +1,121 @@
+//============================================================
+// autobaudSnap(), in and just out of each standard rate's
+// window, and where the 230400 and 250000 windows overlap.
+// Then USARTautobaud(), timing out with nothing sent, must
+// give Timer/counter 1 back as the header says.
+//
+// Libraries: USARTautobaud USARTinterrupt USARTbuffer printf
+//============================================================
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "USARTautobaud.h"
+
+static int failures;
+
+static void check(bool ok, const char *what, uint32_t got) {
+    if (!ok && failures++ < 20)
+        printf("usartAutobaud: %s, got %lu\n", what, (unsigned long)got);
+}
+
+
+//------------------------------------------------------------
+// Every standard rate, and 5% either side, snaps to itself,
+// and a little more than 5% doesn't, unless it's in the
+// overlap. Then rates in the overlap go to the nearer one.
+//------------------------------------------------------------
+static void snap() {
+    static const uint32_t rates[] = {
+        300, 600, 1200, 2400, 4800, 9600, 19200, 38400, 76800,
+        14400, 28800, 57600, 115200, 230400,
+        250000, 500000, 1000000
+    };
+
+    for (uint8_t x = 0; x < sizeof(rates) / sizeof(rates[0]); x++) {
+        uint32_t rate = rates[x];
+        uint32_t window = rate / 100 * AUTOBAUD_SNAP_ERROR / 100;
+        uint32_t got;
+
+        got = autobaudSnap(rate);
+        check(got == rate, "exact rate", got);
+        got = autobaudSnap(rate - window);
+        check(got == rate || (rate == 250000 && got == 230400),
+              "bottom of window", got);
+        got = autobaudSnap(rate + window);
+        check(got == rate || (rate == 230400 && got == 250000),
+              "top of window", got);
+
+        got = autobaudSnap(rate - window - 1);
+        check(got == rate - window - 1 || rate == 250000,
+              "below window", got);
+        got = autobaudSnap(rate + window + 1);
+        check(got == rate + window + 1 || rate == 230400,
+              "above window", got);
+    }
+
+    // 230400 goes up to 241920, and 250000 down to 237500.
+    // Half way is 240200.
+    static const struct {
+        uint32_t measured;
+        uint32_t rate;
+    } overlap[] = {
+        {237000, 230400},
+        {237500, 230400},
+        {240199, 230400},
+        {240200, 230400},
+        {240201, 250000},
+        {241920, 250000},
+        {242000, 250000}
+    };
+
+    for (uint8_t x = 0; x < sizeof(overlap) / sizeof(overlap[0]); x++) {
+        uint32_t got = autobaudSnap(overlap[x].measured);
+        check(got == overlap[x].rate, "in the overlap", got);
+    }
+}
+
+
+//------------------------------------------------------------
+// Timer/counter 1 set up with a pending overflow, and a count
+// and ICR1 to keep, while its clock is stopped. USARTautobaud()
+// runs it past OCR1A and OCR1B, and must clear their flags.
+//------------------------------------------------------------
+static void timerKept() {
+    TIMSK1 = 0;
+    TCCR1A = 0;
+    TCNT1 = 0xFFF0;
+    TCCR1B = (1 << CS10);
+    _delay_us(10);
+    TCCR1B = 0;
+    check(TIFR1 & (1 << TOV1), "no overflow to keep", TIFR1);
+
+    TCNT1 = 1234;
+    ICR1 = 4321;
+    OCR1A = 100;
+    TIFR1 = (1 << OCF1A) | (1 << OCF1B);
+
+    uint32_t rate = USARTautobaud(5);
+    check(rate == 0, "rate with nothing sent", rate);
+
+    check(TCCR1A == 0 && TCCR1B == 0 && TIMSK1 == 0, "control registers",
+          TCCR1B);
+    check(TCNT1 == 1234, "TCNT1", TCNT1);
+    check(ICR1 == 4321, "ICR1", ICR1);
+    check(TIFR1 == (1 << TOV1), "flags", TIFR1);
+
+    // And flags we didn't find set are cleared.
+    TIFR1 = (1 << TOV1) | (1 << OCF1B);
+    USARTautobaud(5);
+    check(TIFR1 == 0, "flags set by USARTautobaud()", TIFR1);
+}
+
+
+int main() {
+    sei();
+
+    snap();
+    timerKept();
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+//============================================================
+// usartBaudSolve(), which init(baudRate) uses at run time,
+// against the constexpr solver, which init<baudRate>() uses.
+// Every baud rate the constexpr one can do must get the same
+// U2X0 and UBRR0 from both, and the rest the nearest there is.
+//
+// Libraries: USARTinterrupt USARTbuffer printf
+//============================================================
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "USARTbaud.h"
+
+static int failures;
+
+static void check(bool ok, const char *what, uint32_t baudRate) {
+    if (!ok && failures++ < 20)
+        printf("usartBaud: %s at %lu baud\n", what,
+               (unsigned long)baudRate);
+}
+
+
+//------------------------------------------------------------
+// At 16 MHz, the closer of the two settings in the data
+// sheet's table of UBRR settings, normal speed if a tie.
+//------------------------------------------------------------
+static void common() {
+    static const struct {
+        uint32_t baudRate;
+        bool u2x;
+        uint16_t ubrr;
+    } table[] = {
+        {  2400, true,  832},
+        {  9600, false, 103},
+        { 19200, false,  51},
+        { 38400, false,  25},
+        { 57600, true,   34},
+        {115200, true,   16},
+        {250000, false,   3},
+        {500000, false,   1},
+        {1000000, false,  0},
+        {2000000, true,   0}
+    };
+
+    for (uint8_t x = 0; x < sizeof(table) / sizeof(table[0]); x++) {
+        bool u2x;
+        uint16_t ubrr = usartBaudSolve(table[x].baudRate, &u2x);
+
+        check(u2x == table[x].u2x && ubrr == table[x].ubrr,
+              "not as the data sheet", table[x].baudRate);
+    }
+}
+
+
+//------------------------------------------------------------
+// Every rate up to F_CPU / 8, more sparsely as it goes up.
+//------------------------------------------------------------
+static void everyRate() {
+    for (uint32_t baudRate = 1; baudRate <= F_CPU / 8;
+         baudRate += 1 + baudRate / 1000) {
+        bool u2x;
+        uint16_t ubrr = usartBaudSolve(baudRate, &u2x);
+        bool want = usartBaudU2X(baudRate);
+
+        if (!usartBaudValid(baudRate, want)) {
+            check(!u2x && ubrr == 4095, "too slow, not the slowest",
+                  baudRate);
+            continue;
+        }
+
+        check(u2x == want, "U2X0 differs", baudRate);
+        check(ubrr == usartBaudUBRR(baudRate, want), "UBRR0 differs",
+              baudRate);
+    }
+
+    // Too fast, and nothing at all.
+    bool u2x;
+    uint16_t ubrr = usartBaudSolve(F_CPU / 4, &u2x);
+    check(u2x && ubrr == 0, "too fast, not the fastest", F_CPU / 4);
+
+    ubrr = usartBaudSolve(0, &u2x);
+    check(!u2x && ubrr == 4095, "not the slowest", 0);
+}
+
+
+int main() {
+    common();
+    everyRate();
+
+    return failures ? 1 : 0;
+}
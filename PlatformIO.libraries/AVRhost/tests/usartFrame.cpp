@@ -0,0 +1,266 @@
+//============================================================
+// USARTframe, COBS and CRC-16, encoded then decoded. Payloads
+// of every length, with zeros in awkward places, runs of 253,
+// 254 and 255 non-zero bytes, frames with a corrupted byte,
+// cut short, or too long, and idle zeros between frames.
+//
+// Libraries: USARTframe USARTinterrupt USARTbuffer printf
+// Flags: -DFRAME_MAX_PAYLOAD=255
+//============================================================
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "USARTframe.h"
+
+static int failures;
+
+static void fail(const char *what, int length) {
+    if (failures++ < 20)
+        printf("usartFrame: %s, payload of %d\n", what, length);
+}
+
+
+//------------------------------------------------------------
+// A repeatable pseudo random sequence.
+//------------------------------------------------------------
+static uint32_t seed = 12345;
+
+static uint8_t randomByte() {
+    seed = seed * 1103515245UL + 12345;
+    return seed >> 16;
+}
+
+
+//------------------------------------------------------------
+// Feed "count" bytes of "frame" to the decoder. Every byte but
+// the last should get FRAME_NONE. Returns what the last got.
+//------------------------------------------------------------
+static uint8_t decode(frameDecoder *decoder, const uint8_t *frame,
+                      uint16_t count, int length) {
+    for (uint16_t x = 0; x + 1 < count; x++) {
+        if (frameDecodeByte(decoder, frame[x]) != FRAME_NONE)
+            fail("frame ended early", length);
+    }
+
+    return frameDecodeByte(decoder, frame[count - 1]);
+}
+
+
+//------------------------------------------------------------
+// Encode "payload", check the frame is well formed, decode
+// it, and check it comes back the same.
+//------------------------------------------------------------
+static void roundTrip(frameDecoder *decoder, const uint8_t *payload,
+                      uint8_t length) {
+    uint8_t frame[FRAME_MAX_ENCODED];
+    uint16_t count = frameEncode(payload, length, frame);
+
+    if (count > FRAME_MAX_ENCODED || count < length + 4) {
+        fail("encoded length", length);
+        return;
+    }
+
+    if (memchr(frame, 0, count - 1) || frame[count - 1])
+        fail("zero in the wrong place", length);
+
+    uint8_t result = decode(decoder, frame, count, length);
+    if (result != FRAME_OK) {
+        fail("didn't decode", length);
+        return;
+    }
+
+    if (decoder->length != length || memcmp(decoder->data, payload, length))
+        fail("decoded payload differs", length);
+}
+
+
+//------------------------------------------------------------
+// The example in USARTframe.h.
+//------------------------------------------------------------
+static void example(frameDecoder *decoder) {
+    static const uint8_t payload[] = {0x11, 0x00, 0x22};
+    static const uint8_t expected[] = {0x02, 0x11, 0x04, 0x22,
+                                       0x6A, 0xE4, 0x00};
+    uint8_t frame[FRAME_MAX_ENCODED];
+
+    uint16_t count = frameEncode(payload, sizeof(payload), frame);
+    if (count != sizeof(expected) || memcmp(frame, expected, count))
+        fail("the example in USARTframe.h", sizeof(payload));
+
+    roundTrip(decoder, payload, sizeof(payload));
+}
+
+
+//------------------------------------------------------------
+// Zeros, and runs either side of the 254 byte limit.
+//------------------------------------------------------------
+static void edgeCases(frameDecoder *decoder) {
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+
+    // Nothing at all, just the CRC.
+    roundTrip(decoder, payload, 0);
+
+    // All zeros, every length.
+    memset(payload, 0, sizeof(payload));
+    for (uint16_t length = 1; length <= FRAME_MAX_PAYLOAD; length++)
+        roundTrip(decoder, payload, length);
+
+    // All non-zero, every length, so runs of 253, 254 and 255
+    // bytes, with and without the CRC on the end of them.
+    memset(payload, 0x55, sizeof(payload));
+    for (uint16_t length = 1; length <= FRAME_MAX_PAYLOAD; length++)
+        roundTrip(decoder, payload, length);
+
+    // A single zero, at every position, in a full payload, so
+    // the runs before and after it are every length.
+    for (uint16_t zero = 0; zero < FRAME_MAX_PAYLOAD; zero++) {
+        memset(payload, 0xAA, sizeof(payload));
+        payload[zero] = 0;
+        roundTrip(decoder, payload, FRAME_MAX_PAYLOAD);
+        roundTrip(decoder, payload, zero + 1);
+    }
+
+    // Exactly 254 non-zero bytes, then a zero, then more.
+    memset(payload, 0x01, sizeof(payload));
+    payload[254] = 0;
+    roundTrip(decoder, payload, 255);
+    roundTrip(decoder, payload, 254);
+}
+
+
+//------------------------------------------------------------
+// Random payloads, of random lengths.
+//------------------------------------------------------------
+static void randomPayloads(frameDecoder *decoder) {
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+
+    for (int pass = 0; pass < 2000; pass++) {
+        uint8_t length = randomByte();
+        bool sparse = pass & 1;
+
+        for (uint8_t x = 0; x < length; x++) {
+            uint8_t aByte = randomByte();
+            payload[x] = (sparse && aByte < 0xC0) ? 0 : aByte;
+        }
+
+        roundTrip(decoder, payload, length);
+    }
+}
+
+
+//------------------------------------------------------------
+// Change one data byte, not a code byte, to another non-zero
+// value. COBS still works, but the CRC mustn't. Then the same
+// with a code byte, which the decoder must not take as good.
+// Either way, a good frame after a bad one still decodes.
+//------------------------------------------------------------
+static void corrupted(frameDecoder *decoder) {
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    uint8_t frame[FRAME_MAX_ENCODED];
+    bool isCode[FRAME_MAX_ENCODED];
+
+    for (int pass = 0; pass < 2000; pass++) {
+        uint8_t length = randomByte();
+        for (uint8_t x = 0; x < length; x++)
+            payload[x] = randomByte() & (pass & 1 ? 0x03 : 0xFF);
+
+        uint16_t count = frameEncode(payload, length, frame);
+
+        // Which bytes are code bytes?
+        memset(isCode, 0, sizeof(isCode));
+        for (uint16_t x = 0; x < count - 1; x += frame[x])
+            isCode[x] = true;
+
+        // A data byte.
+        uint16_t at;
+        do {
+            at = (randomByte() | (randomByte() << 8)) % (count - 1);
+        } while (isCode[at]);
+
+        uint8_t was = frame[at];
+        uint8_t flip = 1 << (randomByte() & 7);
+        frame[at] = (was ^ flip) ? was ^ flip : was ^ 0xFF;
+
+        if (decode(decoder, frame, count, length) != FRAME_BAD_CRC)
+            fail("corrupted data byte not caught", length);
+
+        frame[at] = was;
+
+        // A code byte, still not zero.
+        do {
+            at = (randomByte() | (randomByte() << 8)) % (count - 1);
+        } while (!isCode[at]);
+
+        frame[at] = frame[at] == 1 ? 2 : frame[at] - 1;
+        uint8_t result = decode(decoder, frame, count, length);
+        if (result == FRAME_OK || result == FRAME_NONE)
+            fail("corrupted code byte not caught", length);
+
+        roundTrip(decoder, payload, length);
+    }
+}
+
+
+//------------------------------------------------------------
+// Frames that end in the middle of a run, or don't end in
+// time, and zeros between frames.
+//------------------------------------------------------------
+static void badFrames(frameDecoder *decoder) {
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    uint8_t frame[FRAME_MAX_ENCODED];
+
+    memset(payload, 0x33, 20);
+    uint16_t count = frameEncode(payload, 20, frame);
+
+    // Cut short, the delimiter arrives part way through a run.
+    frame[10] = 0;
+    if (decode(decoder, frame, 11, 20) != FRAME_BAD_COBS)
+        fail("cut short frame not caught", 20);
+
+    // A lone code byte is too short for a CRC.
+    static const uint8_t lone[] = {0x01, 0x00};
+    if (decode(decoder, lone, sizeof(lone), 0) != FRAME_BAD_COBS)
+        fail("frame with no CRC not caught", 0);
+
+    // Idle zeros are ignored.
+    for (uint8_t x = 0; x < 5; x++) {
+        if (frameDecodeByte(decoder, 0) != FRAME_NONE)
+            fail("idle zero", 0);
+    }
+
+    // Back to back, with no idle zeros.
+    count = frameEncode(payload, 20, frame);
+    for (uint8_t x = 0; x < 3; x++) {
+        if (decode(decoder, frame, count, 20) != FRAME_OK ||
+            decoder->length != 20)
+            fail("back to back frames", 20);
+    }
+
+    // Too long, 300 non-zero bytes in 0xFF runs.
+    uint8_t run[255];
+    memset(run, 0x77, sizeof(run));
+    run[0] = 0xFF;
+    for (uint8_t x = 0; x < 2; x++) {
+        for (uint16_t y = 0; y < sizeof(run); y++)
+            frameDecodeByte(decoder, run[y]);
+    }
+    if (frameDecodeByte(decoder, 0) != FRAME_TOO_LONG)
+        fail("too long frame not caught", 300);
+
+    roundTrip(decoder, payload, 20);
+}
+
+
+int main() {
+    frameDecoder decoder;
+    frameDecoderInit(&decoder);
+
+    example(&decoder);
+    edgeCases(&decoder);
+    randomPayloads(&decoder);
+    corrupted(&decoder);
+    badFrames(&decoder);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+//============================================================
+// USARTsend() descriptors, and their "done" functions, which
+// USARTsendPoll() calls from the main code, not the UDRE ISR.
+// An entry with a "done" keeps its place in the queue until
+// it has been called, and one without gives it up once sent.
+//
+// Libraries: USARTinterrupt USARTbuffer printf
+//============================================================
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "hostSim.h"
+#include "USARTinterrupt.h"
+
+static int failures;
+
+// Not printf(), which goes to the USART, and txHook().
+static void check(bool ok, const char *what, int got) {
+    if (!ok) {
+        fprintf(stderr, "usartSend: %s, got %d\n", what, got);
+        failures++;
+    }
+}
+
+static volatile uint16_t bytesSent;
+static uint8_t doneCalls;
+static const void *doneData;
+
+static void txHook(uint8_t) {
+    bytesSent++;
+}
+
+static void done(const void *data) {
+    doneCalls++;
+    doneData = data;
+}
+
+
+//------------------------------------------------------------
+// Wait for everything queued to have gone, for up to a second,
+// and then for the last byte to get out of UDR0 and the shift
+// register.
+//------------------------------------------------------------
+static void waitSent() {
+    uint64_t end = hostCycles() + F_CPU;
+
+    while (USARTsendPending() && hostCycles() < end)
+        _delay_us(100);
+
+    _delay_us(200);
+}
+
+
+int main() {
+    static const char message[] = "Sent by descriptor.\n";
+    bool result;
+
+    hostUSARTsetTxHook(txHook);
+    USARTinit(115200);
+    sei();
+
+    result = USARTsend(message, sizeof(message) - 1, USART_TX_RAM, done);
+    check(result, "send refused", result);
+    waitSent();
+    check(bytesSent == sizeof(message) - 1, "bytes sent", bytesSent);
+    check(doneCalls == 0, "done called before USARTsendPoll()", doneCalls);
+
+    USARTsendPoll();
+    check(doneCalls == 1 && doneData == message, "done calls", doneCalls);
+    USARTsendPoll();
+    check(doneCalls == 1, "done called twice", doneCalls);
+
+    // Entries waiting for USARTsendPoll() keep the queue full.
+    for (uint8_t x = 0; x < USART_TX_QUEUE_SIZE; x++) {
+        result = USARTsend(message, 2, USART_TX_RAM, done);
+        check(result, "queueing refused", x);
+    }
+    waitSent();
+    result = USARTsend(message, 2, USART_TX_RAM, done);
+    check(!result, "queue not full before USARTsendPoll()", result);
+
+    USARTsendPoll();
+    check(doneCalls == 1 + USART_TX_QUEUE_SIZE, "done calls", doneCalls);
+    result = USARTsend(message, 2, USART_TX_RAM, done);
+    check(result, "queue still full after USARTsendPoll()", result);
+    waitSent();
+    USARTsendPoll();
+
+    // Entries without one don't need it.
+    for (uint8_t round = 0; round < 2; round++) {
+        for (uint8_t x = 0; x < USART_TX_QUEUE_SIZE; x++) {
+            result = USARTsend(message, 2);
+            check(result, "queueing without done refused", x);
+        }
+        waitSent();
+    }
+
+    check(doneCalls == 2 + USART_TX_QUEUE_SIZE, "done calls", doneCalls);
+    check(bytesSent == sizeof(message) - 1 + 2 * (3 * USART_TX_QUEUE_SIZE + 1),
+          "bytes sent", bytesSent);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,50 @@
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+//============================================================
+// Host (Linux) replacement for <util/atomic.h>. The same
+// trick as avr-libc: a one pass for loop, with a cleanup
+// variable that restores (or forces) the I bit in SREG
+// however the block is left.
+//============================================================
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+static inline uint8_t hostAtomicCli(void) {
+    cli();
+    return 1;
+}
+
+static inline void hostAtomicRestore(const uint8_t *sregSave) {
+    SREG = *sregSave;
+}
+
+static inline void hostAtomicSei(const uint8_t *) {
+    sei();
+}
+
+static inline void hostAtomicCliParam(const uint8_t *) {
+    cli();
+}
+
+#define ATOMIC_BLOCK(type) \
+    for (type, hostAtomicToDo = hostAtomicCli(); \
+         hostAtomicToDo; hostAtomicToDo = 0)
+
+#define NONATOMIC_BLOCK(type) \
+    for (type, hostAtomicToDo = (sei(), 1); \
+         hostAtomicToDo; hostAtomicToDo = 0)
+
+#define ATOMIC_RESTORESTATE \
+    uint8_t sregSave __attribute__((__cleanup__(hostAtomicRestore))) = SREG
+
+#define ATOMIC_FORCEON \
+    uint8_t sregSave __attribute__((__cleanup__(hostAtomicSei))) = 0
+
+#define NONATOMIC_RESTORESTATE ATOMIC_RESTORESTATE
+
+#define NONATOMIC_FORCEOFF \
+    uint8_t sregSave __attribute__((__cleanup__(hostAtomicCliParam))) = 0
+
+#endif // HOST_UTIL_ATOMIC_H
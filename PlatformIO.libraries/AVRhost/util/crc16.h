@@ -0,0 +1,68 @@
+#ifndef HOST_UTIL_CRC16_H
+#define HOST_UTIL_CRC16_H
+
+//============================================================
+// Host (Linux) replacement for <util/crc16.h>. avr-libc has
+// these as inline assembler, here they are the C equivalents
+// from the avr-libc documentation, and give the same results.
+//============================================================
+
+#include <stdint.h>
+
+// CRC-16, polynomial 0xA001, as used by Modbus etc.
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t data) {
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++) {
+        if (crc & 1)
+            crc = (crc >> 1) ^ 0xA001;
+        else
+            crc = (crc >> 1);
+    }
+    return crc;
+}
+
+// CRC-CCITT, polynomial 0x1021, reflected (0x8408).
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+    data ^= (uint8_t)crc;
+    data ^= data << 4;
+    return ((((uint16_t)data << 8) | (uint8_t)(crc >> 8)) ^
+            (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+// CRC-XMODEM, polynomial 0x1021, not reflected.
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data) {
+    crc = crc ^ ((uint16_t)data << 8);
+    for (uint8_t i = 0; i < 8; i++) {
+        if (crc & 0x8000)
+            crc = (crc << 1) ^ 0x1021;
+        else
+            crc <<= 1;
+    }
+    return crc;
+}
+
+// Dallas/Maxim 1-Wire CRC-8, polynomial 0x8C.
+static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data) {
+    crc = crc ^ data;
+    for (uint8_t i = 0; i < 8; i++) {
+        if (crc & 0x01)
+            crc = (crc >> 1) ^ 0x8C;
+        else
+            crc >>= 1;
+    }
+    return crc;
+}
+
+// CRC-8, polynomial 0x07, as used by SMBus etc.
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data) {
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++) {
+        if (crc & 0x80)
+            crc = (crc << 1) ^ 0x07;
+        else
+            crc <<= 1;
+    }
+    return crc;
+}
+
+#endif // HOST_UTIL_CRC16_H
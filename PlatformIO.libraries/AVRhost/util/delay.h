@@ -0,0 +1,25 @@
+#ifndef HOST_UTIL_DELAY_H
+#define HOST_UTIL_DELAY_H
+
+//============================================================
+// Host (Linux) replacement for <util/delay.h>. The simulated
+// peripherals run in real time, so a delay is a real sleep
+// and interrupts carry on in the meantime, as on the AVR.
+//============================================================
+
+#ifndef F_CPU
+    #warning "F_CPU not defined for <util/delay.h>"
+    #define F_CPU 1000000UL
+#endif
+
+void hostDelayMicroseconds(double us);
+
+static inline void _delay_us(double __us) {
+    hostDelayMicroseconds(__us);
+}
+
+static inline void _delay_ms(double __ms) {
+    hostDelayMicroseconds(__ms * 1000.0);
+}
+
+#endif // HOST_UTIL_DELAY_H
@@ -0,0 +1,151 @@
+#ifndef TWICLOCK_H_
+#define TWICLOCK_H_
+
+#include <stdint.h>
+
+//-------------------------------------------------------------
+// File: TWIclock.h
+//
+// SCL clock solver. Works out the prescaler, in TWSR, and
+// TWBR, for a given SCL frequency and F_CPU. These are all
+// constexpr, so with a constant frequency, the compiler does
+// all the arithmetic and the AVR does none. Each takes the
+// CPU clock too, as "fCpu", which is F_CPU unless given, so
+// other clocks can be checked at compile time.
+//
+// SCL = F_CPU / (16 + 2 * TWBR * Prescaler)
+//
+// Prescaler is 1, 4, 16 or 64, for TWPS1:0 of 0 to 3. TWBR is
+// rounded up, so SCL is never faster than asked for, as the
+// slowest device on the bus sets the limit. The smallest
+// prescaler that lets TWBR fit in 8 bits wins, as it's the
+// closest.
+//
+// At 16 MHz, that's anything from 490 Hz, with a prescaler of
+// 64 and TWBR = 255, up to 1 MHz with TWBR = 0. The data sheet
+// only promises 400 KHz, but Fast-mode Plus devices, and short
+// buses with stiff pull-ups, can go faster.
+//-------------------------------------------------------------
+
+
+//-------------------------------------------------------------
+// Function: twiClockCycles
+//
+// CPU cycles per SCL period, rounded up, for "sclHz".
+//-------------------------------------------------------------
+constexpr uint32_t twiClockCycles(uint32_t sclHz, uint32_t fCpu = F_CPU) {
+    return (fCpu + sclHz - 1) / sclHz;
+}
+
+
+//-------------------------------------------------------------
+// Function: twiClockStretch
+//
+// The part of the SCL period, 2 * TWBR * Prescaler, that's
+// left after the fixed 16 cycles.
+//-------------------------------------------------------------
+constexpr uint32_t twiClockStretch(uint32_t sclHz, uint32_t fCpu = F_CPU) {
+    return twiClockCycles(sclHz, fCpu) > 16 ?
+           twiClockCycles(sclHz, fCpu) - 16 : 0;
+}
+
+
+//-------------------------------------------------------------
+// Function: twiClockTWBR
+//
+// TWBR, rounded up, with a prescaler of 4 to the power
+// "prescaler". May be too big for TWBR.
+//-------------------------------------------------------------
+constexpr uint32_t twiClockTWBR(uint32_t sclHz, uint8_t prescaler,
+                                uint32_t fCpu = F_CPU) {
+    return (twiClockStretch(sclHz, fCpu) + (2UL << (2 * prescaler)) - 1) >>
+           (1 + 2 * prescaler);
+}
+
+
+//-------------------------------------------------------------
+// Function: twiClockPrescaler
+//
+// The TWPS1:0 bits for "sclHz". The smallest prescaler that
+// lets TWBR fit, or 3 if none do.
+//-------------------------------------------------------------
+constexpr uint8_t twiClockPrescaler(uint32_t sclHz, uint32_t fCpu = F_CPU,
+                                    uint8_t prescaler = 0) {
+    return (prescaler >= 3 || twiClockTWBR(sclHz, prescaler, fCpu) <= 255) ?
+           prescaler : twiClockPrescaler(sclHz, fCpu, prescaler + 1);
+}
+
+
+//-------------------------------------------------------------
+// Function: twiClockBitRate
+//
+// The value for TWBR, to go with <twiClockPrescaler>. Too
+// slow a clock gets 255, the slowest there is.
+//-------------------------------------------------------------
+constexpr uint8_t twiClockBitRate(uint32_t sclHz, uint32_t fCpu = F_CPU) {
+    return twiClockTWBR(sclHz, twiClockPrescaler(sclHz, fCpu), fCpu) > 255 ?
+           255 : twiClockTWBR(sclHz, twiClockPrescaler(sclHz, fCpu), fCpu);
+}
+
+
+//-------------------------------------------------------------
+// Function: twiClockValid
+//
+// Can "sclHz" be done at all, at this CPU clock? Not if it's
+// faster than fCpu / 16, or slower than the biggest TWBR and
+// prescaler allow.
+//-------------------------------------------------------------
+constexpr bool twiClockValid(uint32_t sclHz, uint32_t fCpu = F_CPU) {
+    return sclHz && sclHz <= fCpu / 16 && twiClockTWBR(sclHz, 3, fCpu) <= 255;
+}
+
+
+//-------------------------------------------------------------
+// Function: twiClockActual
+//
+// The SCL frequency, in Hz, for this TWBR and TWPS1:0. Use
+// twiClockActual(twiClockBitRate(hz), twiClockPrescaler(hz))
+// to see what asking for "hz" will get.
+//-------------------------------------------------------------
+constexpr uint32_t twiClockActual(uint8_t twbr, uint8_t prescaler,
+                                  uint32_t fCpu = F_CPU) {
+    return fCpu / (16 + ((2UL * twbr) << (2 * prescaler)));
+}
+
+
+//-------------------------------------------------------------
+// The usual clocks, worked out by hand from the formula above,
+// so a change to the solver that gets them wrong won't build.
+//-------------------------------------------------------------
+static_assert(twiClockPrescaler(100000, 16000000UL) == 0 &&
+              twiClockBitRate(100000, 16000000UL) == 72,
+              "100 KHz at 16 MHz should be TWBR 72, prescaler 1");
+static_assert(twiClockPrescaler(400000, 16000000UL) == 0 &&
+              twiClockBitRate(400000, 16000000UL) == 12,
+              "400 KHz at 16 MHz should be TWBR 12, prescaler 1");
+static_assert(twiClockPrescaler(100000, 8000000UL) == 0 &&
+              twiClockBitRate(100000, 8000000UL) == 32,
+              "100 KHz at 8 MHz should be TWBR 32, prescaler 1");
+static_assert(twiClockPrescaler(400000, 8000000UL) == 0 &&
+              twiClockBitRate(400000, 8000000UL) == 2,
+              "400 KHz at 8 MHz should be TWBR 2, prescaler 1");
+static_assert(twiClockPrescaler(10000, 16000000UL) == 1 &&
+              twiClockBitRate(10000, 16000000UL) == 198,
+              "10 KHz at 16 MHz should be TWBR 198, prescaler 4");
+static_assert(twiClockActual(72, 0, 16000000UL) == 100000 &&
+              twiClockActual(2, 0, 8000000UL) == 400000,
+              "twiClockActual disagrees with the table");
+
+// And the ones that can't be done. Too fast for TWBR = 0, and
+// too slow for TWBR = 255 with a prescaler of 64.
+static_assert(twiClockValid(1000000, 16000000UL) &&
+              twiClockValid(490, 16000000UL),
+              "1 MHz and 490 Hz can be done at 16 MHz");
+static_assert(!twiClockValid(2000000, 16000000UL) &&
+              !twiClockValid(1000000, 8000000UL),
+              "Faster than F_CPU / 16 can't be done");
+static_assert(!twiClockValid(480, 16000000UL) &&
+              !twiClockValid(240, 8000000UL) && !twiClockValid(0),
+              "Slower than TWBR 255 and a prescaler of 64 can't be done");
+
+#endif // TWICLOCK_H_
@@ -28,6 +28,9 @@
 // These two headers must be included before TWIlib.h.
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include <util/delay.h>
 #include "TWIlib.h"
 #include <string.h>
 
@@ -47,7 +50,7 @@
 // TWIInfo is the <TWIInfoStruct> structure holding status
 // information relating to the current TWI conversation.
 //-------------------------------------------------------------
-TWIInfoStruct TWIInfo;
+volatile TWIInfoStruct TWIInfo;
 
 //-------------------------------------------------------------
 // Varible: TWITransmitBuffer
@@ -106,6 +109,75 @@ int TXBuffLen;
 //-------------------------------------------------------------
 int RXBuffLen;
 
+//-------------------------------------------------------------
+// Variable: TWIQueue
+//
+// Transactions queued by <TWIQueueTransaction>. "head" counts
+// those added, "tail" those finished. While "running", the ISR
+// is working on the oldest, at "tail", and "reading" says if
+// it's on the read part yet, "index" how many bytes of that
+// part are done.
+//-------------------------------------------------------------
+static struct {
+    TWITransaction entries[TWI_QUEUE_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    volatile bool running;
+    bool reading;
+    uint8_t index;
+} TWIQueue;
+
+
+//-------------------------------------------------------------
+// Variable: TWISlave
+//
+// The register bank from <TWISlaveInit>. "ack" is (1 << TWEA)
+// while we answer to our address, 0 when we don't. "pointer"
+// is the next register to read or write. The first byte of
+// each write sets it, "pointerSet" says if that's happened
+// yet, and "first" and "count" are for the callback.
+//-------------------------------------------------------------
+static struct {
+    volatile uint8_t *bank;
+    uint8_t size;
+    TWISlaveCallback written;
+    uint8_t ack;
+    uint8_t pointer;
+    bool pointerSet;
+    uint8_t first;
+    uint8_t count;
+} TWISlave;
+
+
+//-------------------------------------------------------------
+// Function: TWISendByte
+//
+// <TWISendTransmit>, for SLA+R/W and data we send as master,
+// but with TWEA left on while we are a slave. Should another
+// master win arbitration by addressing us, the TWI then
+// answers, with 0x68 or 0xB0, rather than ignoring it.
+//-------------------------------------------------------------
+static inline void TWISendByte() {
+    TWCR = (TWI_COMMON) | TWISlave.ack;
+}
+
+
+//-------------------------------------------------------------
+// Variable: TWITicks
+//
+// Calls of <TWITick> since the TWI last did anything.
+//-------------------------------------------------------------
+static volatile uint8_t TWITicks;
+
+
+//-------------------------------------------------------------
+// Variable: TWIStatistics
+//
+// The counts returned by <TWIStats>.
+//-------------------------------------------------------------
+static TWIStatsStruct TWIStatistics;
+
+
 //-------------------------------------------------------------
 // Title: Function declarations
 //-------------------------------------------------------------
@@ -118,6 +190,13 @@ int RXBuffLen;
 // before any other TWI functions can be used however it
 // should be called after global interrupts have been enabled.
 // 
+// The prescaler and TWBR come from the solver in <TWIclock.h>.
+// The clock is never faster than asked for, and anything too
+// slow, or too fast, for F_CPU gets the nearest there is. Call
+// <SCLfreq> to see what that was, or use TWIInit<hz>(), which
+// works it all out at compile time, and won't compile if it
+// can't be done.
+//
 // Parameter:
 //
 //   SCLfreq_KHz - Desired frequency of the TWI clock. The 
@@ -128,11 +207,34 @@ int RXBuffLen;
 //-------------------------------------------------------------
 void TWIInit(uint32_t SCLfreq_KHz)
 {
-    // Set pre-scalers (no pre-scaling)
-    TWSR = 0;
+    uint32_t sclHz = SCLfreq_KHz * 1000;
+
+    TWIInitTWBR(twiClockBitRate(sclHz), twiClockPrescaler(sclHz));
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIInitTWBR
+//
+// Initialize the TWI hardware, as <TWIInit>, with the bit rate
+// already worked out.
+//
+// Parameters:
+//
+//   bitRate - The value for TWBR.
+//   prescaler - The value for the TWPS1:0 bits in TWSR, 0 to
+//               3, for a prescaler of 1, 4, 16 or 64.
+//
+// Returns:
+//  None.
+//-------------------------------------------------------------
+void TWIInitTWBR(uint8_t bitRate, uint8_t prescaler)
+{
+    // Set pre-scalers. The status bits are read only.
+    TWSR = prescaler & ((1 << TWPS1) | (1 << TWPS0));
 
     // Set bit rate
-    TWBR = ((F_CPU / (SCLfreq_KHz*1000)) - 16) / 2;
+    TWBR = bitRate;
 
     // Enable TWI and interrupt
     TWCR = (1 << TWIE) | (1 << TWEN);
@@ -141,6 +243,73 @@ void TWIInit(uint32_t SCLfreq_KHz)
     TWIInfo.mode = Ready;
     TWIInfo.errorCode = TWI_SUCCESS;
     TWIInfo.repStart = 0;
+
+    // Forget anything queued.
+    TWIQueue.head = 0;
+    TWIQueue.tail = 0;
+    TWIQueue.running = false;
+
+    // Master only, until TWISlaveInit().
+    TWISlave.ack = 0;
+}
+
+
+//-------------------------------------------------------------
+// Function: TWISlaveInit
+//
+// Answer to "address", as a slave, as well as being a master.
+// A master sees "bank" as "size" registers, much like those in
+// a sensor. The first byte it writes selects a register, and
+// any more are written to it, and the registers after it. A
+// read carries on from wherever the last read or write left
+// off, so a write of the register number, then a repeated
+// START and a read, reads from that register onwards.
+//
+// Writes past the end of the bank are NACKed, reads past it
+// get 0xFF. The ISR does it all, the main code only sees the
+// registers change, and "written" called, if it's not 0.
+//
+// Parameters:
+//
+//   address - The 7 bit address to answer to.
+//   bank - The registers. Must stay in scope.
+//   size - How many registers, up to 255.
+//   written - See <TWISlaveCallback>, may be 0.
+//
+// Usage:
+//
+// ---C++
+// volatile uint8_t registers[4];
+// volatile bool changed = false;
+//
+// void gotIt(uint8_t reg, uint8_t count) {
+//     changed = true;
+// }
+//
+// TWIInit();
+// TWISlaveInit(0x20, registers, sizeof(registers), gotIt);
+// ---
+//
+// *NOTE:* A master may read or write the bank at any time.
+// Read or write anything longer than a byte with interrupts
+// off, or it may change half way through.
+//-------------------------------------------------------------
+void TWISlaveInit(uint8_t address,
+                  volatile uint8_t *bank, uint8_t size,
+                  TWISlaveCallback written) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TWISlave.bank = bank;
+        TWISlave.size = size;
+        TWISlave.written = written;
+        TWISlave.pointer = 0;
+        TWISlave.ack = (1 << TWEA);
+
+        TWAR = address << 1;
+
+        // If the bus is ours, TWEA is set when we let it go.
+        if (TWIInfo.mode == Ready)
+            TWCR = (1 << TWIE) | (1 << TWEN) | (1 << TWEA);
+    }
 }
 
 
@@ -171,7 +340,8 @@ uint8_t isTWIReady()
 //-------------------------------------------------------------
 // Function: SCLfreq
 //
-// Return the SCL clock frequency in KHz.
+// Return the SCL clock frequency in KHz, from TWBR and the
+// prescaler.
 //
 // Parameter:
 //  None.
@@ -180,7 +350,18 @@ uint8_t isTWIReady()
 //  The clock speed in KHz.
 //-------------------------------------------------------------
 uint32_t SCLfreq() {
-    return F_CPU / (16 + (2 * TWBR)) / 1000;
+    return SCLfreqHz() / 1000;
+}
+
+
+//-------------------------------------------------------------
+// Function: SCLfreqHz
+//
+// Returns:
+//  The SCL clock frequency in Hz, as <SCLfreq>.
+//-------------------------------------------------------------
+uint32_t SCLfreqHz() {
+    return twiClockActual(TWBR, TWSR & ((1 << TWPS1) | (1 << TWPS0)));
 }
 
 
@@ -194,7 +375,8 @@ uint32_t SCLfreq() {
 //
 // Returns:
 // The most recent TWI error message. The errorCode from
-// <TWIInfo> should be passed in.
+// <TWIInfo> should be passed in. The message is in flash, so
+// print it with "%S" or USARTwriteText_P().
 //
 // Notes:
 // 1. This function could read <TWIInfo> to get the error code
@@ -202,29 +384,34 @@ uint32_t SCLfreq() {
 // changed when it does so, returning an incorrect error 
 // message for the actual code.
 //
-// 2. If your Atmega328P, for example, is short on code and 
+// 2. This is a direct lookup in <TWIStatusMessages>, the same
+// speed for every code, and any code at all, even one not from
+// the TWI hardware, gets a message.
+//
+// 3. If your Atmega328P, for example, is short on code and 
 // data space, defining NO_ERROR_DATA_REQUIRED will omit this 
 // function and all the data defined in <twiErrors.h>. As an 
 // example, an Arduino UNO, using PlatformIO as the development
 // system, went from 1992/2048 and 2882/32K memory usage to 
 // 244/2048 and 1798/32K when this macro was defined. Saving 
 // 1048 and 2888 bytes of Static and Flash RAM respectively.
+// Now that the messages are kept in flash, the Static RAM is
+// saved either way.
 // 
 // Using the Arduino Language would have resulted in even 
 // larger RAM usage.
 
 //-------------------------------------------------------------
 const char *TWIGetLastError(uint8_t errorCode) {
-    uint8_t index = 0;
-
-    do {
-        if (errorCode == TWIStatusMessages[index].errorCode)
-            break;
+    if (errorCode == TWI_TIMEOUT)
+        return twiMsgTimeout;
 
-        index++;
-    } while (errorCode != 0xFF);
+    // Only multiples of 8 are TWI status codes. Anything else,
+    // TWI_SUCCESS included, is unknown.
+    if (errorCode & ~TWI_STATUS_MASK)
+        return twiMsgFF;
 
-    return TWIStatusMessages[index].errorMessage;
+    return (const char *)pgm_read_ptr(&TWIStatusMessages[errorCode >> 3]);
 }
 #endif 
 
@@ -249,6 +436,15 @@ const char *TWIGetLastError(uint8_t errorCode) {
 // to be sent must be the write address of the sensor device
 // that will be written to.
 //
+// This can be used alongside queued transactions, even ones
+// queued by an ISR, as TWIscheduler does. Checking the bus
+// is free, and claiming it, is done with interrupts off, so
+// only one of them ever gets it. The other waits: a queued
+// transaction starts when this one lets go of the bus, and
+// this returns <TWI_TX_RX_NOT_READY> while the queue is
+// running. Between a repeated START and the <TWIReadData>
+// that follows it, the bus is still ours, and the queue waits.
+//
 // Parameters:
 //
 //    TXdata  - Void pointer to the first byte of data 
@@ -303,10 +499,22 @@ uint8_t TWITransmitData(void *const TXdata,
                         uint8_t dataLen, 
                         uint8_t repStart)
 {
-    if (!isTWIReady()) {
-        return TWI_TX_RX_NOT_READY;
+    bool repeatedStart = false;
+
+    //---------------------------------------------------------
+    // Claim the bus, unless it's busy, or the queue has it.
+    // An ISR queueing a transaction could otherwise start it
+    // between the check and the claim.
+    //---------------------------------------------------------
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (!isTWIReady() || TWIQueue.running) {
+            return TWI_TX_RX_NOT_READY;
+        }
+
+        repeatedStart = (TWIInfo.mode == RepeatedStartSent);
+        TWIInfo.mode = Initializing;
     }
-    
+
     //---------------------------------------------------------
     // Set repeated start mode.
     //---------------------------------------------------------
@@ -323,15 +531,14 @@ uint8_t TWITransmitData(void *const TXdata,
     //---------------------------------------------------------
     TXBuffLen = dataLen;
     TXBuffIndex = 0;
+    TWITicks = 0;
     
     //---------------------------------------------------------
     // If a repeated start has been sent, then devices are
     // already listening for an address and another start
     // does not need to be sent. 
     //---------------------------------------------------------
-    if (TWIInfo.mode == RepeatedStartSent) {
-        TWIInfo.mode = Initializing;
-
+    if (repeatedStart) {
         //-----------------------------------------------------
         // Load data to transmit buffer.
         //-----------------------------------------------------
@@ -340,13 +547,12 @@ uint8_t TWITransmitData(void *const TXdata,
         //-----------------------------------------------------
         // Send the data
         //-----------------------------------------------------
-        TWISendTransmit();
+        TWISendByte();
     } else {
         //-----------------------------------------------------
         // Otherwise, just send the normal start signal
         // to begin transmission.
         //-----------------------------------------------------
-        TWIInfo.mode = Initializing;
         TWISendStart();
     }
     
@@ -464,9 +670,10 @@ uint8_t TWIReadData(uint8_t TWIaddr,
 
     //---------------------------------------------------------
     // Create the one value array for the address to be
-    // transmitted.
+    // transmitted. Static, as the ISR sends it after we have
+    // returned, unless a repeated START was already sent.
     //---------------------------------------------------------
-    uint8_t TXdata[1];
+    static uint8_t TXdata[1];
 
     //---------------------------------------------------------
     // Shift the address left and AND a 1 into the 
@@ -491,6 +698,663 @@ uint8_t TWIReadData(uint8_t TWIaddr,
 
 
 
+//-------------------------------------------------------------
+// Function: TWIQueueCurrent
+//
+// The transaction at the front of the queue.
+//-------------------------------------------------------------
+static inline TWITransaction *TWIQueueCurrent() {
+    return &TWIQueue.entries[TWIQueue.tail & (TWI_QUEUE_SIZE - 1)];
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIQueueBegin
+//
+// Get ready to run the transaction at the front of the queue.
+// The caller sends the START.
+//-------------------------------------------------------------
+static void TWIQueueBegin() {
+    TWITransaction *entry = TWIQueueCurrent();
+
+    TWIQueue.running = true;
+    TWIQueue.reading = !entry->writeLen && entry->readLen;
+    TWIQueue.index = 0;
+    TWIInfo.mode = Initializing;
+    TWITicks = 0;
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIQueueStart
+//
+// Start the transaction at the front of the queue, with a
+// START as soon as the bus is free. Until then, we still
+// answer as a slave, if <TWISlaveInit> was called.
+//-------------------------------------------------------------
+static void TWIQueueStart() {
+    TWIQueueBegin();
+    TWCR = (TWI_COMMON) | (1 << TWSTA) | TWISlave.ack;
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIReleaseBus
+//
+// Called from the ISR, at the end of a conversation, in place
+// of <TWISendStop>. If there's a transaction queued, the STOP
+// is followed by a START for it, and the bus is never idle.
+// As a slave, TWEA goes back on, so we answer to our address.
+//-------------------------------------------------------------
+static void TWIReleaseBus() {
+    if (TWIQueue.head != TWIQueue.tail) {
+        TWIQueueBegin();
+        TWCR = (TWI_COMMON) | (1 << TWSTO) | (1 << TWSTA) | TWISlave.ack;
+    } else {
+        TWCR = (TWI_COMMON) | (1 << TWSTO) | TWISlave.ack;
+    }
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIQueueRemove
+//
+// The transaction at the front of the queue is over. Take it
+// off, and tell the caller.
+//-------------------------------------------------------------
+static void TWIQueueRemove(uint8_t errorCode) {
+    TWITransaction *entry = TWIQueueCurrent();
+    TWICallback callback = entry->callback;
+    void *context = entry->context;
+
+    // Free the slot first, so the callback can reuse it.
+    TWIQueue.tail++;
+
+    if (callback)
+        callback(errorCode, context);
+
+    TWIQueue.running = false;
+    TWIInfo.mode = Ready;
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIQueueFinish
+//
+// As <TWIQueueRemove>, then let go of the bus, or start the
+// next one, if any.
+//-------------------------------------------------------------
+static void TWIQueueFinish(uint8_t errorCode) {
+    TWIQueueRemove(errorCode);
+    TWIReleaseBus();
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIQueueTransaction
+//
+// Add a transaction to the queue. If the bus is free, it
+// starts at once, otherwise when the ones in front of it,
+// and any <TWITransmitData> or <TWIReadData> in progress, have
+// finished. From then on, the ISR does it all.
+//
+// Parameter:
+//
+//   transaction - What to do, see <TWITransaction>. It's
+//                 copied, so needn't be kept, but the buffers
+//                 it points at must be.
+//
+// Returns:
+//
+//    <TWI_TX_RX_SUCCESS> The transaction has been queued.
+//
+//    <TWI_TX_RX_NOT_READY> The queue is full, see
+//    <TWI_QUEUE_SIZE>. Try again later.
+//
+// Usage:
+//
+// ---C++
+// uint8_t reg = 0;
+// uint8_t temperature[2];
+// volatile bool done = false;
+//
+// void gotIt(uint8_t errorCode, void *context) {
+//     done = true;
+// }
+//
+// TWITransaction read = {0x4F, &reg, 1, temperature, 2,
+//                        gotIt, 0};
+// TWIQueueTransaction(&read);
+// ---
+//-------------------------------------------------------------
+uint8_t TWIQueueTransaction(const TWITransaction *transaction) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (uint8_t(TWIQueue.head - TWIQueue.tail) >= TWI_QUEUE_SIZE)
+            return TWI_TX_RX_NOT_READY;
+
+        TWIQueue.entries[TWIQueue.head & (TWI_QUEUE_SIZE - 1)] =
+            *transaction;
+        TWIQueue.head++;
+
+        // Queued, but not yet done.
+        if (transaction->callback == TWISignal)
+            *(TWIHandle *)transaction->context = TWI_NO_RELEVANT_INFO;
+
+        // Nothing on the bus? Then this one is at the front.
+        if (!TWIQueue.running && TWIInfo.mode == Ready)
+            TWIQueueStart();
+    }
+
+    return TWI_TX_RX_SUCCESS;
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIWriteRead
+//
+// Write some bytes to a slave, then read some back, as one
+// queued transaction. Usually the bytes written select a
+// register in the slave, and the bytes read are its contents.
+// The ISR does it all: SLA+W, the bytes to write, a repeated
+// START, SLA+R and the bytes to read, then calls "callback".
+//
+// Parameters:
+//
+//   address - The 7 bit address of the slave.
+//   writeData, writeLen - What to write, may be 0 and 0.
+//   readData, readLen - Where to read to, may be 0 and 0.
+//   callback - Called from the ISR when done, may be 0.
+//   context - Passed to the callback.
+//
+// Returns:
+//
+//    As <TWIQueueTransaction>.
+//
+// Usage:
+//
+// ---C++
+// // Read the LM75A temperature register.
+// uint8_t reg = 0;
+// uint8_t temperature[2];
+// TWIWriteRead(0x4F, &reg, 1, temperature, 2, gotIt);
+// ---
+//-------------------------------------------------------------
+uint8_t TWIWriteRead(uint8_t address,
+                     const void *writeData, uint8_t writeLen,
+                     void *readData, uint8_t readLen,
+                     TWICallback callback, void *context) {
+    TWITransaction transaction = {
+        address,
+        (const uint8_t *)writeData, writeLen,
+        (uint8_t *)readData, readLen,
+        callback, context
+    };
+
+    return TWIQueueTransaction(&transaction);
+}
+
+
+//-------------------------------------------------------------
+// Function: TWISignal
+//
+// A <TWICallback> that puts the result in the <TWIHandle> at
+// "context". Used with <TWIDone> and <TWIWait>, it lets the
+// caller find out how a transaction went without writing a
+// callback, and without having to watch <TWIInfo>.
+//-------------------------------------------------------------
+void TWISignal(uint8_t errorCode, void *context) {
+    *(TWIHandle *)context = errorCode;
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIWait
+//
+// Wait for a transaction queued with <TWISignal> to finish.
+// With <TWI_IDLE_SLEEP>, the CPU sleeps while it waits. Any
+// interrupt wakes it, so the handle is checked again, with
+// interrupts off, before each sleep. The instruction after
+// sei() always runs, so the TWI interrupt can't slip in
+// between the check and the sleep.
+//
+// Parameter:
+//
+//   handle - The <TWIHandle> given to <TWISignal>.
+//
+// Returns:
+//  <TWI_SUCCESS>, or the status code that stopped it.
+//-------------------------------------------------------------
+uint8_t TWIWait(TWIHandle *handle) {
+#if TWI_IDLE_SLEEP
+    uint8_t oldSREG = SREG;
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (1) {
+        cli();
+        if (TWIDone(handle))
+            break;
+
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+
+    SREG = oldSREG;
+#else
+    while (!TWIDone(handle))
+        ;
+#endif
+
+    return *handle;
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIQueuePending
+//
+// Returns:
+//  The number of queued transactions not yet finished,
+//  including any in progress.
+//-------------------------------------------------------------
+uint8_t TWIQueuePending() {
+    uint8_t pending;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pending = TWIQueue.head - TWIQueue.tail;
+    }
+
+    return pending;
+}
+
+
+//-------------------------------------------------------------
+// Function: TWISlaveDone
+//
+// We are no longer addressed as a slave. Answer to our address
+// again, and get on with our own work as master. A queued
+// transaction that lost arbitration to the master that
+// addressed us starts again, from the beginning.
+//-------------------------------------------------------------
+static void TWISlaveDone() {
+    if (TWIQueue.running || TWIQueue.head != TWIQueue.tail) {
+        TWIQueueStart();
+    } else {
+        TWIInfo.mode = Ready;
+        TWCR = (TWI_COMMON) | TWISlave.ack;
+    }
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIRecoverBus
+//
+// A slave reset, or confused, part way through sending a byte
+// can be left holding SDA low, waiting for clocks that will
+// never come. The TWI hardware can't get a START past it, and
+// just waits. This disables the TWI, clocks SCL by hand until
+// the slave lets go of SDA, up to 9 times, enough for the rest
+// of its byte and the ACK, then sends a STOP to leave every
+// slave idle.
+//
+// The pins are driven as an open drain bus should be: low, or
+// let go to be pulled high, never driven high.
+//
+// Afterwards, the TWI is enabled again, as <TWIInit> does,
+// but keeping the clock rate, and anything queued. Anything
+// in progress is lost. <TWITick> calls this itself, and it can
+// be called at startup, before anything is sent.
+//
+// Returns:
+//  true if SDA is free, false if it's still held low.
+//-------------------------------------------------------------
+bool TWIRecoverBus() {
+    uint8_t pins = (1 << TWI_SDA_BIT) | (1 << TWI_SCL_BIT);
+    uint8_t oldDDR;
+    uint8_t oldPORT;
+    bool freed;
+
+    // Only the register changes are atomic. The clocking takes
+    // up to 110 us, and other interrupts needn't wait for it.
+    // With the TWI off, its own can't happen, and while we're
+    // Initializing, nothing else can start on the bus.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TWIStatistics.recoveries++;
+
+        // Keep the pins' settings, to put them back.
+        oldDDR = TWI_DDR & pins;
+        oldPORT = TWI_PORT & pins;
+
+        // Give the pins back to the port, both let go, with
+        // pull-ups.
+        TWCR = 0;
+        TWIInfo.mode = Initializing;
+        TWITicks = 0;
+        TWI_DDR &= ~pins;
+        TWI_PORT |= pins;
+    }
+
+    // Clock SCL, a 100 KHz clock, until SDA is free. Each of
+    // these is a single SBI or CBI, which can't be interrupted.
+    for (uint8_t clocks = 0;
+         clocks < 9 && !(TWI_PIN & (1 << TWI_SDA_BIT));
+         clocks++) {
+        TWI_PORT &= ~(1 << TWI_SCL_BIT);
+        TWI_DDR |= (1 << TWI_SCL_BIT);
+        _delay_us(5);
+        TWI_DDR &= ~(1 << TWI_SCL_BIT);
+        TWI_PORT |= (1 << TWI_SCL_BIT);
+        _delay_us(5);
+    }
+
+    // STOP. SCL goes low, then SDA, then SCL goes high,
+    // then SDA.
+    TWI_PORT &= ~(1 << TWI_SCL_BIT);
+    TWI_DDR |= (1 << TWI_SCL_BIT);
+    TWI_PORT &= ~(1 << TWI_SDA_BIT);
+    TWI_DDR |= (1 << TWI_SDA_BIT);
+    _delay_us(5);
+    TWI_DDR &= ~(1 << TWI_SCL_BIT);
+    TWI_PORT |= (1 << TWI_SCL_BIT);
+    _delay_us(5);
+    TWI_DDR &= ~(1 << TWI_SDA_BIT);
+    TWI_PORT |= (1 << TWI_SDA_BIT);
+    _delay_us(5);
+
+    freed = TWI_PIN & (1 << TWI_SDA_BIT);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (!freed)
+            TWIStatistics.stuck++;
+
+        TWI_DDR = (TWI_DDR & ~pins) | oldDDR;
+        TWI_PORT = (TWI_PORT & ~pins) | oldPORT;
+
+        // Enable TWI and interrupt, TWBR, TWSR and TWAR are as
+        // they were.
+        TWCR = (1 << TWIE) | (1 << TWEN) | TWISlave.ack;
+        TWIInfo.mode = Ready;
+        TWIInfo.repStart = 0;
+        TWITicks = 0;
+    }
+
+    return freed;
+}
+
+
+//-------------------------------------------------------------
+// Function: TWITick
+//
+// The TWI has no timeout of its own. If a slave holds SDA or
+// SCL low, the interrupt that ends the current START, STOP or
+// byte never comes, and the conversation, and everything
+// queued after it, waits forever.
+//
+// Call this from a timer interrupt, every millisecond is good.
+// If <TWI_TIMEOUT_TICKS> calls go by with a conversation in
+// progress, but no TWI interrupt, it's abandoned with the error
+// <TWI_TIMEOUT>, and <TWIRecoverBus> frees the bus, with
+// interrupts on, even if this was called from an ISR. The next
+// queued transaction, if any, then starts, whether what timed
+// out was queued, or a <TWITransmitData> or <TWIReadData>.
+//
+// A repeated start left waiting by <TWITransmitData> or
+// <TWIReadData> is waiting for the main code, not the bus, so
+// it doesn't count.
+//
+// As a slave, the bus belongs to another master, so it's left
+// alone. We just stop waiting for that master, and carry on
+// with anything queued.
+//-------------------------------------------------------------
+void TWITick() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (isTWIReady()) {
+            TWITicks = 0;
+            return;
+        }
+
+        if (++TWITicks < TWI_TIMEOUT_TICKS)
+            return;
+
+        TWIStatistics.timeouts++;
+
+        if (TWIInfo.mode == SlaveTransmitter ||
+            TWIInfo.mode == SlaveReciever) {
+            TWITicks = 0;
+            TWISlaveDone();
+            return;
+        }
+
+        // It's ours now, the ISR mustn't finish it meanwhile.
+        TWCR = 0;
+    }
+
+    // Even from a timer ISR, let other interrupts in while the
+    // bus is freed. This one won't come round again for a tick.
+    NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE) {
+        TWIRecoverBus();
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (TWIQueue.running)
+            TWIQueueRemove(TWI_TIMEOUT);
+        else
+            TWIInfo.errorCode = TWI_TIMEOUT;
+
+        // Queued or not, whatever timed out held up anything
+        // queued behind it, which can start now.
+        if (TWIQueue.head != TWIQueue.tail)
+            TWIQueueStart();
+    }
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIStats
+//
+// Parameters:
+//
+//   stats - Where to put a copy of the counts, see 
+//           <TWIStatsStruct>.
+//   reset - true to zero the counts afterwards.
+//-------------------------------------------------------------
+void TWIStats(TWIStatsStruct *stats, bool reset) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *stats = TWIStatistics;
+
+        if (reset)
+            memset(&TWIStatistics, 0, sizeof(TWIStatistics));
+    }
+}
+
+
+//-------------------------------------------------------------
+// Function: TWIQueueInterrupt
+//
+// The part of <ISR(TWI_vect)> that runs queued transactions.
+// SLA+W and the bytes to write, if any, then a repeated START,
+// SLA+R and the bytes to read, if any. The bus is never let go
+// until it's all done.
+//-------------------------------------------------------------
+static void TWIQueueInterrupt(uint8_t status) {
+    TWITransaction *entry = TWIQueueCurrent();
+
+    switch (status) {
+
+    //---------------------------------------------------------
+    // We have the bus. Address the slave.
+    //---------------------------------------------------------
+    case TWI_START_SENT:
+    case TWI_REP_START_SENT:
+        TWIQueue.index = 0;
+        TWDR = (entry->address << 1) | (TWIQueue.reading ? 0x01 : 0x00);
+        TWISendByte();
+        break;
+
+    //---------------------------------------------------------
+    // Writing. Send the next byte, or, when they have all
+    // gone, read, or finish.
+    //---------------------------------------------------------
+    case TWI_MT_SLAW_ACK:
+        TWIInfo.mode = MasterTransmitter;
+        // Falls through.
+
+    case TWI_MT_DATA_ACK:
+        if (TWIQueue.index < entry->writeLen) {
+            TWDR = entry->writeData[TWIQueue.index++];
+            TWISendByte();
+        } else if (entry->readLen) {
+            // Keep the bus, a repeated START, then SLA+R.
+            TWIQueue.reading = true;
+            TWISendStart();
+        } else {
+            TWIQueueFinish(TWI_SUCCESS);
+        }
+        break;
+
+    //---------------------------------------------------------
+    // Reading. ACK every byte but the last, which is NACKed.
+    //---------------------------------------------------------
+    case TWI_MR_SLAR_ACK:
+        TWIInfo.mode = MasterReceiver;
+
+        if (entry->readLen > 1) {
+            TWISendACK();
+        } else {
+            TWISendNACK();
+        }
+        break;
+
+    case TWI_MR_DATA_ACK:
+        entry->readData[TWIQueue.index++] = TWDR;
+
+        if (TWIQueue.index < entry->readLen - 1) {
+            TWISendACK();
+        } else {
+            TWISendNACK();
+        }
+        break;
+
+    case TWI_MR_DATA_NACK:
+        entry->readData[TWIQueue.index++] = TWDR;
+        TWIQueueFinish(TWI_SUCCESS);
+        break;
+
+    //---------------------------------------------------------
+    // Not a real interrupt, ignore it.
+    //---------------------------------------------------------
+    case TWI_NO_RELEVANT_INFO:
+        break;
+
+    //---------------------------------------------------------
+    // Anything else is an error. No slave at the address, a
+    // byte NACKed, arbitration lost, or a bus error. Give up
+    // on this one, and carry on with the next.
+    //---------------------------------------------------------
+    default:
+        TWIQueueFinish(status);
+        break;
+    }
+}
+
+
+
+//-------------------------------------------------------------
+// Function: TWISlaveInterrupt
+//
+// The part of <ISR(TWI_vect)> that answers, as a slave, to a
+// master reading or writing the register bank, see
+// <TWISlaveInit>.
+//-------------------------------------------------------------
+static void TWISlaveInterrupt(uint8_t status) {
+    switch (status) {
+
+    //---------------------------------------------------------
+    // Our SLA+W. The first byte will select a register. If we
+    // were master, whoever it was is told it lost the bus.
+    //---------------------------------------------------------
+    case TWI_SR_ARB_LOST_SLAW_ACK:
+        if (!TWIQueue.running)
+            TWIInfo.errorCode = TWI_LOST_ARBIT;
+        // Falls through.
+
+    case TWI_SR_SLAW_ACK:
+        TWIInfo.mode = SlaveReciever;
+        TWISlave.pointerSet = false;
+        TWISlave.count = 0;
+        TWISendACK();
+        break;
+
+    //---------------------------------------------------------
+    // A byte for us. The register number, or the next
+    // register's contents. Only ACK the next byte if there's
+    // a register for it.
+    //---------------------------------------------------------
+    case TWI_SR_DATA_ACK: {
+        uint8_t data = TWDR;
+
+        if (!TWISlave.pointerSet) {
+            TWISlave.pointer = data;
+            TWISlave.first = data;
+            TWISlave.pointerSet = true;
+        } else {
+            TWISlave.bank[TWISlave.pointer++] = data;
+            TWISlave.count++;
+        }
+
+        if (TWISlave.pointer < TWISlave.size) {
+            TWISendACK();
+        } else {
+            TWISendNACK();
+        }
+        break;
+    }
+
+    //---------------------------------------------------------
+    // The write is over, with a STOP or repeated START, or
+    // because we NACKed a byte past the end of the bank.
+    //---------------------------------------------------------
+    case TWI_SR_DATA_NACK:
+    case TWI_SR_STOP:
+        if (TWISlave.count && TWISlave.written)
+            TWISlave.written(TWISlave.first, TWISlave.count);
+
+        TWISlaveDone();
+        break;
+
+    //---------------------------------------------------------
+    // Our SLA+R, or the master wants another byte.
+    //---------------------------------------------------------
+    case TWI_ST_ARB_LOST_SLAR_ACK:
+        if (!TWIQueue.running)
+            TWIInfo.errorCode = TWI_LOST_ARBIT;
+        // Falls through.
+
+    case TWI_ST_SLAR_ACK:
+        TWIInfo.mode = SlaveTransmitter;
+        // Falls through.
+
+    case TWI_ST_DATA_ACK:
+        if (TWISlave.pointer < TWISlave.size) {
+            TWDR = TWISlave.bank[TWISlave.pointer++];
+        } else {
+            TWDR = 0xFF;
+        }
+        TWISendACK();
+        break;
+
+    //---------------------------------------------------------
+    // The master has had enough, or the general call, which
+    // we don't answer to. Either way, we're done.
+    //---------------------------------------------------------
+    default:
+        TWISlaveDone();
+        break;
+    }
+}
+
+
+
 //-------------------------------------------------------------
 // Here be interrupts!
 //-------------------------------------------------------------
@@ -513,12 +1377,33 @@ uint8_t TWIReadData(uint8_t TWIaddr,
 // Until such time as this code is set, the communication is
 // still in progress.
 //
-// *NOTE:* The ISR currently only handles master transmitter 
-// and master receiver modes. The slave transmitter and slave
-// receiver modes have yet to be implemented.
+// Transactions from <TWIQueueTransaction> are handled by
+// <TWIQueueInterrupt>. As each one ends, its STOP is followed
+// at once by the START of the next, with no help from the
+// main code.
+//
+// Being addressed as a slave is handled by <TWISlaveInterrupt>.
+// That can happen part way through a conversation of our own,
+// if we lose arbitration to the master addressing us.
 //-------------------------------------------------------------
 ISR (TWI_vect)
 {
+    // Something happened, so it's not hung.
+    TWITicks = 0;
+
+    // A slave? Every slave status is from 0x60 to 0xC8.
+    if (TWI_STATUS >= TWI_SR_SLAW_ACK &&
+        TWI_STATUS <= TWI_ST_LAST_DATA_ACK) {
+        TWISlaveInterrupt(TWI_STATUS);
+        return;
+    }
+
+    // Working through the transaction queue?
+    if (TWIQueue.running) {
+        TWIQueueInterrupt(TWI_STATUS);
+        return;
+    }
+
     switch (TWI_STATUS) {
 
     //=========================================================
@@ -531,8 +1416,8 @@ ISR (TWI_vect)
     //---------------------------------------------------------
     case TWI_MT_SLAW_ACK:
         // Set mode to Master Transmitter.
-        // Drops in below.
         TWIInfo.mode = MasterTransmitter;
+        // Falls through.
 
     //---------------------------------------------------------
     // Start condition has been transmitted. The next data
@@ -555,7 +1440,7 @@ ISR (TWI_vect)
         // next data byte to transmit register.
         TWDR = TWITransmitBuffer[TXBuffIndex++]; 
         TWIInfo.errorCode = TWI_NO_RELEVANT_INFO;
-        TWISendTransmit(); // Send the data
+        TWISendByte(); // Send the data
         } else
             if (TWIInfo.repStart) {
                 // This transmission is complete however 
@@ -566,7 +1451,7 @@ ISR (TWI_vect)
                 // All transmissions are complete, exit.
                 TWIInfo.mode = Ready;
                 TWIInfo.errorCode = TWI_SUCCESS;
-                TWISendStop();
+                TWIReleaseBus();
           }
         break;
     
@@ -638,7 +1523,7 @@ ISR (TWI_vect)
             // All transmissions are complete, exit.
             TWIInfo.mode = Ready;
             TWIInfo.errorCode = TWI_SUCCESS;
-            TWISendStop();
+            TWIReleaseBus();
         }
       break;
     
@@ -681,7 +1566,7 @@ ISR (TWI_vect)
             // All transmissions are complete, exit.
             TWIInfo.mode = Ready;
             TWIInfo.errorCode = TWI_STATUS;
-            TWISendStop();
+            TWIReleaseBus();
         }
       break;
 
@@ -695,14 +1580,9 @@ ISR (TWI_vect)
         break;
     
     //=========================================================
-    //                  SLAVE RECEIVER
-    //=========================================================
-    // TODO  IMPLEMENT SLAVE RECEIVER FUNCTIONALITY
-
-    //=========================================================
-    //                SLAVE TRANSMITTER
+    //          SLAVE RECEIVER AND SLAVE TRANSMITTER
     //=========================================================
-    // TODO  IMPLEMENT SLAVE TRANSMITTER FUNCTIONALITY
+    // See TWISlaveInterrupt(), above.
 
     //=========================================================
     //              MISCELLANEOUS STATES
@@ -723,7 +1603,7 @@ ISR (TWI_vect)
     case TWI_ILLEGAL_START_STOP:
         TWIInfo.errorCode = TWI_ILLEGAL_START_STOP;
         TWIInfo.mode = Ready;
-        TWISendStop();
+        TWIReleaseBus();
         break;
     } // end switch.
 }
@@ -27,6 +27,8 @@
 #ifndef TWILIB_H_
 #define TWILIB_H_
 
+#include "TWIclock.h"
+
 //-------------------------------------------------------------
 // Title: Constants
 //-------------------------------------------------------------
@@ -83,9 +85,10 @@
 // A macro to extract the status of the most recent TWI action,
 // from the TWSR register, mask out the unwanted bits (bits
 // 0-2), and return the actual status code listed in the data
-// sheets.
+// sheets. Every status code is a multiple of 8.
 //-------------------------------------------------------------
-#define TWI_STATUS  (TWSR & 0xF8) 
+#define TWI_STATUS_MASK 0xF8
+#define TWI_STATUS  (TWSR & TWI_STATUS_MASK) 
 
 
 //-------------------------------------------------------------
@@ -115,9 +118,12 @@
 //                    still control the bus, but we are
 //                    receiving data.
 //
-//   SlaveTransmitter - Not currently used by the library.
+//   SlaveTransmitter - Our own SLA+R has been received, and
+//                      we are sending a master the contents of
+//                      the register bank. See <TWISlaveInit>.
 //
-//   SlaveReciever - Not currently used by the library.
+//   SlaveReciever - Our own SLA+W has been received, and a
+//                   master is writing to the register bank.
 //-------------------------------------------------------------
 typedef enum {
     Ready,
@@ -153,6 +159,194 @@ typedef struct TWIInfoStruct{
     uint8_t repStart; 
 } TWIInfoStruct;
 
+//-------------------------------------------------------------
+// Title: Transaction Queue
+//-------------------------------------------------------------
+
+
+//-------------------------------------------------------------
+// Constant: TWI_QUEUE_SIZE
+//
+// How many transactions <TWIQueueTransaction> can hold while
+// the bus is busy. It must be a power of 2, up to 128. Override
+// it in platformio.ini, for example:
+//
+// build_flags = -DTWI_QUEUE_SIZE=8
+//-------------------------------------------------------------
+#ifndef TWI_QUEUE_SIZE
+    #define TWI_QUEUE_SIZE 4
+#endif
+
+static_assert(TWI_QUEUE_SIZE >= 1 && TWI_QUEUE_SIZE <= 128 &&
+              (TWI_QUEUE_SIZE & (TWI_QUEUE_SIZE - 1)) == 0,
+              "TWI_QUEUE_SIZE must be a power of 2, up to 128.");
+
+
+//-------------------------------------------------------------
+// Type: TWICallback
+//
+// A function called from <ISR(TWI_vect)>, with interrupts
+// off, when a queued transaction has finished. "errorCode" is
+// <TWI_SUCCESS>, or the TWI status code that stopped it.
+// "context" is whatever was in the <TWITransaction>.
+//
+// The bus is held until it returns, so keep it short. It may
+// call <TWIQueueTransaction> to queue another.
+//-------------------------------------------------------------
+typedef void (*TWICallback)(uint8_t errorCode, void *context);
+
+
+//-------------------------------------------------------------
+// Type: TWIHandle
+//
+// Somewhere for <TWISignal> to put the result of a queued
+// transaction. It reads <TWI_NO_RELEVANT_INFO> while the
+// transaction is queued or running, then <TWI_SUCCESS>, or the
+// status code that stopped it. Poll it with <TWIDone>, or
+// wait on it with <TWIWait>.
+//
+// Usage:
+//
+// ---C++
+// TWIHandle reading;
+// TWIWriteRead(0x4F, &reg, 1, temperature, 2,
+//              TWISignal, (void *)&reading);
+//
+// while (!TWIDone(&reading))
+//     doSomethingUseful();
+//
+// if (reading != TWI_SUCCESS)
+//     handleTWIErrorsHere(reading);
+// ---
+//-------------------------------------------------------------
+typedef volatile uint8_t TWIHandle;
+
+
+//-------------------------------------------------------------
+// Constant: TWI_IDLE_SLEEP
+//
+// <TWIWait> is a busy loop. Define TWI_IDLE_SLEEP as 1 to have
+// the CPU sleep in idle mode between interrupts instead:
+//
+// build_flags = -DTWI_IDLE_SLEEP=1
+//-------------------------------------------------------------
+#ifndef TWI_IDLE_SLEEP
+    #define TWI_IDLE_SLEEP 0
+#endif
+
+
+//-------------------------------------------------------------
+// Struct: TWITransaction
+//
+// One conversation with one slave, for <TWIQueueTransaction>.
+// Any bytes to write are sent first, then any bytes to read
+// are read, after a repeated START. With neither, the slave is
+// only addressed, which will tell if it's there.
+//
+// Members:
+//
+//  address - The 7 bit address of the slave.
+//  writeData - The bytes to write, after SLA+W.
+//  writeLen - How many bytes to write, may be 0.
+//  readData - Where the bytes read, after SLA+R, go.
+//  readLen - How many bytes to read, may be 0.
+//  callback - Called when it's all done, may be 0.
+//  context - For the caller's use, passed to the callback.
+//
+// *WARNING*: The buffers must not be allowed to go out of
+// scope until the callback has been called.
+//-------------------------------------------------------------
+typedef struct TWITransaction {
+    uint8_t address;
+    const uint8_t *writeData;
+    uint8_t writeLen;
+    uint8_t *readData;
+    uint8_t readLen;
+    TWICallback callback;
+    void *context;
+} TWITransaction;
+
+//-------------------------------------------------------------
+// Title: Slave Mode
+//-------------------------------------------------------------
+
+
+//-------------------------------------------------------------
+// Type: TWISlaveCallback
+//
+// A function called from <ISR(TWI_vect)>, with interrupts
+// off, when a master has written to the register bank given to
+// <TWISlaveInit>, and sent a STOP or a repeated START. "reg" is
+// the first register written, "count" how many were, one after
+// the other. It isn't called for a write that only selects a
+// register, to be read.
+//
+// The bus is held until it returns, so keep it short.
+//-------------------------------------------------------------
+typedef void (*TWISlaveCallback)(uint8_t reg, uint8_t count);
+
+//-------------------------------------------------------------
+// Title: Timeouts and Bus Recovery
+//-------------------------------------------------------------
+
+
+//-------------------------------------------------------------
+// Constant: TWI_TIMEOUT_TICKS
+//
+// How many calls of <TWITick>, with no TWI interrupt, before
+// a conversation is given up as hung. Called every millisecond,
+// the default of 10 allows far longer than a byte takes even
+// at 10 KHz, and no slave should stretch the clock that long.
+//-------------------------------------------------------------
+#ifndef TWI_TIMEOUT_TICKS
+    #define TWI_TIMEOUT_TICKS 10
+#endif
+
+
+//-------------------------------------------------------------
+// Constants: TWI_PIN, TWI_DDR, TWI_PORT, TWI_SDA_BIT, TWI_SCL_BIT
+//
+// Where SDA and SCL are, so that <TWIRecoverBus> can drive
+// them by hand. PC4 and PC5 on the ATmega328P, PD1 and PD0 on
+// the ATmega2560.
+//-------------------------------------------------------------
+#ifndef TWI_PIN
+    #if defined(__AVR_ATmega2560__)
+        #define TWI_PIN PIND
+        #define TWI_DDR DDRD
+        #define TWI_PORT PORTD
+        #define TWI_SDA_BIT PD1
+        #define TWI_SCL_BIT PD0
+    #else
+        #define TWI_PIN PINC
+        #define TWI_DDR DDRC
+        #define TWI_PORT PORTC
+        #define TWI_SDA_BIT PC4
+        #define TWI_SCL_BIT PC5
+    #endif
+#endif
+
+
+//-------------------------------------------------------------
+// Struct: TWIStatsStruct
+//
+// Counts of trouble on the bus, from <TWIStats>. Any of them
+// going up is a sign of a flaky bus, or slave.
+//
+// Members:
+//
+//  timeouts - Conversations abandoned by <TWITick>.
+//  recoveries - Calls of <TWIRecoverBus>, by <TWITick> or
+//               anyone else.
+//  stuck - Recoveries that left SDA still held low.
+//-------------------------------------------------------------
+typedef struct TWIStatsStruct {
+    uint16_t timeouts;
+    uint16_t recoveries;
+    uint16_t stuck;
+} TWIStatsStruct;
+
+
 //-------------------------------------------------------------
 // Title: External Variables
 //-------------------------------------------------------------
@@ -168,8 +362,10 @@ typedef struct TWIInfoStruct{
 //
 // The TWIInfo structure. This holds status etc information 
 // regarding the current conversation. See <TWIInfoStruct>.
+// It's volatile, as the interrupt handler changes it, so a
+// loop waiting on it really does read it every time.
 //-------------------------------------------------------------
-extern TWIInfoStruct TWIInfo;
+extern volatile TWIInfoStruct TWIInfo;
 
 
 //-------------------------------------------------------------
@@ -342,6 +538,97 @@ extern int RXBuffLen;
 #define TWI_MR_DATA_NACK 0x58 
 
 
+//-------------------------------------------------------------
+// Slave Receiver Mode.
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// Constant: TWI_SR_SLAW_ACK
+//
+// Status code returned when our own SLA+W has been received,
+// and ACK returned. This puts the TWI into slave receiver mode.
+//-------------------------------------------------------------
+#define TWI_SR_SLAW_ACK 0x60
+
+//-------------------------------------------------------------
+// Constant: TWI_SR_ARB_LOST_SLAW_ACK
+//
+// As <TWI_SR_SLAW_ACK>, but we were sending SLA+R/W ourselves,
+// as master, and lost arbitration to the master addressing us.
+//-------------------------------------------------------------
+#define TWI_SR_ARB_LOST_SLAW_ACK 0x68
+
+//-------------------------------------------------------------
+// Constant: TWI_SR_DATA_ACK
+//
+// Status code returned when the master has sent us a data
+// byte, now in register TWDR, and we sent back an ACK.
+//-------------------------------------------------------------
+#define TWI_SR_DATA_ACK 0x80
+
+//-------------------------------------------------------------
+// Constant: TWI_SR_DATA_NACK
+//
+// Status code returned when the master has sent us a data
+// byte, and we sent back a NACK. We are no longer addressed.
+//-------------------------------------------------------------
+#define TWI_SR_DATA_NACK 0x88
+
+//-------------------------------------------------------------
+// Constant: TWI_SR_STOP
+//
+// Status code returned when a STOP, or a repeated START, has
+// been received while we were addressed as a slave receiver.
+//-------------------------------------------------------------
+#define TWI_SR_STOP 0xA0
+
+
+//-------------------------------------------------------------
+// Slave Transmitter Mode.
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// Constant: TWI_ST_SLAR_ACK
+//
+// Status code returned when our own SLA+R has been received,
+// and ACK returned. This puts the TWI into slave transmitter
+// mode, and the first data byte must go into TWDR.
+//-------------------------------------------------------------
+#define TWI_ST_SLAR_ACK 0xA8
+
+//-------------------------------------------------------------
+// Constant: TWI_ST_ARB_LOST_SLAR_ACK
+//
+// As <TWI_ST_SLAR_ACK>, but we lost arbitration, as master, to
+// the master addressing us.
+//-------------------------------------------------------------
+#define TWI_ST_ARB_LOST_SLAR_ACK 0xB0
+
+//-------------------------------------------------------------
+// Constant: TWI_ST_DATA_ACK
+//
+// Status code returned when the byte in TWDR has been sent,
+// and the master sent back an ACK. It wants another.
+//-------------------------------------------------------------
+#define TWI_ST_DATA_ACK 0xB8
+
+//-------------------------------------------------------------
+// Constant: TWI_ST_DATA_NACK
+//
+// Status code returned when the byte in TWDR has been sent,
+// and the master sent back a NACK. It wants no more.
+//-------------------------------------------------------------
+#define TWI_ST_DATA_NACK 0xC0
+
+//-------------------------------------------------------------
+// Constant: TWI_ST_LAST_DATA_ACK
+//
+// Status code returned when the byte in TWDR, sent with TWEA
+// clear as the last one, has been ACKed by the master.
+//-------------------------------------------------------------
+#define TWI_ST_LAST_DATA_ACK 0xC8
+
+
 //-------------------------------------------------------------
 // Miscellaneous States
 //
@@ -383,6 +670,15 @@ extern int RXBuffLen;
 //-------------------------------------------------------------
 #define TWI_SUCCESS 0xFF 
 
+//-------------------------------------------------------------
+// Constant: TWI_TIMEOUT
+//
+// The errorCode when a conversation made no progress for
+// <TWI_TIMEOUT_TICKS> calls of <TWITick>, and was abandoned.
+// Like <TWI_SUCCESS>, TWSR can never hold this value.
+//-------------------------------------------------------------
+#define TWI_TIMEOUT 0xFE
+
 
 //-------------------------------------------------------------
 // Constant: TWI_COMMON
@@ -412,6 +708,14 @@ extern int RXBuffLen;
 //-------------------------------------------------------------
 #define TWISendStop()   (TWCR = (TWI_COMMON)|(1<<TWSTO)) 
 
+//-------------------------------------------------------------
+// Macro: TWISendStopStart
+//
+// Send the STOP signal, then a START as soon as it's done, to
+// begin the next conversation.
+//-------------------------------------------------------------
+#define TWISendStopStart() (TWCR = (TWI_COMMON)|(1<<TWSTO)|(1<<TWSTA))
+
 //-------------------------------------------------------------
 // Macro: TWISendTransmit
 //
@@ -449,10 +753,32 @@ uint8_t TWITransmitData(void *const TXdata,
                         
 //-------------------------------------------------------------
 // Initialise the TWI interface with a default clock frequency
-// of 100 KHz. 
+// of 100 KHz. The prescaler and TWBR are worked out at run
+// time, see <TWIclock.h>.
 //-------------------------------------------------------------
 void TWIInit(uint32_t freqSCLKHz = 100);
 
+//-------------------------------------------------------------
+// Initialise the TWI interface with TWBR and the TWPS1:0
+// prescaler bits already worked out.
+//-------------------------------------------------------------
+void TWIInitTWBR(uint8_t bitRate, uint8_t prescaler);
+
+//-------------------------------------------------------------
+// As TWIInit(freqSCLKHz), but the frequency, in Hz, is a
+// constant, so TWBR and the prescaler are worked out at
+// compile time. It won't compile if this F_CPU can't do it:
+//
+// TWIInit<400000>();
+//-------------------------------------------------------------
+template <uint32_t sclHz>
+inline void TWIInit() {
+    static_assert(twiClockValid(sclHz),
+                  "This SCL frequency can't be done at this F_CPU.");
+
+    TWIInitTWBR(twiClockBitRate(sclHz), twiClockPrescaler(sclHz));
+}
+
 //-------------------------------------------------------------
 // Initiate a read of data from the TWI interface.
 //-------------------------------------------------------------
@@ -466,16 +792,91 @@ uint8_t TWIReadData(uint8_t TWIaddr,
 //-------------------------------------------------------------
 uint8_t isTWIReady();
 
+//-------------------------------------------------------------
+// Answer, as a slave, to the 7 bit "address", and let masters
+// read and write the "size" registers in "bank". Call after
+// <TWIInit>, which turns slave mode off again.
+//-------------------------------------------------------------
+void TWISlaveInit(uint8_t address,
+                  volatile uint8_t *bank, uint8_t size,
+                  TWISlaveCallback written = 0);
+
+//-------------------------------------------------------------
+// Call every millisecond, or so, from a timer interrupt, to
+// catch conversations that hang. See <TWI_TIMEOUT_TICKS>.
+//-------------------------------------------------------------
+void TWITick();
+
+//-------------------------------------------------------------
+// Free a slave stuck holding SDA low, and send a STOP. Returns
+// true if SDA is free afterwards.
+//-------------------------------------------------------------
+bool TWIRecoverBus();
+
+//-------------------------------------------------------------
+// Take a copy of the timeout and recovery counts, and zero
+// them if "reset" is true.
+//-------------------------------------------------------------
+void TWIStats(TWIStatsStruct *stats, bool reset = false);
+
 //-------------------------------------------------------------
 // Return the current TWI clock frequency in KHz.
 //-------------------------------------------------------------
 uint32_t SCLfreq();
 
+//-------------------------------------------------------------
+// Return the current TWI clock frequency in Hz.
+//-------------------------------------------------------------
+uint32_t SCLfreqHz();
+
+//-------------------------------------------------------------
+// Queue a transaction. It starts as soon as the bus is free,
+// and the interrupt handler runs it, and every other queued
+// one, to the end. Returns <TWI_TX_RX_NOT_READY> if the queue
+// is full.
+//-------------------------------------------------------------
+uint8_t TWIQueueTransaction(const TWITransaction *transaction);
+
+//-------------------------------------------------------------
+// Queue a write, then a read after a repeated START, with one
+// call. Returns as <TWIQueueTransaction>.
+//-------------------------------------------------------------
+uint8_t TWIWriteRead(uint8_t address,
+                     const void *writeData, uint8_t writeLen,
+                     void *readData, uint8_t readLen,
+                     TWICallback callback = 0, void *context = 0);
+
+//-------------------------------------------------------------
+// A ready made <TWICallback>. "context" is the address of a
+// <TWIHandle>, which gets the result. Queueing a transaction
+// with it sets the handle to <TWI_NO_RELEVANT_INFO>.
+//-------------------------------------------------------------
+void TWISignal(uint8_t errorCode, void *context);
+
+//-------------------------------------------------------------
+// Has the transaction signalling this handle finished?
+//-------------------------------------------------------------
+inline bool TWIDone(const TWIHandle *handle) {
+    return *handle != TWI_NO_RELEVANT_INFO;
+}
+
+//-------------------------------------------------------------
+// Wait for the transaction signalling this handle to finish,
+// and return its result. Interrupts must be on.
+//-------------------------------------------------------------
+uint8_t TWIWait(TWIHandle *handle);
+
+//-------------------------------------------------------------
+// How many queued transactions are yet to finish?
+//-------------------------------------------------------------
+uint8_t TWIQueuePending();
+
 #ifndef NO_ERROR_DATA_REQUIRED
 //-------------------------------------------------------------
 // Return the most recent TWI error message. Uses the error
 // code from <TWIInfo> and returns a message explaining what
-// might have happened.
+// might have happened. The message is in flash, print it with
+// "%S" or USARTwriteText_P().
 //-------------------------------------------------------------
 const char *TWIGetLastError(uint8_t errorCode);
 #endif
@@ -1,6 +1,8 @@
 #ifndef TWI_ERRORS
 #define TWI_ERRORS
 
+#include <avr/pgmspace.h>
+
 //-------------------------------------------------------------
 // File: twiErrors.h
 //
@@ -8,6 +10,11 @@
 // NO_ERROR_DATA_REQUIRED is defined. This will save Static 
 // and Flash RAM space, if it is tight.
 //
+// The messages, and the table of them, are all in flash, so
+// they cost no Static RAM. <TWIGetLastError> returns a flash
+// address, so print it with "%S", or USARTwriteText_P(), and
+// not "%s".
+//
 // ---C++
 // #ifndef NO_ERROR_DATA_REQUIRED
 //    #include "twiErrors.h"
@@ -19,7 +26,7 @@
 //        printf("Error: %x", errorCode);
 //
 //#ifndef NO_ERROR_DATA_REQUIRED
-//        printf(" %s", TWIGetLastError(errorCode));
+//        printf(" %S", TWIGetLastError(errorCode));
 //#endif
 //
 //        printf("\n");
@@ -29,36 +36,20 @@
 
 
 
-//------------------------------------------------------------
-// Struct: TWIStatusMessage
-//
-// The structure holds a status code from TWI and a messages
-// attempting to translate the code into meaningful text.
-//
-// Members:
-//
-//  errorCode - Any TWI status codes set by the interrupt 
-//              handler <ISR{TWI_vect)>.
-//
-//  errorMessage - A reasonably explanatory message for the
-//                 error code.
-//------------------------------------------------------------
-typedef struct TWIStatusMessage {
-    uint8_t errorCode;
-    const char * errorMessage;
-} TWIStatusMessage;
-
 //------------------------------------------------------------
 //
 // Array: TWIStatusMessages[]
 //
-// TWIStatusMessages is a static array of <TWIStatusMessage>.
-// There is one entry in the array for each possible status 
-// code that can be returned, at any point in time, from the 
-// TWI interrupt handler into <TWIInfo>.
+// TWIStatusMessages is a static array of pointers to messages,
+// all in flash. The status codes set by the interrupt handler
+// <ISR{TWI_vect)> are always multiples of 8, <TWI_STATUS>
+// masks off the prescaler bits, so there are only 32 of them
+// and the array is indexed by the code divided by 8. Codes the
+// TWI hardware never sets point at the "Unknown Error" text.
 //
-// It could be used as follows where we wait in a loop for 
-// a success from TWI:
+// Read it with pgm_read_ptr(), or better, let
+// <TWIGetLastError> do it. It could be used as follows where
+// we wait in a loop for a success from TWI:
 //
 // ---C++
 //    TWIInfo.errorCode = TWI_NO_RELEVANT_INFO;
@@ -69,7 +60,7 @@ typedef struct TWIStatusMessage {
 //        // Ignore TWI_NO_RELEVANT_INFO.
 //        if (errorCode != TWI_NO_RELEVANT_INFO) {
 //            printf("TWI Transmit error: %d\n", errorCode);
-//            printf("%s\n", TWIGetLastError(errorCode));
+//            printf("%S\n", TWIGetLastError(errorCode));
 //            ...
 //        }
 //        errorCode = TWIInfo.errorCode;           
@@ -78,34 +69,75 @@ typedef struct TWIStatusMessage {
 // ---
 //
 //------------------------------------------------------------
-TWIStatusMessage TWIStatusMessages[] = {
-    {0x00, "Bus error due to illegal start or stop condition"},
-    {0x08, "Start sent"},
-    {0x10, "Repeated start sent"},
-    {0x18, "SLA+W transmitted, ACK received"},
-    {0x20, "SLA+W transmitted, NACK received"},
-    {0x28, "Data byte transmitted, ACK received"},
-    {0x30, "Data byte transmitted, NACK received"},
-    {0x38, "Arbitrations lost"},
-    {0x40, "SLA+R transmitted, ACK received"},
-    {0x48, "SLA+R transmitted, NACK received"},
-    {0x50, "Data byte received, ACK transmitted"},
-    {0x58, "Data byte received, NACK transmitted"},
-    {0x60, "Own SLA+W receved, ACK transmitted"},
-    {0x68, "Arbitration lost in SLA+R/W. Own SLA+W received, ACK transmitted"},
-    {0x70, "General call address received, ACK transmitted"},
-    {0x80, "In SLA+W mode, data byte has been received, ACK transmitted"},
-    {0x88, "In SLA+W mode, data byte has been received, NACK transmitted"},
-    {0x90, "In General mode, data byte has been received, ACK transmitted"},
-    {0x98, "In General mode, data byte has been received, NACK transmitted"},
-    {0xA0, "In SLA+R/W mode, stop or Repeated start received"},
-    {0xA8, "Own SLA+R received, ACK transmitted"},
-    {0xB0, "Arbitration lost in SLA+R/W. Own SLA+R received, ACK transmitted"},
-    {0xB8, "Data byte transmitted, ACK received"},
-    {0xC0, "Data byte transmitted, NACK received"},
-    {0xC8, "Final data byte transmitted, ACK received"},
-    {0xF8, "No relevant state information"},
-    {0xFF, "Unknown Error"},
+
+// PROGMEM on the table doesn't reach the string literals in
+// it, they would still be copied to Static RAM at startup. So
+// each message is a PROGMEM array of its own.
+static const char twiMsg00[] PROGMEM = "Bus error due to illegal start or stop condition";
+static const char twiMsg08[] PROGMEM = "Start sent";
+static const char twiMsg10[] PROGMEM = "Repeated start sent";
+static const char twiMsg18[] PROGMEM = "SLA+W transmitted, ACK received";
+static const char twiMsg20[] PROGMEM = "SLA+W transmitted, NACK received";
+static const char twiMsg28[] PROGMEM = "Data byte transmitted, ACK received";
+static const char twiMsg30[] PROGMEM = "Data byte transmitted, NACK received";
+static const char twiMsg38[] PROGMEM = "Arbitrations lost";
+static const char twiMsg40[] PROGMEM = "SLA+R transmitted, ACK received";
+static const char twiMsg48[] PROGMEM = "SLA+R transmitted, NACK received";
+static const char twiMsg50[] PROGMEM = "Data byte received, ACK transmitted";
+static const char twiMsg58[] PROGMEM = "Data byte received, NACK transmitted";
+static const char twiMsg60[] PROGMEM = "Own SLA+W receved, ACK transmitted";
+static const char twiMsg68[] PROGMEM = "Arbitration lost in SLA+R/W. Own SLA+W received, ACK transmitted";
+static const char twiMsg70[] PROGMEM = "General call address received, ACK transmitted";
+static const char twiMsg78[] PROGMEM = "Arbitration lost in SLA+R/W. General call address received, ACK transmitted";
+static const char twiMsg80[] PROGMEM = "In SLA+W mode, data byte has been received, ACK transmitted";
+static const char twiMsg88[] PROGMEM = "In SLA+W mode, data byte has been received, NACK transmitted";
+static const char twiMsg90[] PROGMEM = "In General mode, data byte has been received, ACK transmitted";
+static const char twiMsg98[] PROGMEM = "In General mode, data byte has been received, NACK transmitted";
+static const char twiMsgA0[] PROGMEM = "In SLA+R/W mode, stop or Repeated start received";
+static const char twiMsgA8[] PROGMEM = "Own SLA+R received, ACK transmitted";
+static const char twiMsgB0[] PROGMEM = "Arbitration lost in SLA+R/W. Own SLA+R received, ACK transmitted";
+static const char twiMsgB8[] PROGMEM = "Data byte transmitted, ACK received";
+static const char twiMsgC0[] PROGMEM = "Data byte transmitted, NACK received";
+static const char twiMsgC8[] PROGMEM = "Final data byte transmitted, ACK received";
+static const char twiMsgF8[] PROGMEM = "No relevant state information";
+static const char twiMsgFF[] PROGMEM = "Unknown Error";
+static const char twiMsgTimeout[] PROGMEM = "Timed out, bus recovered";
+
+#define TWI_STATUS_MESSAGES 32
+
+const char * const TWIStatusMessages[TWI_STATUS_MESSAGES] PROGMEM = {
+    twiMsg00,    // 0x00
+    twiMsg08,    // 0x08
+    twiMsg10,    // 0x10
+    twiMsg18,    // 0x18
+    twiMsg20,    // 0x20
+    twiMsg28,    // 0x28
+    twiMsg30,    // 0x30
+    twiMsg38,    // 0x38
+    twiMsg40,    // 0x40
+    twiMsg48,    // 0x48
+    twiMsg50,    // 0x50
+    twiMsg58,    // 0x58
+    twiMsg60,    // 0x60
+    twiMsg68,    // 0x68
+    twiMsg70,    // 0x70
+    twiMsg78,    // 0x78
+    twiMsg80,    // 0x80
+    twiMsg88,    // 0x88
+    twiMsg90,    // 0x90
+    twiMsg98,    // 0x98
+    twiMsgA0,    // 0xA0
+    twiMsgA8,    // 0xA8
+    twiMsgB0,    // 0xB0
+    twiMsgB8,    // 0xB8
+    twiMsgC0,    // 0xC0
+    twiMsgC8,    // 0xC8
+    twiMsgFF,    // 0xD0
+    twiMsgFF,    // 0xD8
+    twiMsgFF,    // 0xE0
+    twiMsgFF,    // 0xE8
+    twiMsgFF,    // 0xF0
+    twiMsgF8,    // 0xF8
 };
 
 
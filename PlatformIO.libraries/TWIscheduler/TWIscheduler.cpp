@@ -0,0 +1,315 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <string.h>
+#include "TWIlib.h"
+#include "TWIscheduler.h"
+
+//============================================================
+// The bus share is counted in thousandths of a bit time, so
+// that even a slow SCL gets some every tick.
+//============================================================
+static struct {
+    TWIschedDevice *devices;    // The list.
+    TWIschedDevice *first;      // Tried first next tick.
+    volatile uint32_t now;      // Ticks so far.
+    uint32_t credit;            // Bus time we may use.
+    uint32_t perTick;           // Added every tick.
+    uint32_t depth;             // Most we can save up.
+} TWIsched;
+
+
+//------------------------------------------------------------
+// Forget everything, and work out the bus share from the SCL
+// frequency TWIInit() set.
+//------------------------------------------------------------
+void TWIschedInit() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memset(&TWIsched, 0, sizeof(TWIsched));
+        TWIsched.perTick = SCLfreqHz() * TWISCHED_BUS_PERCENT / 100;
+        TWIsched.depth = TWIsched.perTick;
+        TWIsched.credit = TWIsched.depth;
+    }
+}
+
+
+//------------------------------------------------------------
+// START, SLA+W, the register, a repeated START, SLA+R, the
+// data and a STOP, for each step, in bit times.
+//------------------------------------------------------------
+static uint32_t TWIschedCost(const TWIschedStep *script, uint8_t steps) {
+    uint32_t bits = 0;
+
+    for (uint8_t x = 0; x < steps; x++)
+        bits += 1 + 9 + 9 + 1 + 9 + 9 * script[x].count + 1;
+
+    return bits;
+}
+
+
+//------------------------------------------------------------
+// Fill in the device and add it to the end of the list, so
+// devices due on the same tick start in the order added, at
+// first.
+//------------------------------------------------------------
+bool TWIschedAdd(TWIschedDevice *device,
+                 uint8_t address,
+                 uint16_t periodMs,
+                 const TWIschedStep *script,
+                 uint8_t steps,
+                 uint8_t *buffer,
+                 TWIschedCallback done) {
+    uint32_t bits = TWIschedCost(script, steps);
+    uint16_t size = 0;
+
+    for (uint8_t x = 0; x < steps; x++)
+        size += script[x].count;
+
+    // The device only has 8 bits for the size and offset, and
+    // 16 for the cost.
+    if (size > 255 || bits > 0xFFFF)
+        return false;
+
+    uint32_t cost = bits * 1000;
+
+    // It could never keep up, even with the bus to itself. That
+    // is cost > periodMs * perTick, but the product can
+    // overflow, and this can't.
+    if (!periodMs || !steps || !TWIsched.perTick ||
+        (cost - 1) / TWIsched.perTick >= periodMs)
+        return false;
+
+    memset(device, 0, sizeof(*device));
+    device->address = address;
+    device->periodMs = periodMs;
+    device->script = script;
+    device->steps = steps;
+    device->buffer = buffer;
+    device->done = done;
+    device->cost = bits;
+    device->size = size;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        device->due = TWIsched.now + 1;
+
+        // Always enough saved up for the biggest read.
+        if (TWIsched.depth < cost + TWIsched.perTick)
+            TWIsched.depth = cost + TWIsched.perTick;
+
+        TWIschedDevice **last = &TWIsched.devices;
+        while (*last)
+            last = &(*last)->next;
+        *last = device;
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------
+// Queue the read of the current step.
+//------------------------------------------------------------
+static void TWIschedStepDone(uint8_t errorCode, void *context);
+
+static uint8_t TWIschedQueueStep(TWIschedDevice *device) {
+    const TWIschedStep *step = &device->script[device->step];
+
+    return TWIWriteRead(device->address,
+                        &step->reg, 1,
+                        device->buffer + device->offset, step->count,
+                        TWIschedStepDone, device);
+}
+
+
+//------------------------------------------------------------
+// The TWI ISR has finished a step. Queue the next one, or
+// finish the read. The slot the step just freed in the queue
+// is still free, so the next step can always be queued.
+//------------------------------------------------------------
+static void TWIschedStepDone(uint8_t errorCode, void *context) {
+    TWIschedDevice *device = (TWIschedDevice *)context;
+
+    if (errorCode == TWI_SUCCESS) {
+        device->offset += device->script[device->step].count;
+
+        if (++device->step < device->steps &&
+            TWIschedQueueStep(device) == TWI_TX_RX_SUCCESS)
+            return;
+    }
+
+    device->result = errorCode;
+    if (errorCode == TWI_SUCCESS) {
+        device->samples++;
+    } else {
+        device->errors++;
+    }
+
+    device->fresh = true;
+    device->busy = false;
+
+    if (device->done)
+        device->done(device, errorCode);
+}
+
+
+//------------------------------------------------------------
+// Start a read of the device, and note when, for the stats.
+// Returns false if the TWI queue is full.
+//------------------------------------------------------------
+static bool TWIschedStart(TWIschedDevice *device) {
+    device->step = 0;
+    device->offset = 0;
+    device->busy = true;
+
+    if (TWIschedQueueStep(device) != TWI_TX_RX_SUCCESS) {
+        device->busy = false;
+        return false;
+    }
+
+    uint32_t now = TWIsched.now;
+
+    if (!device->starts) {
+        device->firstStart = now;
+    } else {
+        // Gaps after a skipped period aren't jitter, they are
+        // counted as skipped instead.
+        uint32_t gap = now - device->lastStart;
+        if (gap < 2UL * device->periodMs) {
+            uint16_t jitter = (gap > device->periodMs) ?
+                              gap - device->periodMs :
+                              device->periodMs - gap;
+            device->jitterSum += jitter;
+            device->gaps++;
+            if (jitter > device->jitterMax)
+                device->jitterMax = jitter;
+        }
+    }
+
+    device->lastStart = now;
+    device->starts++;
+    device->due += device->periodMs;
+    return true;
+}
+
+
+//------------------------------------------------------------
+// Every millisecond. Each device that's due is started, if
+// there's enough bus time saved up for it, otherwise it
+// waits for a later tick. Which device is tried first goes
+// round in turn, so that none is always last.
+//------------------------------------------------------------
+void TWIschedTick() {
+    uint32_t now = ++TWIsched.now;
+
+    TWIsched.credit += TWIsched.perTick;
+    if (TWIsched.credit > TWIsched.depth)
+        TWIsched.credit = TWIsched.depth;
+
+    if (!TWIsched.first)
+        TWIsched.first = TWIsched.devices;
+
+    TWIschedDevice *device = TWIsched.first;
+    while (device) {
+        if (!device->busy && (int32_t)(now - device->due) >= 0) {
+            // A whole period, or more, late? Those reads are
+            // lost, but stay in step with the period.
+            uint32_t late = now - device->due;
+            if (late >= device->periodMs) {
+                uint16_t lost = late / device->periodMs;
+                device->skipped += lost;
+                device->due += (uint32_t)lost * device->periodMs;
+            }
+
+            uint32_t cost = device->cost * 1000UL;
+            if (TWIsched.credit >= cost && TWIschedStart(device))
+                TWIsched.credit -= cost;
+        }
+
+        device = device->next ? device->next : TWIsched.devices;
+        if (device == TWIsched.first)
+            break;
+    }
+
+    TWIsched.first = TWIsched.first ? TWIsched.first->next : 0;
+}
+
+
+//------------------------------------------------------------
+// The latest reading, if there's a new one, and it's all
+// there.
+//------------------------------------------------------------
+uint8_t TWIschedFetch(TWIschedDevice *device, uint8_t *data) {
+    uint8_t result = TWI_NO_RELEVANT_INFO;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (device->fresh && !device->busy) {
+            memcpy(data, device->buffer, device->size);
+            device->fresh = false;
+            result = device->result;
+        }
+    }
+
+    return result;
+}
+
+
+//------------------------------------------------------------
+// Reads per 1000 seconds, (intervals * 1000000) / spanMs, in
+// 32 bit integers. Seconds first, then the remainder, so
+// nothing overflows. As there's at most one start per tick,
+// spanMs is at least intervals, and the rate at most 1000000.
+//------------------------------------------------------------
+static uint32_t TWIschedRate(uint16_t intervals, uint32_t spanMs) {
+    uint32_t perSecond = intervals * 1000UL;
+    uint32_t rest = perSecond % spanMs;
+    uint32_t rate = perSecond / spanMs * 1000;
+
+    // rest * 1000 fits, for spans up to an hour or so.
+    if (spanMs <= 0xFFFFFFFFUL / 1000)
+        return rate + rest * 1000 / spanMs;
+
+    return rate + rest / (spanMs / 1000);
+}
+
+
+//------------------------------------------------------------
+// Take a consistent copy of the statistics. The arithmetic is
+// done after, with interrupts on.
+//------------------------------------------------------------
+void TWIschedStats(TWIschedDevice *device,
+                   TWIschedStatsStruct *stats,
+                   bool reset) {
+    uint16_t starts;
+    uint32_t span;
+    uint16_t gaps;
+    uint16_t jitterMax;
+    uint32_t jitterSum;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        stats->samples = device->samples;
+        stats->errors = device->errors;
+        stats->skipped = device->skipped;
+        starts = device->starts;
+        span = device->lastStart - device->firstStart;
+        gaps = device->gaps;
+        jitterMax = device->jitterMax;
+        jitterSum = device->jitterSum;
+
+        if (reset) {
+            device->starts = 0;
+            device->samples = 0;
+            device->errors = 0;
+            device->skipped = 0;
+            device->gaps = 0;
+            device->jitterMax = 0;
+            device->jitterSum = 0;
+        }
+    }
+
+    // N starts make N - 1 gaps, in milliseconds.
+    stats->rateMilliHz = (starts > 1 && span) ?
+                         TWIschedRate(starts - 1, span) : 0;
+    stats->jitterMeanUs = gaps ? jitterSum * 1000 / gaps : 0;
+
+    stats->jitterMaxUs = jitterMax * 1000UL;
+}
@@ -0,0 +1,182 @@
+#ifndef TWISCHEDULER_H
+#define TWISCHEDULER_H
+
+#include <stdint.h>
+
+//============================================================
+// Polls any number of TWI (I2C) devices, each at its own
+// rate, from interrupts, with TWIlib's transaction queue.
+//
+// Each device has a period, a script of registers to read,
+// and a buffer for what's read. TWIschedTick(), called every
+// millisecond from a timer interrupt, starts a read of each
+// device as it falls due. Each step of the script is one
+// TWIWriteRead(), the register number then, after a repeated
+// START, its contents, and the TWI ISR queues the next step
+// as each one finishes. The main code does nothing but pick
+// up the results.
+//
+// The bus is shared out with a token bucket. Every tick adds
+// enough bit times for TWISCHED_BUS_PERCENT of the bus, and
+// a read only starts when there are enough for all of it. A
+// read that has to wait is late, and that shows up as jitter.
+// Whatever the devices ask for, the scheduler never uses more
+// than that share of the bus, leaving the rest for anything
+// else using TWIlib.
+//
+// A read is costed as START, SLA+W, the register, a repeated
+// START, SLA+R, the data and STOP, at 9 bits a byte and one
+// each for START and STOP. Interrupt latency and clock
+// stretching are not counted.
+//
+// Other code may use TWIlib at the same time, queued or not.
+// TWITransmitData() and TWIReadData() claim the bus with
+// interrupts off, so a read started by TWIschedTick() never
+// collides with one. They return TWI_TX_RX_NOT_READY while
+// the queue has the bus, and the scheduler's reads wait in
+// the queue while they have it, which shows up as jitter. Any
+// wait longer than a period is a skipped read.
+//============================================================
+
+//------------------------------------------------------------
+// The most of the bus, in percent, the scheduler will use.
+// Override in platformio.ini, e.g.
+//
+// build_flags = -DTWISCHED_BUS_PERCENT=80
+//------------------------------------------------------------
+#ifndef TWISCHED_BUS_PERCENT
+    #define TWISCHED_BUS_PERCENT 50
+#endif
+
+#if TWISCHED_BUS_PERCENT < 1 || TWISCHED_BUS_PERCENT > 100
+    #error "TWISCHED_BUS_PERCENT must be from 1 to 100."
+#endif
+
+
+//------------------------------------------------------------
+// One step of a device's script. Read "count" bytes from
+// register "reg" onwards. The steps' bytes go into the
+// device's buffer one after the other.
+//------------------------------------------------------------
+typedef struct TWIschedStep {
+    uint8_t reg;
+    uint8_t count;
+} TWIschedStep;
+
+
+struct TWIschedDevice;
+
+//------------------------------------------------------------
+// Called from the TWI ISR, with interrupts off, when a read
+// has finished. "errorCode" is TWI_SUCCESS, or the status
+// code that stopped it. Keep it short.
+//------------------------------------------------------------
+typedef void (*TWIschedCallback)(struct TWIschedDevice *device,
+                                 uint8_t errorCode);
+
+
+//------------------------------------------------------------
+// How a device is getting on, from TWIschedStats().
+//
+// The rate is from the times the reads started, over all the
+// reads since the stats were reset. The jitter is how far
+// each gap between starts was from the period, except for
+// gaps with a skipped period in them. Times are measured in
+// ticks, so to the nearest millisecond.
+//------------------------------------------------------------
+typedef struct TWIschedStatsStruct {
+    uint16_t samples;       // Reads that worked.
+    uint16_t errors;        // Reads that failed.
+    uint16_t skipped;       // Periods with no read at all.
+    uint32_t rateMilliHz;   // Reads per 1000 seconds.
+    uint32_t jitterMaxUs;   // Worst jitter.
+    uint32_t jitterMeanUs;  // Average jitter.
+} TWIschedStatsStruct;
+
+
+//------------------------------------------------------------
+// A device. Declare one for each, and hand it to
+// TWIschedAdd(), which fills it in. The rest is the
+// scheduler's, and must not be touched.
+//------------------------------------------------------------
+typedef struct TWIschedDevice {
+    uint8_t address;            // 7 bit address.
+    uint16_t periodMs;          // How often to read it.
+    const TWIschedStep *script; // What to read.
+    uint8_t steps;              // How many steps.
+    uint8_t *buffer;            // Where to put it.
+    TWIschedCallback done;      // Or 0.
+
+    // For the scheduler's own use.
+    uint8_t size;               // Bytes in one read.
+    uint16_t cost;              // Bit times for one read.
+    uint32_t due;               // Tick the next read is due.
+    uint32_t firstStart;        // Tick of the first read.
+    uint32_t lastStart;         // Tick of the latest read.
+    uint8_t step;               // Step being read.
+    uint8_t offset;             // Where it goes in buffer.
+    volatile bool busy;         // Being read now.
+    volatile bool fresh;        // Read since last fetched.
+    uint8_t result;             // How the last read went.
+    uint16_t starts;
+    uint16_t samples;
+    uint16_t errors;
+    uint16_t skipped;
+    uint16_t gaps;              // Gaps counted as jitter.
+    uint16_t jitterMax;
+    uint32_t jitterSum;
+    struct TWIschedDevice *next;
+} TWIschedDevice;
+
+
+//------------------------------------------------------------
+// Get ready, after TWIInit(), which sets the SCL frequency
+// the bus share is worked out from. Forgets any devices.
+//------------------------------------------------------------
+void TWIschedInit();
+
+
+//------------------------------------------------------------
+// Add a device, to be read every "periodMs" milliseconds,
+// the first time on the next tick. "buffer" must have room
+// for every step's bytes, and "script", "buffer" and
+// "device" must all stay in scope. Returns false, and the
+// device isn't added, if reading it that often would need
+// more than the bus share, even with no other devices, or if
+// the steps read more than 255 bytes in all.
+//------------------------------------------------------------
+bool TWIschedAdd(TWIschedDevice *device,
+                 uint8_t address,
+                 uint16_t periodMs,
+                 const TWIschedStep *script,
+                 uint8_t steps,
+                 uint8_t *buffer,
+                 TWIschedCallback done = 0);
+
+
+//------------------------------------------------------------
+// Call every millisecond, from a timer interrupt. Starts the
+// reads that are due, if the bus share allows.
+//------------------------------------------------------------
+void TWIschedTick();
+
+
+//------------------------------------------------------------
+// Copy the device's latest reading into "data", as long as
+// there's been a new one since the last call, and it's not
+// being read again right now. Returns that reading's
+// TWI_SUCCESS or error code, or TWI_NO_RELEVANT_INFO if
+// there was nothing new, with "data" untouched.
+//------------------------------------------------------------
+uint8_t TWIschedFetch(TWIschedDevice *device, uint8_t *data);
+
+
+//------------------------------------------------------------
+// Take a copy of the device's statistics, and start them
+// again if "reset" is true.
+//------------------------------------------------------------
+void TWIschedStats(TWIschedDevice *device,
+                   TWIschedStatsStruct *stats,
+                   bool reset = false);
+
+#endif // TWISCHEDULER_H
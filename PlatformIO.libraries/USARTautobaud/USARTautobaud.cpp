@@ -0,0 +1,188 @@
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "USARTautobaud.h"
+#include "USARTinterrupt.h"
+
+//============================================================
+// The sync character 'U' has a change at every bit, so ten
+// edges, from the start bit to the stop bit. Any other ends
+// when the line has been idle for a whole character.
+//============================================================
+#define AUTOBAUD_EDGES 10
+
+static uint16_t bitCycles = 0;
+
+
+//------------------------------------------------------------
+// Standard rates come in families, each double the last:
+// 300 to 76800, 14400 to 230400, and 250000 to 1000000. The
+// windows around 230400 and 250000 overlap, so keep looking
+// for a nearer one after the first that fits.
+//------------------------------------------------------------
+uint32_t autobaudSnap(uint32_t measured) {
+    static const uint32_t families[3][2] = {
+        {300, 76800},
+        {14400, 230400},
+        {250000, 1000000}
+    };
+
+    uint32_t nearest = measured;
+    uint32_t nearestDiff = 0xFFFFFFFFUL;
+
+    for (uint8_t x = 0; x < 3; x++) {
+        for (uint32_t rate = families[x][0];
+             rate <= families[x][1];
+             rate *= 2) {
+            uint32_t diff = (measured > rate) ? measured - rate
+                                              : rate - measured;
+
+            // All are multiples of 100, so this doesn't round.
+            if (diff <= rate / 100 * AUTOBAUD_SNAP_ERROR / 100 &&
+                diff < nearestDiff) {
+                nearest = rate;
+                nearestDiff = diff;
+            }
+        }
+    }
+
+    return nearest;
+}
+
+
+//------------------------------------------------------------
+// Time the edges on ICP1, by polling the ICU, so no ISRs are
+// needed, and any the program has for Timer/counter 1 are
+// left alone. Each edge is caught by the hardware, to the
+// cycle, we only have to read ICR1 before the next one.
+//------------------------------------------------------------
+uint32_t USARTautobaud(uint16_t timeoutMs) {
+    // Borrow Timer/counter 1, stopped first, so that TCNT1
+    // and the flags stay as they are while we look.
+    uint8_t oldTCCR1A, oldTCCR1B, oldTIMSK1, oldTIFR1;
+    uint16_t oldTCNT1, oldICR1;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        oldTCCR1B = TCCR1B;
+        TCCR1B = 0;
+        oldTCCR1A = TCCR1A;
+        oldTIMSK1 = TIMSK1;
+        oldTIFR1 = TIFR1;
+        oldTCNT1 = TCNT1;
+        oldICR1 = ICR1;
+
+        TIMSK1 = 0;
+        TCCR1A = 0;
+    }
+
+    // Normal mode, noise canceller on, no prescaler, and the
+    // falling edge of the start bit first. (ICES1 = 0).
+    TCCR1B = (1 << ICNC1) | (1 << CS10);
+    TIFR1 = (1 << ICF1);
+
+    // ICP1 is input, and idles high, as the RX line does.
+    DDRB &= ~(1 << DDB0);
+    PORTB |= (1 << PORTB0);
+
+    uint32_t timeout = (uint32_t)timeoutMs * (F_CPU / 1000);
+    uint32_t elapsed = 0;       // Cycles since we started.
+    uint32_t sinceEdge = 0;     // Cycles since the last edge.
+    uint16_t then = TCNT1;
+    uint16_t lastEdge = 0;
+    uint16_t shortest = 0xFFFF;
+    uint32_t firstAt = 0;       // "elapsed" at the first edge,
+    uint32_t lastAt = 0;        // and the last.
+    uint8_t edges = 0;
+
+    while (edges < AUTOBAUD_EDGES) {
+        // Check for an edge before reading TCNT1, so that any
+        // edge found is before "now".
+        bool captured = TIFR1 & (1 << ICF1);
+
+        // Count time in 32 bits, the timer wraps every 4 ms.
+        uint16_t now = TCNT1;
+        uint16_t delta = now - then;
+        then = now;
+        elapsed += delta;
+        sinceEdge += delta;
+
+        if (captured) {
+            uint16_t edge = ICR1;
+
+            // Catch the opposite edge next. ICF1 must be
+            // cleared after changing ICES1.
+            TCCR1B ^= (1 << ICES1);
+            TIFR1 = (1 << ICF1);
+
+            if (edges) {
+                uint16_t gap = edge - lastEdge;
+                if (gap < shortest)
+                    shortest = gap;
+            }
+
+            lastEdge = edge;
+            sinceEdge = (uint16_t)(now - edge);
+            lastAt = elapsed - sinceEdge;
+            if (!edges)
+                firstAt = lastAt;
+            edges++;
+            continue;
+        }
+
+        if (edges >= 2) {
+            // A whole character of idle line. It's over.
+            if (sinceEdge > 10UL * shortest)
+                break;
+        } else if (edges == 1 && sinceEdge > 0xFFFF) {
+            // A glitch, or a bit too long to time. Start again.
+            TCCR1B &= ~(1 << ICES1);
+            TIFR1 = (1 << ICF1);
+            edges = 0;
+        }
+
+        if (timeout && edges < 2 && elapsed >= timeout)
+            break;
+    }
+
+    // Give Timer/counter 1 back. ICR1 can only be written in
+    // a mode with it as TOP, so CTC, mode 12, with the clock
+    // still stopped. Then clear the flags that weren't already
+    // set when we started. ICF1, which we had to clear, can't
+    // be set again.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TCCR1B = 0;
+        TCCR1A = 0;
+        TCCR1B = (1 << WGM13) | (1 << WGM12);
+        ICR1 = oldICR1;
+        TCNT1 = oldTCNT1;
+        TIFR1 = (1 << ICF1) |
+                (~oldTIFR1 & ((1 << OCF1B) | (1 << OCF1A) | (1 << TOV1)));
+        TCCR1A = oldTCCR1A;
+        TIMSK1 = oldTIMSK1;
+        TCCR1B = oldTCCR1B;
+    }
+
+    if (edges < 2) {
+        bitCycles = 0;
+        return 0;
+    }
+
+    // The shortest gap is one bit, and tells us how many bits
+    // there were from the first edge to the last. Timing all
+    // of them averages out any difference between rising and
+    // falling edges.
+    uint32_t span = lastAt - firstAt;
+    uint32_t bits = (span + shortest / 2) / shortest;
+    bitCycles = (span + bits / 2) / bits;
+
+    uint32_t baudRate = autobaudSnap((F_CPU * bits + span / 2) / span);
+    USARTinit(baudRate);
+    return baudRate;
+}
+
+
+//------------------------------------------------------------
+// The length of a bit, in clock cycles.
+//------------------------------------------------------------
+uint16_t USARTautobaudCycles() {
+    return bitCycles;
+}
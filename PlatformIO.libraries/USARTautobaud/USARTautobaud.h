@@ -0,0 +1,66 @@
+#ifndef USARTAUTOBAUD_H
+#define USARTAUTOBAUD_H
+
+#include <stdint.h>
+
+//============================================================
+// Automatic baud rate detection, for USART0.
+//
+// The other end sends a sync character, and the shortest time
+// between two edges on the RX line is one bit. 'U' (0x55) is
+// best, as every bit is a change, but anything with a single
+// 0 or 1 bit in it will do.
+//
+// The timing is done by the Timer/counter 1 input capture
+// unit, as in enableTimer1ICU() in 07_TimerCounter, but with
+// no prescaler, and catching both edges. The ICU only listens
+// to ICP1, so the RX pin, PD0 (D0), must also be wired to
+// ICP1, PB0 (D8).
+//
+// At 16 MHz, a bit at 115200 baud is 139 clock cycles, and
+// the ICU times it to the cycle. Rates below about 250 baud
+// have bits too long for the 16 bit timer.
+//============================================================
+
+//------------------------------------------------------------
+// How far, in hundredths of a percent, the measured rate may
+// be from a standard one, and still be taken as that one.
+// Otherwise, the measured rate is used as it is.
+//------------------------------------------------------------
+#ifndef AUTOBAUD_SNAP_ERROR
+    #define AUTOBAUD_SNAP_ERROR 500
+#endif
+
+
+//------------------------------------------------------------
+// Wait up to "timeoutMs" milliseconds, or forever if zero, for
+// a sync character, then USARTinit() at the baud rate it was
+// sent at. Call this instead of USARTinit(). Returns the baud
+// rate, or 0, with the USART untouched, if nothing arrived in
+// time. The sync character itself is not received.
+//
+// Timer/counter 1 is only borrowed. Its registers, TCNT1 and
+// ICR1 included, are put back as they were, as if it had been
+// stopped meanwhile, and so are its TOV1, OCF1A and OCF1B
+// flags, set or not. ICF1 is left clear, even if it was set,
+// as it has to be cleared to catch the first edge, and can't
+// be set again. PB0 is left as an input, with its pull-up on.
+//------------------------------------------------------------
+uint32_t USARTautobaud(uint16_t timeoutMs = 0);
+
+
+//------------------------------------------------------------
+// The length of a bit, in clock cycles, averaged over the
+// sync character, by the last call to USARTautobaud(). Zero
+// if nothing was seen.
+//------------------------------------------------------------
+uint16_t USARTautobaudCycles();
+
+
+//------------------------------------------------------------
+// The standard baud rate nearest to "measured", if it's within
+// AUTOBAUD_SNAP_ERROR, otherwise "measured" itself.
+//------------------------------------------------------------
+uint32_t autobaudSnap(uint32_t measured);
+
+#endif // USARTAUTOBAUD_H
@@ -2,47 +2,77 @@
 #define USARTBUFFER_H
 
 #include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
 
 //============================================================
 // We need a buffer for transmitting data. This implementation
-// uses a circular buffer. The buffers used here are designed
-// to be 255 or fewer characters and so, indexes etc will fit
-// a uint8_t.
+// uses a circular buffer, a RingBuffer<Size>, where Size is
+// set at compile time, separately for each buffer.
 //============================================================
 // BufferFull = ((head + 1) == tail)
 // BufferEmpty = (tail == head)
-// IncrementIndex = (index + 1) % BUFFER_SIZE
-// DecrementIndex = (index - BUFFER_SIZE -1) % BUFFER_SIZE
-// Available = (BUFFER_SIZE + (head - tail)) % BUFFER_SIZE
-// FreeToWrite = BUFFER_SIZE - available_to_get.
+// IncrementIndex = (index + 1) & (Size - 1)
+// Available = (head - tail) & (Size - 1)
+// FreeToWrite = Size - 1 - available_to_get.
 //
-// Head = where last byte was added to buffer. Will be 
+// Head = where last byte was added to buffer. Will be
 //        incremented before next add.
 //
 // Tail = where last byte was read from buffer. Will be
 //        incremented before next get.
 //============================================================
-// Using two pointers in this way means that the maximum 
-// number of characters in the buffer is the BUFFER_SIZE - 1
+// Using two pointers in this way means that the maximum
+// number of characters in the buffer is the Size - 1
 // as head and tail cannot be equal when adding a byte. They
 // can be equal when getting a byte - the final one in the
 // buffer.
 //============================================================
+// FULL CAPACITY MODE - RingBuffer<Size, IndexT, true>
+//
+// Head and tail are free running counts of the bytes added
+// and removed, which roll over at the top of IndexT. The
+// unsigned subtraction (head - tail) is still correct after
+// they do, so:
+//
+// BufferFull = ((head - tail) == Size)
+// BufferEmpty = (tail == head)
+// Available = (head - tail)
+// FreeToWrite = Size - available_to_get.
+//
+// Head = where the next byte will be added, & (Size - 1).
+// Tail = where the next byte will be read from, & (Size - 1).
+//
+// A buffer of size 'n' holds 'n' bytes, but (head - tail)
+// has to reach Size, so a uint8_t index limits Size to 128.
+//============================================================
 
 
 //------------------------------------------------------------
-// Buffer size must be a power of 2 and less than 256. If you
-// need more than 256 then update the uint8_t data types to 
-// uint16_t or results will be "undefined"! You will also have
-// to make sure that any amendments to head or tail indexes 
-// are protected by an atomic block - the AVR doesn't have a
-// single instruction to load a 16 bit variable. 8 bits are
-// ok as a load cannot be interrupted.
+// Buffer sizes. Each must be a power of 2, from 2 to 32768.
+// Override them in platformio.ini, for example:
+//
+// build_flags = -DUSART_RX_BUFFER_SIZE=256
 //
-// NOTE: Because of the use of two pointers, head and tail, 
-// a buffer of size 'n' can only hold 'n'-1 items.
+// NOTE: Because of the use of two pointers, head and tail,
+// a buffer of size 'n' can only hold 'n'-1 items. Unless
+// USART_BUFFER_FULL_CAPACITY is defined as 1, when both
+// buffers use full capacity mode.
 //------------------------------------------------------------
-#define BUFFER_SIZE 64
+#ifndef USART_BUFFER_FULL_CAPACITY
+    #define USART_BUFFER_FULL_CAPACITY 0
+#endif
+
+#ifndef USART_RX_BUFFER_SIZE
+    #define USART_RX_BUFFER_SIZE 64
+#endif
+
+#ifndef USART_TX_BUFFER_SIZE
+    #define USART_TX_BUFFER_SIZE 64
+#endif
 
 //------------------------------------------------------------
 // Buffer full/empty error returns.
@@ -51,10 +81,80 @@
 #define ERR_BUFFER_FULL -1
 #define ERR_BUFFER_EMPTY -2
 
+
+//------------------------------------------------------------
+// What cBufferAdd() does when the buffer is full. Each buffer
+// has its own, see cBufferSetPolicy().
+//
+// BUFFER_BLOCK        - Wait for the ISR to make space. If
+//                       interrupts are off, as they are in an
+//                       ISR, it never would, so the new byte
+//                       is dropped instead.
+// BUFFER_DROP_NEWEST  - Drop the new byte.
+// BUFFER_DROP_OLDEST  - Drop the oldest byte in the buffer to
+//                       make space for the new one. Only for
+//                       buffers which the main code writes,
+//                       like the txBuffer.
+// BUFFER_RETURN_ERROR - Leave the buffer alone. The caller
+//                       gets ERR_BUFFER_FULL, and decides.
+//
+// As far as the buffer is concerned, DROP_NEWEST and
+// RETURN_ERROR are the same, the difference is in what the
+// caller does next. USARTtryPrintf(), for example, carries on
+// after a dropped byte, but stops at the first error.
+//------------------------------------------------------------
+#define BUFFER_BLOCK 0
+#define BUFFER_DROP_NEWEST 1
+#define BUFFER_DROP_OLDEST 2
+#define BUFFER_RETURN_ERROR 3
+
+#ifndef USART_RX_OVERFLOW_POLICY
+    #define USART_RX_OVERFLOW_POLICY BUFFER_DROP_NEWEST
+#endif
+
+#ifndef USART_TX_OVERFLOW_POLICY
+    #define USART_TX_OVERFLOW_POLICY BUFFER_BLOCK
+#endif
+
+
+//------------------------------------------------------------
+// Waiting for an ISR, for space in a full buffer, or for the
+// txBuffer to empty, is a busy loop. Define USART_IDLE_SLEEP
+// as 1 to have the CPU sleep in idle mode between interrupts
+// instead, and save some current:
+//
+// build_flags = -DUSART_IDLE_SLEEP=1
+//
+// Any interrupt wakes it, not just the USART's, which is why
+// the condition is tested again every time.
+//------------------------------------------------------------
+#ifndef USART_IDLE_SLEEP
+    #define USART_IDLE_SLEEP 0
+#endif
+
+
+//------------------------------------------------------------
+// Buffers up to 256 bytes use uint8_t head and tail indexes,
+// larger ones need uint16_t. In full capacity mode, uint8_t
+// indexes only go up to 128 bytes.
+//------------------------------------------------------------
+template <bool Small>
+struct RingBufferIndexType {
+    typedef uint16_t type;
+};
+
+template <>
+struct RingBufferIndexType<true> {
+    typedef uint8_t type;
+};
+
+template <uint16_t Size, bool FullCapacity = false>
+struct RingBufferIndex
+    : RingBufferIndexType<(Size <= (FullCapacity ? 128 : 256))> {};
+
+
 //------------------------------------------------------------
 // The actual buffer. Contains its own head and tail indexes.
-// All buffers will be defined with  the same size, for ease
-// of use and simplicity. (Mine!)
 //
 // headIndex is the byte position where the most recent byte
 // was added. This is incremented just before adding the next
@@ -63,50 +163,491 @@
 // tailIndex is the byte position where the most recent byte
 // was removed. This is incremented just before getting the
 // next byte from the buffer.
+//
+// In full capacity mode, they are the counts of bytes added
+// and removed, as above.
+//
+// The index wraps with "& (Size - 1)" rather than "% Size",
+// which is why Size must be a power of 2.
 //------------------------------------------------------------
-typedef struct circularBuffer {
-    uint8_t headIndex;
-    uint8_t tailIndex;
+template <uint16_t Size,
+          typename IndexT = typename RingBufferIndex<Size>::type,
+          bool FullCapacity = false>
+struct RingBuffer {
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0,
+                  "RingBuffer Size must be a power of 2.");
+    static_assert((FullCapacity ? Size : Size - 1) <= IndexT(~IndexT(0)),
+                  "RingBuffer IndexT is too small for Size.");
+
+    typedef IndexT indexType;
+
+    IndexT  headIndex;
+    IndexT  tailIndex;
     int8_t  lastError;
-    uint8_t cBuffer[BUFFER_SIZE];
-} circularBuffer;
+    uint8_t overflowPolicy;
+    uint8_t cBuffer[Size];
+};
 
 
 //------------------------------------------------------------
-// Initialise a new buffer.
+// The USART's buffers, defined in USARTbuffer.cpp.
 //------------------------------------------------------------
-void cBufferInit(volatile circularBuffer *buf);
+typedef RingBuffer<USART_RX_BUFFER_SIZE,
+                   RingBufferIndex<USART_RX_BUFFER_SIZE,
+                                   USART_BUFFER_FULL_CAPACITY>::type,
+                   USART_BUFFER_FULL_CAPACITY> rxRingBuffer;
+
+typedef RingBuffer<USART_TX_BUFFER_SIZE,
+                   RingBufferIndex<USART_TX_BUFFER_SIZE,
+                                   USART_BUFFER_FULL_CAPACITY>::type,
+                   USART_BUFFER_FULL_CAPACITY> txRingBuffer;
+
+extern volatile rxRingBuffer rxBuffer;
+extern volatile txRingBuffer txBuffer;
+
+
+//------------------------------------------------------------
+// Reading or writing a uint8_t index is a single instruction
+// and cannot be interrupted. A uint16_t index takes two, so
+// an interrupt could change it between them. Those accesses
+// are done with interrupts off. (In an ISR they already are,
+// and ATOMIC_RESTORESTATE leaves them that way.)
+//------------------------------------------------------------
+inline uint8_t cBufferIndex(const volatile uint8_t &index) {
+    return index;
+}
+
+inline uint16_t cBufferIndex(const volatile uint16_t &index) {
+    uint16_t result;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        result = index;
+    }
+    return result;
+}
+
+inline void cBufferSetIndex(volatile uint8_t &index, uint8_t value) {
+    index = value;
+}
+
+inline void cBufferSetIndex(volatile uint16_t &index, uint16_t value) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        index = value;
+    }
+}
+
+
+//------------------------------------------------------------
+// Initialise a new buffer. Sets the two pointers to the start
+// of the buffer and as they are equal, this means empty.
+// Clears the error flag - only used by the rxBuffer.
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline void cBufferInit(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        buf->headIndex = buf->tailIndex = 0;
+        buf->lastError = 0;
+    }
+}
+
+
+//------------------------------------------------------------
+// Choose what happens when a byte is added to a full buffer.
+// One of the BUFFER_xxx policies above. Static buffers start
+// out as BUFFER_BLOCK, and cBufferInit() doesn't change it.
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline void cBufferSetPolicy(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf,
+    uint8_t policy) {
+    buf->overflowPolicy = policy;
+}
 
 
 //------------------------------------------------------------
 // Anything in a buffer to get? Unsigned return, buffers are
-// always a positive length! Allows code to check if rxBuffer
-// has data. Cf Serial.available() on Arduino.
+// always a positive length!
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline IndexT cBufferAvailable(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf) {
+    IndexT used = cBufferIndex(buf->headIndex) -
+                  cBufferIndex(buf->tailIndex);
+
+    return FullCapacity ? used : IndexT(used & (Size - 1));
+}
+
+
+//------------------------------------------------------------
+// How many more bytes can be added before the buffer is full?
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline uint16_t cBufferFree(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf) {
+    return (FullCapacity ? Size : Size - 1) - cBufferAvailable(buf);
+}
+
+
+//------------------------------------------------------------
+// Copy up to "count" bytes from "src" into a buffer. Returns
+// the number actually copied, which is less than "count" if
+// the buffer fills up. Unlike cBufferAdd(), this never waits.
+//
+// The free space is, at most, two runs of bytes: from the
+// head to the end of cBuffer, then from the start of cBuffer.
+// So it's two memcpy() calls, and one update of the head
+// index, however many bytes are copied.
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline uint16_t cBufferWrite(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf,
+    const uint8_t *src,
+    uint16_t count) {
+
+    // Only we change headIndex.
+    IndexT head = buf->headIndex;
+    IndexT used = head - cBufferIndex(buf->tailIndex);
+    uint16_t space = FullCapacity ? Size - used
+                                  : Size - 1 - (used & (Size - 1));
+
+    if (count > space)
+        count = space;
+
+    if (!count)
+        return 0;
+
+    // Where the first new byte goes, and how many fit before
+    // the end of cBuffer.
+    uint16_t start = (FullCapacity ? head : head + 1) & (Size - 1);
+    uint16_t first = Size - start;
+    if (first > count)
+        first = count;
+
+    // Nobody else touches the free space, so it's safe to
+    // lose the volatile here.
+    uint8_t *data = (uint8_t *)buf->cBuffer;
+    memcpy(data + start, src, first);
+    memcpy(data, src + first, count - first);
+
+    // The bytes must be in cBuffer before the ISR can see
+    // the new headIndex.
+    __asm__ __volatile__ ("" ::: "memory");
+
+    head += count;
+    cBufferSetIndex(buf->headIndex,
+                    FullCapacity ? head : IndexT(head & (Size - 1)));
+    return count;
+}
+
+
+//------------------------------------------------------------
+// Copy up to "count" bytes from a buffer to "dst". Returns
+// the number actually copied, which is less than "count" if
+// the buffer runs out. As above, in two memcpy() calls.
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline uint16_t cBufferRead(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf,
+    uint8_t *dst,
+    uint16_t count) {
+
+    // Only we change tailIndex.
+    IndexT tail = buf->tailIndex;
+    uint16_t available = cBufferAvailable(buf);
+
+    if (count > available)
+        count = available;
+
+    if (!count)
+        return 0;
+
+    uint16_t start = (FullCapacity ? tail : tail + 1) & (Size - 1);
+    uint16_t first = Size - start;
+    if (first > count)
+        first = count;
+
+    const uint8_t *data = (const uint8_t *)buf->cBuffer;
+    memcpy(dst, data + start, first);
+    memcpy(dst + first, data, count - first);
+
+    // Don't hand the space back to the ISR until the bytes
+    // have been copied out of it.
+    __asm__ __volatile__ ("" ::: "memory");
+
+    tail += count;
+    cBufferSetIndex(buf->tailIndex,
+                    FullCapacity ? tail : IndexT(tail & (Size - 1)));
+    buf->lastError = ERR_BUFFER_OK;
+    return count;
+}
+
+
+//------------------------------------------------------------
+// Zero copy reading. Sets "*ptr" to the oldest unread byte in
+// cBuffer itself, and returns how many unread bytes follow it
+// before the end of cBuffer. Returns zero if the buffer is
+// empty. Nothing is removed from the buffer.
+//
+// Unread data which has wrapped round to the start of cBuffer
+// is not included. Consume this run, then peek again to get
+// the rest.
+//
+// The ISR only ever adds bytes after these, so they stay put,
+// and unchanged, until cBufferConsume() releases them.
 //------------------------------------------------------------
-uint8_t cBufferAvailable();
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline uint16_t cBufferPeekContiguous(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf,
+    const uint8_t **ptr) {
+
+    // Only we change tailIndex.
+    IndexT tail = buf->tailIndex;
+    uint16_t available = cBufferAvailable(buf);
+    uint16_t start = (FullCapacity ? tail : tail + 1) & (Size - 1);
+
+    *ptr = (const uint8_t *)buf->cBuffer + start;
+
+    if (available > Size - start)
+        return Size - start;
+
+    return available;
+}
 
 
 //------------------------------------------------------------
-// Add a byte to a buffer.
+// Release the oldest "count" bytes, once the code has finished
+// with them, via cBufferPeekContiguous(), and make the space
+// available to the ISR again. Returns the number actually
+// released, which is less than "count" if the buffer runs out.
 //------------------------------------------------------------
-void cBufferAdd(volatile circularBuffer *buf, uint8_t aByte);
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline uint16_t cBufferConsume(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf,
+    uint16_t count) {
+
+    IndexT tail = buf->tailIndex;
+    uint16_t available = cBufferAvailable(buf);
+
+    if (count > available)
+        count = available;
+
+    if (!count)
+        return 0;
+
+    // Everything done to the bytes via the peeked pointer
+    // must finish before the ISR can overwrite them.
+    __asm__ __volatile__ ("" ::: "memory");
+
+    tail += count;
+    cBufferSetIndex(buf->tailIndex,
+                    FullCapacity ? tail : IndexT(tail & (Size - 1)));
+    buf->lastError = ERR_BUFFER_OK;
+    return count;
+}
 
 
 //------------------------------------------------------------
-// Get a byte from a buffer.
+// Anything in rxBuffer to get? Allows code to check if
+// rxBuffer has data. Cf Serial.available() on Arduino.
 //------------------------------------------------------------
-int cBufferGet(volatile circularBuffer *buf);
+rxRingBuffer::indexType cBufferAvailable();
 
 
+//============================================================
+// The following are called from the USART ISRs, so they are
+// defined here, inline, rather than in USARTbuffer.cpp.
+//
+// An ISR that calls a function in another file has no idea
+// which registers that function will use, so the compiler
+// has to save and restore every call-used register, r18-r27,
+// r30 and r31, on entry and exit. That's 12 PUSH and 12 POP
+// instructions, 48 cycles, plus 8 more for the CALL and RET,
+// on every interrupt. Inline, the ISR only saves the few
+// registers it actually uses.
+//
+// You can see the difference in the listing produced by:
+//
+//    avr-objdump -d .pio/build/uno/firmware.elf
+//
+// Look for "<__vector_18>:" (USART_RX_vect) and
+// "<__vector_19>:" (USART_UDRE_vect). tools/isrCycles.py, at
+// the top of the repository, counts the cycles for you, and
+// checks them against tools/isrBudget.txt.
+//============================================================
+
 //------------------------------------------------------------
-// Is this buffer full? If head == Tail
+// Is this buffer full? If head + 1 == Tail, or in full
+// capacity mode, head - tail == Size.
 //------------------------------------------------------------
-bool cBufferFull(volatile circularBuffer *buf);
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline bool cBufferFull(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf) {
+    IndexT head = cBufferIndex(buf->headIndex);
+    IndexT tail = cBufferIndex(buf->tailIndex);
+
+    if (FullCapacity)
+        return IndexT(head - tail) == Size;
+
+    return ((head + 1) & (Size - 1)) == tail;
+}
 
 
 //------------------------------------------------------------
 // Is this buffer empty? Head == Tail
 //------------------------------------------------------------
-bool cBufferEmpty(volatile circularBuffer *buf);
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline bool cBufferEmpty(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf) {
+    return cBufferIndex(buf->headIndex) == cBufferIndex(buf->tailIndex);
+}
+
+
+//------------------------------------------------------------
+// Take back the most recently added byte, if there is one.
+// Only for the code that adds the bytes, as it moves headIndex
+// backwards. Returns ERR_BUFFER_EMPTY if there was nothing to
+// take back.
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline int8_t cBufferDropLast(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf) {
+    if (cBufferEmpty(buf))
+        return ERR_BUFFER_EMPTY;
+
+    IndexT head = cBufferIndex(buf->headIndex) - 1;
+    cBufferSetIndex(buf->headIndex,
+                    FullCapacity ? head : IndexT(head & (Size - 1)));
+    return ERR_BUFFER_OK;
+}
+
+
+//------------------------------------------------------------
+// Wait, with interrupts on, until "condition()" is false. Only
+// an ISR can make it so. With USART_IDLE_SLEEP, the condition
+// is checked with interrupts off, and the CPU only sleeps if
+// it's still true. The instruction after sei() always runs,
+// so an ISR can't sneak in between the check and the sleep,
+// and leave us asleep with nothing left to wake us.
+//------------------------------------------------------------
+template <typename Condition>
+inline void cBufferWaitWhile(Condition condition) {
+#if USART_IDLE_SLEEP
+    uint8_t oldSREG = SREG;
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (1) {
+        cli();
+        if (!condition())
+            break;
+
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+
+    SREG = oldSREG;
+#else
+    while (condition())  ; // Wait...
+#endif
+}
+
+
+//------------------------------------------------------------
+// Add a byte to a buffer. If it is full, "policy" decides
+// what happens. Returns ERR_BUFFER_OK if the byte was added,
+// ERR_BUFFER_FULL if not.
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline int8_t cBufferAdd(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf,
+    uint8_t aByte,
+    uint8_t policy) {
+
+    // Temporary new headIndex calculated. Only we change it.
+    IndexT head = buf->headIndex;
+    IndexT nextPut;
+    if (FullCapacity) {
+        nextPut = head + 1;
+    } else {
+        nextPut = (head + 1) & (Size - 1);
+        head = nextPut;
+    }
+
+    if (cBufferFull(buf)) {
+        switch (policy) {
+            case BUFFER_BLOCK:
+                // Wait for space in buffer, if the ISR can
+                // make some. Otherwise we would wait forever.
+                if (!(SREG & (1 << SREG_I)))
+                    return ERR_BUFFER_FULL;
+
+                cBufferWaitWhile([buf] { return cBufferFull(buf); });
+                break;
+
+            case BUFFER_DROP_OLDEST:
+                // Throw away the byte the ISR would have got
+                // next. The ISR mustn't take it meanwhile.
+                ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                    if (cBufferFull(buf)) {
+                        IndexT tail = buf->tailIndex + 1;
+                        buf->tailIndex = FullCapacity ?
+                            tail : IndexT(tail & (Size - 1));
+                    }
+                }
+                break;
+
+            default:
+                return ERR_BUFFER_FULL;
+        }
+    }
+
+    // Free space, write the byte.
+    buf->cBuffer[head & (Size - 1)] = aByte;
+    cBufferSetIndex(buf->headIndex, nextPut);
+    return ERR_BUFFER_OK;
+}
+
+
+//------------------------------------------------------------
+// Add a byte to a buffer, using the buffer's own policy.
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline int8_t cBufferAdd(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf,
+    uint8_t aByte) {
+    return cBufferAdd(buf, aByte, buf->overflowPolicy);
+}
+
+
+//------------------------------------------------------------
+// Get a byte from a buffer. Returns -1 is buffer is empty.
+//------------------------------------------------------------
+template <uint16_t Size, typename IndexT, bool FullCapacity>
+inline int cBufferGet(
+    volatile RingBuffer<Size, IndexT, FullCapacity> *buf) {
+    IndexT tail;
+    IndexT nextGet;
+    uint8_t aByte;
+
+    // Test if buffer is empty? If not, fetch a byte.
+    if (!cBufferEmpty(buf)) {
+        tail = buf->tailIndex;
+        if (FullCapacity) {
+            nextGet = tail + 1;
+        } else {
+            nextGet = (tail + 1) & (Size - 1);
+            tail = nextGet;
+        }
+
+        aByte = buf->cBuffer[tail & (Size - 1)];
+        cBufferSetIndex(buf->tailIndex, nextGet);
+        buf->lastError = ERR_BUFFER_OK;
+        return aByte;
+    }
+
+    // Buffer is empty, return error code.
+    return -1;
+}
 
 #endif // USARTBUFFER_H
@@ -0,0 +1,237 @@
+#include <util/crc16.h>
+#include "USARTframe.h"
+#include "USARTinterrupt.h"
+#include "USARTbuffer.h"
+
+//============================================================
+// COBS encoding. The position of the current run's code byte
+// is remembered, and it's filled in when the run ends, at a
+// zero, at 254 bytes, or at the end of the frame.
+//============================================================
+typedef struct {
+    uint8_t *frame;
+    uint16_t codeAt;    // Where this run's code byte goes.
+    uint16_t next;      // Where the next byte goes.
+    uint8_t code;       // Run length so far, plus 1.
+} cobsEncoder;
+
+
+//------------------------------------------------------------
+// Add one byte to the frame being encoded.
+//------------------------------------------------------------
+static inline void cobsPut(cobsEncoder *enc, uint8_t aByte) {
+    if (aByte) {
+        enc->frame[enc->next++] = aByte;
+        enc->code++;
+
+        // A full run, with no zero after it.
+        if (enc->code != 0xFF)
+            return;
+    }
+
+    // End this run, start the next.
+    enc->frame[enc->codeAt] = enc->code;
+    enc->codeAt = enc->next++;
+    enc->code = 1;
+}
+
+
+//------------------------------------------------------------
+// Encode a frame. The CRC is worked out in the same pass as
+// the encoding, so each payload byte is only read once.
+//------------------------------------------------------------
+uint16_t frameEncode(const uint8_t *payload, uint8_t length,
+                     uint8_t *frame) {
+    cobsEncoder enc = {frame, 0, 1, 1};
+    uint16_t crc = 0xFFFF;
+
+    for (uint8_t x = 0; x < length; x++) {
+        crc = _crc_ccitt_update(crc, payload[x]);
+        cobsPut(&enc, payload[x]);
+    }
+
+    // CRC, low byte first.
+    cobsPut(&enc, crc & 0xFF);
+    cobsPut(&enc, crc >> 8);
+
+    // Finish the last run, and end the frame.
+    frame[enc.codeAt] = enc.code;
+    frame[enc.next++] = 0;
+
+    return enc.next;
+}
+
+
+//============================================================
+// COBS decoding.
+//============================================================
+
+//------------------------------------------------------------
+// Start, or restart, decoding.
+//------------------------------------------------------------
+void frameDecoderInit(frameDecoder *decoder) {
+    decoder->length = 0;
+    decoder->crc = 0xFFFF;
+    decoder->remaining = 0;
+    decoder->zeroPending = false;
+    decoder->tooLong = false;
+    decoder->finished = false;
+}
+
+
+//------------------------------------------------------------
+// Add a decoded byte to data[], if there's room.
+//------------------------------------------------------------
+static inline void frameStore(frameDecoder *decoder, uint8_t aByte) {
+    if (decoder->length >= sizeof(decoder->data)) {
+        decoder->tooLong = true;
+        return;
+    }
+
+    decoder->data[decoder->length++] = aByte;
+    decoder->crc = _crc_ccitt_update(decoder->crc, aByte);
+}
+
+
+//------------------------------------------------------------
+// Decode one received byte.
+//------------------------------------------------------------
+uint8_t frameDecodeByte(frameDecoder *decoder, uint8_t aByte) {
+    // The last frame has been dealt with by now.
+    if (decoder->finished) {
+        decoder->length = 0;
+        decoder->finished = false;
+    }
+
+    if (!aByte) {
+        // End of frame. Idle zeros between frames are fine.
+        uint8_t result;
+
+        if (!decoder->length && !decoder->remaining &&
+            !decoder->zeroPending && !decoder->tooLong)
+            return FRAME_NONE;
+
+        if (decoder->tooLong)
+            result = FRAME_TOO_LONG;
+        else if (decoder->remaining || decoder->length < 2)
+            result = FRAME_BAD_COBS;
+        else if (decoder->crc)
+            result = FRAME_BAD_CRC;
+        else
+            result = FRAME_OK;
+
+        // The payload stays in data[], minus the CRC, until
+        // the next byte arrives.
+        uint16_t length = decoder->length;
+        frameDecoderInit(decoder);
+        if (result == FRAME_OK) {
+            decoder->length = length - 2;
+            decoder->finished = true;
+        }
+
+        return result;
+    }
+
+    if (decoder->remaining) {
+        // Part of a run.
+        frameStore(decoder, aByte);
+        decoder->remaining--;
+        return FRAME_NONE;
+    }
+
+    // A code byte, starting a new run. The previous run, if
+    // there was one, ended with a zero, unless it was full.
+    if (decoder->zeroPending)
+        frameStore(decoder, 0);
+
+    decoder->remaining = aByte - 1;
+    decoder->zeroPending = (aByte != 0xFF);
+    return FRAME_NONE;
+}
+
+
+//============================================================
+// Frames over USART0.
+//============================================================
+static frameDecoder usartDecoder;
+static frameCallback usartCallback = 0;
+static frameStatsStruct usartFrameStats;
+
+
+//------------------------------------------------------------
+// Set the function to be called for each good frame.
+//------------------------------------------------------------
+void USARTframeSetCallback(frameCallback callback) {
+    frameDecoderInit(&usartDecoder);
+    usartCallback = callback;
+}
+
+
+//------------------------------------------------------------
+// Encode a frame, then hand it to the txBuffer in one go.
+//------------------------------------------------------------
+bool USARTframeSend(const uint8_t *payload, uint8_t length) {
+    uint8_t frame[FRAME_MAX_ENCODED];
+
+    // A uint8_t can't be too big for a 255 byte payload.
+#if FRAME_MAX_PAYLOAD < 255
+    if (length > FRAME_MAX_PAYLOAD)
+        return false;
+#endif
+
+    USARTwriteBytes(frame, frameEncode(payload, length, frame));
+    return true;
+}
+
+
+//------------------------------------------------------------
+// Decode straight out of the rxBuffer, a contiguous run at a
+// time, without copying the bytes out first.
+//------------------------------------------------------------
+uint8_t USARTframePoll() {
+    const uint8_t *received;
+    uint16_t count;
+    uint8_t frames = 0;
+
+    while ((count = cBufferPeekContiguous(&rxBuffer, &received))) {
+        for (uint16_t x = 0; x < count; x++) {
+            switch (frameDecodeByte(&usartDecoder, received[x])) {
+                case FRAME_OK:
+                    usartFrameStats.good++;
+                    frames++;
+                    if (usartCallback)
+                        usartCallback(usartDecoder.data,
+                                      usartDecoder.length);
+                    break;
+
+                case FRAME_BAD_CRC:
+                    usartFrameStats.badCRC++;
+                    break;
+
+                case FRAME_BAD_COBS:
+                    usartFrameStats.badCOBS++;
+                    break;
+
+                case FRAME_TOO_LONG:
+                    usartFrameStats.tooLong++;
+                    break;
+            }
+        }
+
+        cBufferConsume(&rxBuffer, count);
+    }
+
+    // Restart the other end, if flow control stopped it.
+    USARTflowCheck();
+
+    return frames;
+}
+
+
+//------------------------------------------------------------
+// Counts of frames received. Only USARTframePoll() changes
+// them, so there's no need to turn interrupts off.
+//------------------------------------------------------------
+void USARTframeStats(frameStatsStruct *stats) {
+    *stats = usartFrameStats;
+}
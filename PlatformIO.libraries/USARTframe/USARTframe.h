@@ -0,0 +1,138 @@
+#ifndef USARTFRAME_H
+#define USARTFRAME_H
+
+#include <stdint.h>
+
+//============================================================
+// Binary frames over the USART. Each frame is a payload of
+// up to FRAME_MAX_PAYLOAD bytes, followed by a CRC-16, all
+// COBS encoded, and ended by a zero byte.
+//
+// COBS (Consistent Overhead Byte Stuffing) removes every zero
+// from the data. Each run of non-zero bytes is preceded by a
+// "code" byte, which is the length of the run plus one, and
+// stands for a zero after the run. A code of 0xFF means a run
+// of 254 bytes with no zero after it. That costs one extra
+// byte per 254, at most, and as zero never appears anywhere
+// else, a receiver can always find the start of the next
+// frame, whatever it missed.
+//
+// The CRC is CRC-CCITT, reflected, starting from 0xFFFF, via
+// _crc_ccitt_update() in <util/crc16.h>. It's appended low
+// byte first, so the CRC of payload plus CRC is always zero,
+// which is what the decoder checks.
+//
+// For example, the payload 0x11 0x00 0x22 has a CRC of 0xE46A
+// and goes out as:
+//
+// 0x02 0x11 0x04 0x22 0x6A 0xE4 0x00
+//============================================================
+
+//------------------------------------------------------------
+// The largest payload. Override in platformio.ini, e.g.
+//
+// build_flags = -DFRAME_MAX_PAYLOAD=128
+//------------------------------------------------------------
+#ifndef FRAME_MAX_PAYLOAD
+    #define FRAME_MAX_PAYLOAD 64
+#endif
+
+#if FRAME_MAX_PAYLOAD > 255
+    #error "FRAME_MAX_PAYLOAD cannot be more than 255."
+#endif
+
+// Payload and CRC, plus a COBS code byte per 254, plus the
+// first code byte and the zero delimiter.
+#define FRAME_MAX_ENCODED \
+    (FRAME_MAX_PAYLOAD + 2 + (FRAME_MAX_PAYLOAD + 2) / 254 + 2)
+
+
+//------------------------------------------------------------
+// What frameDecodeByte() found.
+//------------------------------------------------------------
+#define FRAME_NONE 0        // Nothing yet, send more.
+#define FRAME_OK 1          // A good frame, see decoder.
+#define FRAME_BAD_CRC 2     // Complete, but the CRC is wrong.
+#define FRAME_BAD_COBS 3    // Ended in the middle of a run.
+#define FRAME_TOO_LONG 4    // Bigger than FRAME_MAX_PAYLOAD.
+
+
+//------------------------------------------------------------
+// An incremental decoder. Feed it bytes, one at a time, and
+// when frameDecodeByte() returns FRAME_OK, the payload is in
+// data[], and its size in length. They stay there until the
+// next byte is decoded.
+//------------------------------------------------------------
+typedef struct frameDecoder {
+    uint8_t data[FRAME_MAX_PAYLOAD + 2];  // Payload and CRC.
+    uint16_t length;        // Bytes in data[] so far.
+    uint16_t crc;           // CRC of data[] so far.
+    uint8_t remaining;      // Bytes left in the current run.
+    bool zeroPending;       // Add a zero before the next run.
+    bool tooLong;           // Frame overflowed data[].
+    bool finished;          // data[] holds the last frame.
+} frameDecoder;
+
+
+//------------------------------------------------------------
+// Encode "length" bytes of "payload" into "frame", which must
+// have room for FRAME_MAX_ENCODED bytes. Returns the number
+// of bytes in the frame, including the final zero.
+//------------------------------------------------------------
+uint16_t frameEncode(const uint8_t *payload, uint8_t length,
+                     uint8_t *frame);
+
+
+//------------------------------------------------------------
+// Start, or restart, decoding.
+//------------------------------------------------------------
+void frameDecoderInit(frameDecoder *decoder);
+
+
+//------------------------------------------------------------
+// Decode one received byte. Returns one of FRAME_xxx above.
+//------------------------------------------------------------
+uint8_t frameDecodeByte(frameDecoder *decoder, uint8_t aByte);
+
+
+//============================================================
+// Frames over USART0, via USARTinterrupt.
+//============================================================
+
+//------------------------------------------------------------
+// Called by USARTframePoll() for every good frame received.
+//------------------------------------------------------------
+typedef void (*frameCallback)(const uint8_t *payload, uint8_t length);
+
+void USARTframeSetCallback(frameCallback callback);
+
+
+//------------------------------------------------------------
+// Encode and send a frame. Waits for space in the txBuffer,
+// as printf() does. Returns false, and sends nothing, if
+// "length" is more than FRAME_MAX_PAYLOAD.
+//------------------------------------------------------------
+bool USARTframeSend(const uint8_t *payload, uint8_t length);
+
+
+//------------------------------------------------------------
+// Decode everything waiting in the rxBuffer, calling the
+// callback for every good frame. Call this from the loop.
+// Returns the number of good frames found.
+//------------------------------------------------------------
+uint8_t USARTframePoll();
+
+
+//------------------------------------------------------------
+// Counts of good and bad frames received.
+//------------------------------------------------------------
+typedef struct frameStatsStruct {
+    uint16_t good;
+    uint16_t badCRC;
+    uint16_t badCOBS;
+    uint16_t tooLong;
+} frameStatsStruct;
+
+void USARTframeStats(frameStatsStruct *stats);
+
+#endif // USARTFRAME_H
@@ -0,0 +1,189 @@
+#ifndef USARTBAUD_H
+#define USARTBAUD_H
+
+#include <stdint.h>
+
+//============================================================
+// Baud rate solver. Works out UBRR0, and whether to use U2X0,
+// for a given baud rate and F_CPU. These are all constexpr,
+// so with a constant baud rate, the compiler does all the
+// arithmetic and the AVR does none.
+//
+// For each setting of U2X0:
+//
+// UBRR0 = round(F_CPU / (Divisor * baudRate)) - 1
+// Actual baud = F_CPU / (Divisor * (UBRR0 + 1))
+// Error = (Actual - baudRate) / baudRate
+//
+// Divisor is 16, or 8 with U2X0. Rounding, rather than just
+// truncating, keeps the error as small as possible. Whichever
+// setting gets Divisor * (UBRR0 + 1) * baudRate closest to
+// F_CPU, so has the smallest error, wins, and if they tie, we
+// use normal speed, as the receiver takes more samples per
+// bit. UBRR0 is 12 bits, so a setting that needs more than
+// 4095 is never chosen.
+//
+// Errors are in hundredths of a percent, so 212 is 2.12%.
+//============================================================
+
+//------------------------------------------------------------
+// The most error USARTinit<baudRate>() will accept, again in
+// hundredths of a percent. Note that 115200 baud at 16 MHz is
+// 2.12% fast, which most USB adaptors are happy with, so to
+// use it, build with:
+//
+// build_flags = -DUSART_BAUD_MAX_ERROR=250
+//------------------------------------------------------------
+#ifndef USART_BAUD_MAX_ERROR
+    #define USART_BAUD_MAX_ERROR 200
+#endif
+
+// The "error" of a baud rate that can't be done at all.
+#define USART_BAUD_IMPOSSIBLE 0x7FFFFFFFL
+
+
+//------------------------------------------------------------
+// UBRR0 + 1, rounded, for U2X0 set or not.
+//------------------------------------------------------------
+constexpr uint32_t usartBaudDivisor(uint32_t baudRate, bool u2x) {
+    return (F_CPU + (u2x ? 4 : 8) * baudRate) /
+           ((u2x ? 8 : 16) * baudRate);
+}
+
+
+//------------------------------------------------------------
+// Can this U2X0 setting reach this baud rate at all?
+//------------------------------------------------------------
+constexpr bool usartBaudValid(uint32_t baudRate, bool u2x) {
+    return baudRate &&
+           usartBaudDivisor(baudRate, u2x) >= 1 &&
+           usartBaudDivisor(baudRate, u2x) <= 4096;
+}
+
+
+//------------------------------------------------------------
+// The value for UBRR0.
+//------------------------------------------------------------
+constexpr uint16_t usartBaudUBRR(uint32_t baudRate, bool u2x) {
+    return usartBaudDivisor(baudRate, u2x) - 1;
+}
+
+
+//------------------------------------------------------------
+// The baud rate the USART will actually run at.
+//------------------------------------------------------------
+constexpr uint32_t usartBaudActual(uint32_t baudRate, bool u2x) {
+    return F_CPU /
+           ((u2x ? 8 : 16) * usartBaudDivisor(baudRate, u2x));
+}
+
+
+//------------------------------------------------------------
+// Signed error, in hundredths of a percent. Positive is fast.
+//------------------------------------------------------------
+constexpr int32_t usartBaudError(uint32_t baudRate, bool u2x) {
+    return (int32_t)(((int64_t)usartBaudActual(baudRate, u2x) -
+                      (int64_t)baudRate) * 10000 / baudRate);
+}
+
+
+//------------------------------------------------------------
+// Size of the error, or USART_BAUD_IMPOSSIBLE.
+//------------------------------------------------------------
+constexpr int32_t usartBaudAbsError(uint32_t baudRate, bool u2x) {
+    return !usartBaudValid(baudRate, u2x) ? USART_BAUD_IMPOSSIBLE :
+           usartBaudError(baudRate, u2x) < 0 ?
+               -usartBaudError(baudRate, u2x) :
+               usartBaudError(baudRate, u2x);
+}
+
+
+//------------------------------------------------------------
+// CPU cycles for baudRate bits, at the actual baud rate. As
+// near to F_CPU as this U2X0 setting gets.
+//------------------------------------------------------------
+constexpr uint32_t usartBaudFrame(uint32_t baudRate, bool u2x) {
+    return (u2x ? 8 : 16) * baudRate * usartBaudDivisor(baudRate, u2x);
+}
+
+
+//------------------------------------------------------------
+// How many CPU cycles usartBaudFrame() is out by, or
+// 0xFFFFFFFF if this U2X0 setting can't do it at all. The
+// smaller, the smaller the error. Unlike the error, this needs
+// no 64 bit arithmetic, or rounding of the actual baud rate,
+// which at low rates is out by more than the difference
+// between the two settings.
+//------------------------------------------------------------
+constexpr uint32_t usartBaudCycles(uint32_t baudRate, bool u2x) {
+    return !usartBaudValid(baudRate, u2x) ? 0xFFFFFFFFUL :
+           usartBaudFrame(baudRate, u2x) > F_CPU ?
+               usartBaudFrame(baudRate, u2x) - F_CPU :
+               F_CPU - usartBaudFrame(baudRate, u2x);
+}
+
+
+//------------------------------------------------------------
+// Should U2X0 be set for this baud rate?
+//------------------------------------------------------------
+constexpr bool usartBaudU2X(uint32_t baudRate) {
+    return usartBaudCycles(baudRate, true) < usartBaudCycles(baudRate, false);
+}
+
+
+//------------------------------------------------------------
+// The error, in hundredths of a percent, for the chosen U2X0
+// setting, or USART_BAUD_IMPOSSIBLE.
+//------------------------------------------------------------
+constexpr int32_t usartBaudError(uint32_t baudRate) {
+    return usartBaudValid(baudRate, usartBaudU2X(baudRate)) ?
+           usartBaudError(baudRate, usartBaudU2X(baudRate)) :
+           USART_BAUD_IMPOSSIBLE;
+}
+
+
+//------------------------------------------------------------
+// The same choice as usartBaudU2X(), made at run time, for
+// init(baudRate), working out each divisor just the once. It
+// never needs the errors, so there's no 64 bit divide linked
+// into every program that calls USARTinit(9600). If neither
+// setting can do it, we get the nearest there is, UBRR0 =
+// 4095 without U2X0 if too slow, or 0 with it if too fast.
+//
+// Returns UBRR0, and sets "*u2x".
+//------------------------------------------------------------
+inline uint16_t usartBaudSolve(uint32_t baudRate, bool *u2x) {
+    uint32_t bestCycles = 0xFFFFFFFFUL;
+    uint16_t bestUBRR = 4095;
+
+    *u2x = false;
+    if (!baudRate)
+        return bestUBRR;
+
+    for (uint8_t mult = 16; mult >= 8; mult -= 8) {
+        uint32_t step = mult * baudRate;
+        uint32_t divisor = (F_CPU + step / 2) / step;
+
+        if (divisor < 1 || divisor > 4096)
+            continue;
+
+        uint32_t cycles = divisor * step;
+        cycles = cycles > F_CPU ? cycles - F_CPU : F_CPU - cycles;
+
+        if (cycles < bestCycles) {
+            bestCycles = cycles;
+            bestUBRR = divisor - 1;
+            *u2x = (mult == 8);
+        }
+    }
+
+    // Too fast for either.
+    if (bestCycles == 0xFFFFFFFFUL && baudRate > F_CPU / 16) {
+        bestUBRR = 0;
+        *u2x = true;
+    }
+
+    return bestUBRR;
+}
+
+#endif // USARTBAUD_H
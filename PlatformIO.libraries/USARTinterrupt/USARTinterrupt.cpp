@@ -1,11 +1,16 @@
 #include <avr/interrupt.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include "USARTinterrupt.h"
 #include "USARTbuffer.h"
 
-// The buffers live elsewhere.
-extern  volatile circularBuffer rxBuffer;
-extern  volatile circularBuffer txBuffer;
+//============================================================
+// The USARTxxx() functions are a thin wrapper around Usart<0>,
+// in Usart.h, which does the actual work. They are all short
+// enough that the compiler inlines Usart<0> into them.
+//============================================================
+
+// The buffers live in USARTbuffer.cpp.
 
 
 //------------------------------------------------------------
@@ -13,50 +18,22 @@ extern  volatile circularBuffer txBuffer;
 // baud rate. We assume, always a bad idea, that we are using
 // 8 bits of data, no parity and 1 stop bit.
 // Calling here also initialises the two circular buffers.
+//
+// The baud rate solver in USARTbaud.h picks U2X0 and UBRR0.
+// Called like this, it runs on the AVR, with 32 bit divides.
+// USARTinit<baudRate>() has the compiler do it instead.
 //------------------------------------------------------------
 void USARTinit(const uint32_t baudRate) {
-    // Baud rate factor.
-    uint16_t baudFactor;
-
-    // Initialise the two buffers. Do it first to stop
-    // occasional random garbage being transmitted by 
-    // the USART.
-    cBufferInit(&rxBuffer);
-    cBufferInit(&txBuffer);
-
-    // Power up the USART.
-    PRR &= ~(1 << PRUSART0);
-
-    // Initialise the USART. This sets 1 stop bit and
-    // no parity as a side effect. (They are the defaults.)
-    UCSR0A = UCSR0B = UCSR0C = 0;
-
-    // 8 bit data size.
-    UCSR0C |= ((1 << UCSZ01) | (1 << UCSZ00));
-
-    // Attempt high speed comms, required for 115200 baud
-    // which doesn't work otherwise.
-    UCSR0A = (1 << U2X0);
-
-    // Calculate baud rate factor from baud rate. Assumes
-    // high speed comms is in use.
-    baudFactor = (F_CPU / (8 * baudRate)) - 1;
-
-    // We need to keep the baudFactor below 4096 and
-    // on 16 MHz boards, we need low speed if baudRate is 
-    // 57600. Because both speeds give same actual baud
-    // and error rates. Single speed more accurate perhaps?
-    if ((baudFactor > 4095) ||
-        ((F_CPU == 16000000L) && (baudRate == 57600))) {
-            UCSR0A = 0;
-            baudFactor = (F_CPU / (16 * baudRate)) - 1;
-    }
+    Usart<0>::init(baudRate);
+}
 
-    // Set UBRR0 with correct factor.
-    UBRR0 = baudFactor;
 
-    // Enable and start RX, enable TX but don't start yet.
-    UCSR0B |= ((1 << TXEN0) | (1 << RXEN0) | (1 << RXCIE0));
+//------------------------------------------------------------
+// Initialise the USART with a baud rate factor already worked
+// out, and high speed mode on if "u2x" is true.
+//------------------------------------------------------------
+void USARTinitUBRR(const uint16_t baudFactor, const bool u2x) {
+    Usart<0>::initUBRR(baudFactor, u2x);
 }
 
 
@@ -66,20 +43,7 @@ void USARTinit(const uint32_t baudRate) {
 // This frees up pins PD0 and PD1 (D0 and D1) for GPIO.
 //------------------------------------------------------------
 void USARTend() {
-    // Make sure TX is completed.
-    USARTflush();
-
-    // Stop UDRIE interrupt, TX and RX.
-    STOP_UDRIE_INTERRUPT();
-    STOP_TX();
-    STOP_RX();
-
-    // Clear both buffers.
-    cBufferInit(&txBuffer);
-    cBufferInit(&rxBuffer);
-
-    // Power off the USART.
-    PRR |= (1 << PRUSART0);
+    Usart<0>::end();
 }
 
 //------------------------------------------------------------
@@ -88,16 +52,13 @@ void USARTend() {
 // USART.
 //------------------------------------------------------------
 void _putchar(char ch) {
-
-    // Add data to the buffer. Will wait for space if full.
-    cBufferAdd(&txBuffer, ch);
-
-    // Fire up the UDRE0 interrupt.
-    START_UDRIE_INTERRUPT();
+    // Add data to the buffer. If full, what happens depends
+    // on USART_TX_OVERFLOW_POLICY.
+    Usart<0>::putChar(ch);
 }
 
 //------------------------------------------------------------
-// This is not strictly necessary, we could just call 
+// This is not strictly necessary, we could just call
 // _putchar() but as all the other USART functions are named
 // USARTxxxx, this is consitent. That is all!
 //------------------------------------------------------------
@@ -106,23 +67,77 @@ void USARTputChar(uint8_t ch) {
 }
 
 
+//------------------------------------------------------------
+// Send a single byte to the USART, but never wait for space
+// in the txBuffer. Returns true if the byte was sent, false
+// if not.
+//------------------------------------------------------------
+bool USARTtryPutChar(uint8_t ch) {
+    return Usart<0>::tryPutChar(ch);
+}
+
+
+//------------------------------------------------------------
+// As printf(), but never waits for space in the txBuffer.
+// Returns how many bytes were sent, which may be less than
+// printf() would have returned.
+//------------------------------------------------------------
+int USARTtryPrintf(const char *format, ...) {
+    va_list va;
+    va_start(va, format);
+    int sent = Usart<0>::vtryPrintf(format, va);
+    va_end(va);
+
+    return sent;
+}
+
+
+//------------------------------------------------------------
+// Send a number of bytes to the USART, waiting for space in
+// the txBuffer if necessary.
+//------------------------------------------------------------
+int USARTwriteBytes(const uint8_t *buffer, int count) {
+    return Usart<0>::writeBytes(buffer, count);
+}
+
+
+//------------------------------------------------------------
+// Send a string from flash, see Usart<0>::writeText_P().
+//------------------------------------------------------------
+int USARTwriteText_P(const char *text) {
+    return Usart<0>::writeText_P(text);
+}
+
+
+//------------------------------------------------------------
+// Queue a block of data to be sent without copying it, see
+// Usart<0>::send().
+//------------------------------------------------------------
+bool USARTsend(const void *data, uint16_t length,
+               uint8_t flags, usartTxDone done) {
+    return Usart<0>::send(data, length, flags, done);
+}
+
+uint8_t USARTsendPending() {
+    return Usart<0>::sendPending();
+}
+
+void USARTsendPoll() {
+    Usart<0>::sendPoll();
+}
+
+
 //------------------------------------------------------------
 // Calling here will not return until the current txBuffer has
 // been completely sent to the USART. It's simply a busy
-// wait until UDRE0 is disabled.
+// wait until UDRIE0 is disabled.
 // It is probably not wise to call this function if:
 //
 // * The TXEN0 bit in USCR0B is not set; OR
 // * If global interrupts are off;
 //------------------------------------------------------------
 void USARTflush() {
-    volatile circularBuffer *tx = &txBuffer;
-    if (tx->headIndex == tx->tailIndex)
-        // Buffer empty.
-        return;
-
-    // Wait for interrupts to run down the buffer contents.
-    while ((UCSR0B & UDRE0)) ;  // Wait ...
+    Usart<0>::flush();
 }
 
 
@@ -130,24 +145,19 @@ void USARTflush() {
 // Data Register Empty interrupt. Copy next byte to be sent
 // from the txBuffer to UDR0. Will disable transmitter when we
 // run out of bytes. No need for TX Complete interrupt.
+//
+// Receive complete interrupt. Copy data byte received to
+// circular buffer. We must check for errors before reading
+// the data from UDR0.
+//
+// The ATmega2560 and 328PB number their USARTs from 0, the
+// 328P doesn't bother.
 //------------------------------------------------------------
-ISR(USART_UDRE_vect) {
-    // Grab next byte from txBuffer for transmission.
-    volatile circularBuffer *tx = &txBuffer;
-    int aByte= cBufferGet(tx);
-
-    // Is txBuffer empty? Will be -1 if so.
-    if (aByte != -1) {
-        UDR0 = aByte;
-    } else {
-        // txBuffer is empty, disable UDRE interrupt.
-        STOP_UDRIE_INTERRUPT();
-    }
-
-    // Clear the TX Complete interrupt flag.
-    // The interrupt is unused but still sets the flag.
-    UCSR0A |= (1 << TXC0);
-}
+#ifdef USART0_RX_vect
+USART_ISRS(0, USART0_RX_vect, USART0_UDRE_vect)
+#else
+USART_ISRS(0, USART_RX_vect, USART_UDRE_vect)
+#endif
 
 
 //------------------------------------------------------------
@@ -156,7 +166,7 @@ ISR(USART_UDRE_vect) {
 //------------------------------------------------------------
 int USARTreadByte() {
     // This returns -1 on error.
-    return cBufferGet(&rxBuffer);
+    return Usart<0>::readByte();
 }
 
 
@@ -166,20 +176,7 @@ int USARTreadByte() {
 // output buffer.
 //------------------------------------------------------------
 int USARTreadBytes(uint8_t *buffer, int count) {
-    int bytesRead = 0;
-    int aByte;
-    while (count) {
-        aByte = USARTreadByte();
-        if (aByte >= 0) {
-            *buffer++ = aByte;
-            count--;
-            bytesRead++;
-        } else {
-            break;
-        }
-    }
-
-    return bytesRead;
+    return Usart<0>::readBytes(buffer, count);
 }
 
 
@@ -187,39 +184,46 @@ int USARTreadBytes(uint8_t *buffer, int count) {
 // Are there any data in the rxBuffer not yet read by the code
 // if so, return how many bytes are available.
 //------------------------------------------------------------
-uint8_t USARTavailable() {
-    return cBufferAvailable();
+uint16_t USARTavailable() {
+    return Usart<0>::available();
 }
 
 //------------------------------------------------------------
 // Any errors in the USART receiver?
 //------------------------------------------------------------
 uint8_t USARTerror() {
-    return rxBuffer.lastError;
+    return Usart<0>::error();
 }
 
 //------------------------------------------------------------
-// Receive complete interrupt. Copy data byte received to 
-// circular buffer. We must check for errors before reading 
-// the data from UDR0.
+// Line mode, see Usart<0>::lineMode().
+//------------------------------------------------------------
+void USARTlineMode(bool enable, bool echo) {
+    Usart<0>::lineMode(enable, echo);
+}
+
+uint8_t USARTlineReady() {
+    return Usart<0>::lineReady();
+}
+
+int USARTreadLine(char *buffer, uint8_t size) {
+    return Usart<0>::readLine(buffer, size);
+}
+
+//------------------------------------------------------------
+// RX flow control, see Usart<0>::flowControl().
+//------------------------------------------------------------
+void USARTflowControl(uint8_t mode, uint16_t high, uint16_t low) {
+    Usart<0>::flowControl(mode, high, low);
+}
+
+void USARTflowCheck() {
+    Usart<0>::flowCheck();
+}
+
+//------------------------------------------------------------
+// Take a consistent copy of the statistics.
 //------------------------------------------------------------
-ISR(USART_RX_vect) {
-    // Check for errors first.
-    uint8_t errors = USART_CHECK_ERRORS();    
-
-    // Read data from USART.
-    uint8_t aByte = UDR0;
-
-    // If no errors, add the byte to the RX buffer, if
-    // there is free space, otherwise just drop the byte.
-    volatile circularBuffer *rx = &rxBuffer;
-    if (!errors) {
-        if (!cBufferFull(rx)) {
-            cBufferAdd(rx, aByte);
-        }
-    } else {
-        // Save the error bits in case the code is
-        // interested.
-        rx->lastError = errors;
-    }
+void USARTstats(USARTStatsStruct *stats, bool reset) {
+    Usart<0>::stats(stats, reset);
 }
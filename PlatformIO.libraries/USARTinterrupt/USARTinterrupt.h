@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <USARTbuffer.h>
+#include "Usart.h"
 #include <avr/interrupt.h>
 #include "printf.h"
 
@@ -45,6 +46,20 @@
 // just a demo after all.
 //------------------------------------------------------------
 void USARTinit(uint32_t baudRate);
+void USARTinitUBRR(uint16_t baudFactor, bool u2x);
+
+
+//------------------------------------------------------------
+// As USARTinit(baudRate), but the baud rate is a constant, so
+// UBRR0 and U2X0 are worked out at compile time. It won't
+// compile if the error is more than USART_BAUD_MAX_ERROR:
+//
+// USARTinit<500000>();
+//------------------------------------------------------------
+template <uint32_t baudRate>
+inline void USARTinit() {
+    Usart<0>::init<baudRate>();
+}
 
 
 //------------------------------------------------------------
@@ -68,6 +83,51 @@ void _putchar(char ch);
 void USARTputChar(uint8_t ch);
 
 
+//------------------------------------------------------------
+// Non-blocking versions of USARTputChar() and printf(). They
+// never wait for space in the txBuffer. USARTtryPutChar()
+// returns true if the byte was sent, USARTtryPrintf() returns
+// the count of bytes sent.
+//------------------------------------------------------------
+bool USARTtryPutChar(uint8_t ch);
+int USARTtryPrintf(const char *format, ...);
+
+
+//------------------------------------------------------------
+// Send a number of bytes to the USART. Waits for space in the
+// txBuffer if necessary. Returns count of bytes sent.
+//------------------------------------------------------------
+int USARTwriteBytes(const uint8_t *buffer, int count);
+
+
+//------------------------------------------------------------
+// Send a string held in flash, declared PROGMEM or wrapped in
+// PSTR(), without a copy in SRAM. Waits for space in the
+// txBuffer if necessary. Returns the length of the string.
+// printf("%S", text) does the same, with formatting.
+//------------------------------------------------------------
+int USARTwriteText_P(const char *text);
+#define USARTwriteTextln_P(s) do { USARTwriteText_P(s); _putchar('\n'); } while (0)
+
+
+//------------------------------------------------------------
+// Send "length" bytes from "data", in RAM or, with flags of
+// USART_TX_PROGMEM, in flash, without copying them into the
+// txBuffer. The UDRE ISR sends them from where they are, in
+// order with everything else. Never waits, returns false if
+// the descriptor queue is full. USARTsendPending() says how
+// many are queued.
+//
+// Once they've gone, USARTsendPoll(), called from the main
+// loop, calls "done", if not 0. See usartTxDone in Usart.h
+// for having the UDRE ISR call it instead.
+//------------------------------------------------------------
+bool USARTsend(const void *data, uint16_t length,
+               uint8_t flags = USART_TX_RAM, usartTxDone done = 0);
+uint8_t USARTsendPending();
+void USARTsendPoll();
+
+
 //============================================================
 // USART RX Stuff follows.
 //============================================================
@@ -101,9 +161,10 @@ int USARTreadBytes(uint8_t *buffer, int count);
 
 //------------------------------------------------------------
 // Are there any data in the rxBuffer not yet read by the code
-// if so, return how many bytes are available.
+// if so, return how many bytes are available. The rxBuffer
+// can be more than 256 bytes, hence uint16_t.
 //------------------------------------------------------------
-uint8_t USARTavailable();
+uint16_t USARTavailable();
 
 
 //------------------------------------------------------------
@@ -111,5 +172,41 @@ uint8_t USARTavailable();
 //------------------------------------------------------------
 uint8_t USARTerror();
 
+
+//------------------------------------------------------------
+// Line mode. The RX ISR echoes what's typed, if "echo" is
+// true, handles backspace, and turns CR, LF or CR/LF into a
+// single '\n'. USARTlineReady() returns how many complete
+// lines are waiting. USARTreadLine() copies the next one to
+// "buffer", without the '\n', and returns its length, or -1
+// if there isn't one yet. Turning line mode on or off empties
+// the rxBuffer.
+//------------------------------------------------------------
+void USARTlineMode(bool enable, bool echo = true);
+uint8_t USARTlineReady();
+int USARTreadLine(char *buffer, uint8_t size);
+
+
+//------------------------------------------------------------
+// RX flow control. "mode" is USART_FLOW_NONE, USART_FLOW_XONXOFF
+// or USART_FLOW_RTS, see Usart.h. The other end is told to
+// stop sending when the rxBuffer holds "high" bytes, and to
+// start again when it's down to "low". Code that reads the
+// rxBuffer itself, not through USARTreadxxx(), must call
+// USARTflowCheck() afterwards, to restart the flow.
+//------------------------------------------------------------
+void USARTflowControl(uint8_t mode,
+                      uint16_t high = USART_RX_BUFFER_SIZE * 3 / 4,
+                      uint16_t low = USART_RX_BUFFER_SIZE / 4);
+void USARTflowCheck();
+
+
+//------------------------------------------------------------
+// USART statistics, see USARTStatsStruct in Usart.h. Copy
+// them to "stats", with interrupts off so they are
+// consistent. If "reset" is true, start counting again.
+//------------------------------------------------------------
+void USARTstats(USARTStatsStruct *stats, bool reset = false);
+
 #endif // USARTINTERRUPT_H
 
@@ -0,0 +1,1090 @@
+#ifndef USART_H
+#define USART_H
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include <USARTbuffer.h>
+#include "USARTbaud.h"
+#include "printf.h"
+
+//============================================================
+// Usart<N> - an interrupt driven USARTn, for any n that the
+// device has. The ATmega328P only has USART0, the 328PB has
+// two, and the ATmega2560 four.
+//
+// Everything is static, and the registers, buffers and ports
+// are all known at compile time, so Usart<1>::putChar('A')
+// compiles to the same code as the USART0 only version did.
+// There are no pointers to registers, or tables of ports.
+//
+// The ISRs can't be templates, so for every port other than
+// USART0, which USARTinterrupt.cpp looks after, you need this
+// in one of your source files:
+//
+// USART_ISRS(1, USART1_RX_vect, USART1_UDRE_vect)
+//
+// The USARTxxx() functions in USARTinterrupt.h are a thin
+// wrapper around Usart<0>.
+//============================================================
+
+
+//============================================================
+// USART statistics. Counted from init(), and updated by the
+// ISRs, so they cost a few cycles per byte.
+//============================================================
+typedef struct USARTStatsStruct {
+    uint32_t rxBytes;       // Bytes received without errors.
+    uint32_t txBytes;       // Bytes written to UDRn.
+    uint16_t overruns;      // DORn - UDRn wasn't read in time.
+    uint16_t frameErrors;   // FEn - no stop bit.
+    uint16_t parityErrors;  // UPEn.
+    uint16_t rxDropped;     // No room in the rxBuffer.
+    uint16_t rxHighWater;   // Most bytes ever in the rxBuffer.
+    uint16_t flowStops;     // Times XOFF sent, or RTS raised.
+} USARTStatsStruct;
+
+
+//------------------------------------------------------------
+// The registers for each USART. The bits have the same
+// positions in every USART, so the USART0 names, UDRIE0 etc,
+// are used for all of them.
+//------------------------------------------------------------
+template <uint8_t N>
+struct UsartRegisters;
+
+#if defined(PRR0)
+    #define USART0_PRR PRR0
+#else
+    #define USART0_PRR PRR
+#endif
+
+template <>
+struct UsartRegisters<0> {
+    static decltype((UDR0)) udr() { return UDR0; }
+    static decltype((UCSR0A)) ucsra() { return UCSR0A; }
+    static decltype((UCSR0B)) ucsrb() { return UCSR0B; }
+    static decltype((UCSR0C)) ucsrc() { return UCSR0C; }
+    static decltype((UBRR0)) ubrr() { return UBRR0; }
+    static void powerUp() { USART0_PRR &= ~(1 << PRUSART0); }
+    static void powerDown() { USART0_PRR |= (1 << PRUSART0); }
+};
+
+#ifdef UDR1
+// PRUSART1 is in PRR0 on the 328PB, and the 164/324/644/1284
+// family, which have no PRR1 bits for USARTs. The 2560 family
+// and the 32U4 have it in PRR1.
+#if defined(__AVR_ATmega328PB__) || \
+    defined(__AVR_ATmega164A__) || defined(__AVR_ATmega164P__) || \
+    defined(__AVR_ATmega164PA__) || defined(__AVR_ATmega324A__) || \
+    defined(__AVR_ATmega324P__) || defined(__AVR_ATmega324PA__) || \
+    defined(__AVR_ATmega324PB__) || defined(__AVR_ATmega644__) || \
+    defined(__AVR_ATmega644A__) || defined(__AVR_ATmega644P__) || \
+    defined(__AVR_ATmega644PA__) || defined(__AVR_ATmega1284__) || \
+    defined(__AVR_ATmega1284P__)
+    #define USART1_PRR PRR0
+#else
+    #define USART1_PRR PRR1
+#endif
+
+template <>
+struct UsartRegisters<1> {
+    static decltype((UDR1)) udr() { return UDR1; }
+    static decltype((UCSR1A)) ucsra() { return UCSR1A; }
+    static decltype((UCSR1B)) ucsrb() { return UCSR1B; }
+    static decltype((UCSR1C)) ucsrc() { return UCSR1C; }
+    static decltype((UBRR1)) ubrr() { return UBRR1; }
+    static void powerUp() { USART1_PRR &= ~(1 << PRUSART1); }
+    static void powerDown() { USART1_PRR |= (1 << PRUSART1); }
+};
+#endif
+
+// USART2 and USART3 are bits 1 and 2 of PRR1 on the 640/1280/
+// 2560 family, the only devices with a USART3.
+#ifdef UDR2
+template <>
+struct UsartRegisters<2> {
+    static decltype((UDR2)) udr() { return UDR2; }
+    static decltype((UCSR2A)) ucsra() { return UCSR2A; }
+    static decltype((UCSR2B)) ucsrb() { return UCSR2B; }
+    static decltype((UCSR2C)) ucsrc() { return UCSR2C; }
+    static decltype((UBRR2)) ubrr() { return UBRR2; }
+    static void powerUp() { PRR1 &= ~(1 << PRUSART2); }
+    static void powerDown() { PRR1 |= (1 << PRUSART2); }
+};
+#endif
+
+#ifdef UDR3
+template <>
+struct UsartRegisters<3> {
+    static decltype((UDR3)) udr() { return UDR3; }
+    static decltype((UCSR3A)) ucsra() { return UCSR3A; }
+    static decltype((UCSR3B)) ucsrb() { return UCSR3B; }
+    static decltype((UCSR3C)) ucsrc() { return UCSR3C; }
+    static decltype((UBRR3)) ubrr() { return UBRR3; }
+    static void powerUp() { PRR1 &= ~(1 << PRUSART3); }
+    static void powerDown() { PRR1 |= (1 << PRUSART3); }
+};
+#endif
+
+
+//------------------------------------------------------------
+// The state of line mode, see Usart<N>::lineMode().
+//------------------------------------------------------------
+typedef struct UsartLineStruct {
+    uint8_t ready;          // Complete lines in the rxBuffer.
+    uint16_t length;        // Bytes in the line being typed.
+    bool enabled;           // Line mode is on.
+    bool echo;              // Echo what's typed.
+    bool lastWasCR;         // Ignore LF after CR.
+} UsartLineStruct;
+
+
+//------------------------------------------------------------
+// RX flow control, see Usart<N>::flowControl(). When the
+// rxBuffer fills to the high watermark, the other end is told
+// to stop sending, and when it drains to the low watermark,
+// to start again.
+//
+// USART_FLOW_XONXOFF - Send XOFF (Ctrl-S) and XON (Ctrl-Q).
+//                      Only for text, as the data mustn't
+//                      contain either byte.
+// USART_FLOW_RTS     - Take RTS high to stop, low to start.
+//                      The other end's CTS must be wired to
+//                      it, and obey it.
+//
+// The high watermark must leave room for whatever the other
+// end sends before it notices. A USB serial adaptor might
+// send another 16 bytes or more.
+//------------------------------------------------------------
+#define USART_FLOW_NONE 0
+#define USART_FLOW_XONXOFF 1
+#define USART_FLOW_RTS 2
+
+#define USART_XON 0x11
+#define USART_XOFF 0x13
+
+typedef struct UsartFlowStruct {
+    uint16_t high;          // Stop at this many bytes.
+    uint16_t low;           // Start again at this many.
+    uint8_t mode;           // USART_FLOW_xxx.
+    uint8_t pending;        // XON or XOFF to send, or 0.
+    bool stopped;           // Told the other end to stop.
+} UsartFlowStruct;
+
+
+//------------------------------------------------------------
+// The TX descriptor queue, see Usart<N>::send(). Each entry
+// is a block of data, in RAM or in flash, which the UDRE ISR
+// sends straight from where it is, rather than having it
+// copied into the txBuffer first. Override the number of
+// entries in platformio.ini, for example:
+//
+// build_flags = -DUSART_TX_QUEUE_SIZE=8
+//------------------------------------------------------------
+#ifndef USART_TX_QUEUE_SIZE
+    #define USART_TX_QUEUE_SIZE 4
+#endif
+
+static_assert(USART_TX_QUEUE_SIZE >= 1 && USART_TX_QUEUE_SIZE <= 128 &&
+              (USART_TX_QUEUE_SIZE & (USART_TX_QUEUE_SIZE - 1)) == 0,
+              "USART_TX_QUEUE_SIZE must be a power of 2, up to 128.");
+
+#define USART_TX_RAM 0
+#define USART_TX_PROGMEM 1
+
+//------------------------------------------------------------
+// Called when the last byte of "data" has gone to UDRn. By
+// default, from the main code, in Usart<N>::sendPoll(), as a
+// call through a pointer in the UDRE ISR makes avr-gcc save
+// and restore every call-used register, up to 12 more PUSHes
+// and POPs, 48 cycles, on every interrupt, whether there's a
+// "done" or not. To have it called from the UDRE ISR, with
+// interrupts off, and pay that, define USART_TX_DONE_IN_ISR
+// in platformio.ini:
+//
+// build_flags = -DUSART_TX_DONE_IN_ISR
+//------------------------------------------------------------
+typedef void (*usartTxDone)(const void *data);
+
+typedef struct UsartTxDescriptor {
+    const uint8_t *data;
+    uint16_t length;
+    uint16_t mark;          // The txBuffer's headIndex when queued.
+    uint8_t flags;          // USART_TX_RAM or USART_TX_PROGMEM.
+    usartTxDone done;       // Or 0.
+} UsartTxDescriptor;
+
+typedef struct UsartTxQueue {
+    UsartTxDescriptor entries[USART_TX_QUEUE_SIZE];
+    uint16_t offset;        // Bytes sent from the oldest entry.
+    uint8_t head;           // Count of entries added,
+    uint8_t tail;           // of entries sent,
+    uint8_t done;           // and of those sendPoll() has finished.
+} UsartTxQueue;
+
+
+//------------------------------------------------------------
+// The RTS pin, for USART_FLOW_RTS. There isn't one, unless
+// specialised. For USART0, which USARTinterrupt.cpp compiles,
+// set the pin in platformio.ini, for example, for PD2 (D2):
+//
+// build_flags = -DUSART_RTS_BIT=PD2
+//
+// It's on PORTD unless USART_RTS_PORT and USART_RTS_DDR say
+// otherwise. For other ports, specialise UsartRts<N> before
+// using Usart<N>, as below.
+//------------------------------------------------------------
+template <uint8_t N>
+struct UsartRts {
+    static void init() {}
+    static void stop(bool) {}
+};
+
+#ifdef USART_RTS_BIT
+    #ifndef USART_RTS_PORT
+        #define USART_RTS_PORT PORTD
+        #define USART_RTS_DDR DDRD
+    #endif
+
+template <>
+struct UsartRts<0> {
+    // Output, low, so the other end may send.
+    static void init() {
+        USART_RTS_PORT &= ~(1 << USART_RTS_BIT);
+        USART_RTS_DDR |= (1 << USART_RTS_BIT);
+    }
+
+    static void stop(bool stop) {
+        if (stop)
+            USART_RTS_PORT |= (1 << USART_RTS_BIT);
+        else
+            USART_RTS_PORT &= ~(1 << USART_RTS_BIT);
+    }
+};
+#endif
+
+
+//------------------------------------------------------------
+// Each port's statistics, line mode, flow control and TX
+// descriptor queue state.
+//------------------------------------------------------------
+template <uint8_t N>
+struct UsartState {
+    static volatile USARTStatsStruct stats;
+    static volatile UsartLineStruct line;
+    static volatile UsartFlowStruct flow;
+    static volatile UsartTxQueue txQueue;
+};
+
+template <uint8_t N>
+volatile USARTStatsStruct UsartState<N>::stats;
+
+template <uint8_t N>
+volatile UsartLineStruct UsartState<N>::line;
+
+template <uint8_t N>
+volatile UsartFlowStruct UsartState<N>::flow;
+
+template <uint8_t N>
+volatile UsartTxQueue UsartState<N>::txQueue;
+
+
+//------------------------------------------------------------
+// Each port's buffers. By default every port
+// gets an rxRingBuffer and a txRingBuffer, as sized in
+// USARTbuffer.h. USART0 uses the rxBuffer and txBuffer in
+// USARTbuffer.cpp, so that existing code can still find them.
+//
+// For different sizes on another port, specialise this before
+// using Usart<N>, for example:
+//
+// template <>
+// struct UsartData<1> {
+//     static volatile RingBuffer<16> rxStorage;
+//     static volatile RingBuffer<256> txStorage;
+//     static volatile RingBuffer<16> *rx() { return &rxStorage; }
+//     static volatile RingBuffer<256> *tx() { return &txStorage; }
+// };
+//
+// and define the two buffers in one source file.
+//------------------------------------------------------------
+template <uint8_t N>
+struct UsartData {
+    static volatile rxRingBuffer rxStorage;
+    static volatile txRingBuffer txStorage;
+
+    static volatile rxRingBuffer *rx() { return &rxStorage; }
+    static volatile txRingBuffer *tx() { return &txStorage; }
+};
+
+template <uint8_t N>
+volatile rxRingBuffer UsartData<N>::rxStorage;
+
+template <uint8_t N>
+volatile txRingBuffer UsartData<N>::txStorage;
+
+template <>
+struct UsartData<0> {
+    static volatile rxRingBuffer *rx() { return &rxBuffer; }
+    static volatile txRingBuffer *tx() { return &txBuffer; }
+};
+
+
+//------------------------------------------------------------
+// USARTtryPrintf() passes one of these to each call of
+// tryPrintfOut(), to count the bytes sent.
+//------------------------------------------------------------
+typedef struct {
+    int sent;
+    bool stopped;
+} tryPrintfState;
+
+
+//============================================================
+// The driver itself.
+//============================================================
+template <uint8_t N>
+class Usart {
+    typedef UsartRegisters<N> Reg;
+    typedef UsartData<N> Data;
+    typedef UsartState<N> State;
+    typedef UsartRts<N> Rts;
+
+public:
+    //--------------------------------------------------------
+    // Initialise the USART. We always use 8N1 here -- this is
+    // just a demo after all. Calling here also initialises
+    // the two circular buffers.
+    //
+    // The baud rate solver in USARTbaud.h picks U2Xn and
+    // UBRRn. Called like this, it runs on the AVR, with 32
+    // bit divides, see usartBaudSolve(). init<baudRate>() has
+    // the compiler do it.
+    //--------------------------------------------------------
+    static void init(const uint32_t baudRate) {
+        bool u2x;
+        uint16_t ubrr = usartBaudSolve(baudRate, &u2x);
+
+        initUBRR(ubrr, u2x);
+    }
+
+    template <uint32_t baudRate>
+    static void init() {
+        static_assert(usartBaudError(baudRate) <= USART_BAUD_MAX_ERROR &&
+                      usartBaudError(baudRate) >= -USART_BAUD_MAX_ERROR,
+                      "Baud rate error is too high at this F_CPU.");
+
+        initUBRR(usartBaudUBRR(baudRate, usartBaudU2X(baudRate)),
+                 usartBaudU2X(baudRate));
+    }
+
+
+    //--------------------------------------------------------
+    // Initialise the USART with a baud rate factor already
+    // worked out, and high speed mode on if "u2x" is true.
+    //--------------------------------------------------------
+    static void initUBRR(const uint16_t baudFactor, const bool u2x) {
+        // Initialise the two buffers. Do it first to stop
+        // occasional random garbage being transmitted by
+        // the USART.
+        cBufferInit(Data::rx());
+        cBufferInit(Data::tx());
+
+        // What to do when they fill up.
+        cBufferSetPolicy(Data::rx(), USART_RX_OVERFLOW_POLICY);
+        cBufferSetPolicy(Data::tx(), USART_TX_OVERFLOW_POLICY);
+
+        // And start counting from here.
+        USARTStatsStruct ignored;
+        stats(&ignored, true);
+
+        // Forget anything queued by send().
+        State::txQueue.head = 0;
+        State::txQueue.tail = 0;
+        State::txQueue.done = 0;
+        State::txQueue.offset = 0;
+
+        // The rxBuffer is empty, so the other end may send.
+        State::flow.pending = 0;
+        State::flow.stopped = false;
+        if (State::flow.mode == USART_FLOW_RTS)
+            Rts::stop(false);
+
+        // Power up the USART.
+        Reg::powerUp();
+
+        // Initialise the USART. This sets 1 stop bit and
+        // no parity as a side effect. (They are the defaults.)
+        Reg::ucsra() = 0;
+        Reg::ucsrb() = 0;
+        Reg::ucsrc() = 0;
+
+        // 8 bit data size.
+        Reg::ucsrc() |= ((1 << UCSZ01) | (1 << UCSZ00));
+
+        // High or normal speed, and the baud rate factor.
+        Reg::ucsra() = u2x ? (1 << U2X0) : 0;
+        Reg::ubrr() = baudFactor;
+
+        // Enable and start RX, enable TX but don't start yet.
+        Reg::ucsrb() |= ((1 << TXEN0) | (1 << RXEN0) | (1 << RXCIE0));
+    }
+
+
+    //--------------------------------------------------------
+    // We are done with the USART. Stop the interrupts and
+    // power it down to save a couple of microamps.
+    //--------------------------------------------------------
+    static void end() {
+        // Make sure TX is completed.
+        flush();
+
+        // Stop UDRIE interrupt, TX and RX.
+        Reg::ucsrb() &= ~((1 << UDRIE0) | (1 << TXEN0) |
+                          (1 << RXEN0) | (1 << RXCIE0));
+
+        // Clear both buffers.
+        cBufferInit(Data::tx());
+        cBufferInit(Data::rx());
+
+        // Power off the USART.
+        Reg::powerDown();
+    }
+
+
+    //--------------------------------------------------------
+    // Don't return until the txBuffer has been sent. It's
+    // simply a wait until the UDRE interrupt disables itself,
+    // asleep if USART_IDLE_SLEEP is 1. It is probably not
+    // wise to call this function if TXENn is not set, or if
+    // global interrupts are off.
+    //--------------------------------------------------------
+    static void flush() {
+        if (cBufferEmpty(Data::tx()) && !sendPending())
+            // Buffer and descriptor queue empty.
+            return;
+
+        // Wait for interrupts to run down the buffer contents.
+        cBufferWaitWhile([] {
+            return (Reg::ucsrb() & (1 << UDRIE0)) != 0;
+        });
+    }
+
+
+    //--------------------------------------------------------
+    // Send a single byte. If the txBuffer is full, what
+    // happens depends on USART_TX_OVERFLOW_POLICY.
+    //--------------------------------------------------------
+    static void putChar(uint8_t ch) {
+        cBufferAdd(Data::tx(), ch);
+
+        // Fire up the UDRE interrupt.
+        Reg::ucsrb() |= (1 << UDRIE0);
+    }
+
+
+    //--------------------------------------------------------
+    // Send a single byte, but never wait for space in the
+    // txBuffer. Returns true if the byte was sent, false if
+    // not. A txBuffer policy of BUFFER_BLOCK is treated as
+    // BUFFER_RETURN_ERROR here.
+    //--------------------------------------------------------
+    static bool tryPutChar(uint8_t ch) {
+        uint8_t policy = Data::tx()->overflowPolicy;
+        if (policy == BUFFER_BLOCK)
+            policy = BUFFER_RETURN_ERROR;
+
+        if (cBufferAdd(Data::tx(), ch, policy) != ERR_BUFFER_OK)
+            return false;
+
+        // Fire up the UDRE interrupt.
+        Reg::ucsrb() |= (1 << UDRIE0);
+        return true;
+    }
+
+
+    //--------------------------------------------------------
+    // As printf(), but never waits for space in the txBuffer.
+    // Returns how many bytes were sent. With
+    // BUFFER_DROP_NEWEST, any bytes that don't fit are left
+    // out, and the rest sent, if there's space by then.
+    // Otherwise, output stops at the first byte that doesn't
+    // fit.
+    //--------------------------------------------------------
+    static int vtryPrintf(const char *format, va_list va) {
+        tryPrintfState state = {0, false};
+
+        vfctprintf(tryPrintfOut, &state, format, va);
+        return state.sent;
+    }
+
+    static int tryPrintf(const char *format, ...) {
+        va_list va;
+        va_start(va, format);
+        int sent = vtryPrintf(format, va);
+        va_end(va);
+
+        return sent;
+    }
+
+
+    //--------------------------------------------------------
+    // Send a number of bytes. Copies as many as will fit into
+    // the txBuffer in one go, and waits for the UDRE
+    // interrupt to make space for the rest, if any. Returns
+    // the count of bytes sent, which is "count" unless
+    // interrupts are off, when the UDRE interrupt can't make
+    // space.
+    //--------------------------------------------------------
+    static int writeBytes(const uint8_t *buffer, int count) {
+        int bytesWritten = 0;
+
+        while (bytesWritten < count) {
+            uint16_t copied = cBufferWrite(Data::tx(),
+                                           buffer + bytesWritten,
+                                           count - bytesWritten);
+            if (copied) {
+                bytesWritten += copied;
+
+                // Fire up the UDRE interrupt.
+                Reg::ucsrb() |= (1 << UDRIE0);
+            } else if (!(SREG & (1 << SREG_I))) {
+                // Waiting would be forever.
+                break;
+            } else {
+                cBufferWaitWhile([] { return cBufferFull(Data::tx()); });
+            }
+        }
+
+        return bytesWritten;
+    }
+
+
+    //--------------------------------------------------------
+    // Send a string from flash, a PROGMEM array or PSTR(),
+    // a byte at a time, through putChar(). So it never sits
+    // in SRAM, not even on the stack. Returns the length of
+    // the string.
+    //--------------------------------------------------------
+    static int writeText_P(const char *text) {
+        int bytesWritten = 0;
+        uint8_t ch;
+
+        while ((ch = pgm_read_byte(text + bytesWritten))) {
+            putChar(ch);
+            bytesWritten++;
+        }
+
+        return bytesWritten;
+    }
+
+
+    //--------------------------------------------------------
+    // Send "length" bytes from "data" without copying them.
+    // "flags" says whether they are in RAM, USART_TX_RAM, or
+    // in flash, USART_TX_PROGMEM. They go out in order with
+    // everything else sent, after whatever is already in the
+    // txBuffer, and "data" must be left alone until they have
+    // gone. The "done" function, if any, is called to say so,
+    // from sendPoll(), see usartTxDone. An entry with a "done"
+    // keeps its place in the queue until sendPoll() has called
+    // it.
+    //
+    // Never waits. Returns false if the descriptor queue is
+    // full, see USART_TX_QUEUE_SIZE.
+    //
+    // The txBuffer must not use BUFFER_DROP_OLDEST, as that
+    // could throw away the byte the queue is waiting for.
+    //--------------------------------------------------------
+    static bool send(const void *data, uint16_t length,
+                     uint8_t flags = USART_TX_RAM,
+                     usartTxDone done = 0) {
+        if (!length) {
+            if (done)
+                done(data);
+            return true;
+        }
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            volatile UsartTxQueue &queue = State::txQueue;
+
+#ifndef USART_TX_DONE_IN_ISR
+            // Entries sent, with nothing for sendPoll() to call,
+            // are finished with already.
+            while (queue.done != queue.tail &&
+                   !queue.entries[queue.done &
+                                  (USART_TX_QUEUE_SIZE - 1)].done)
+                queue.done++;
+
+            if (uint8_t(queue.head - queue.done) >= USART_TX_QUEUE_SIZE)
+                return false;
+#else
+            if (uint8_t(queue.head - queue.tail) >= USART_TX_QUEUE_SIZE)
+                return false;
+#endif
+
+            volatile UsartTxDescriptor &entry =
+                queue.entries[queue.head & (USART_TX_QUEUE_SIZE - 1)];
+
+            entry.data = (const uint8_t *)data;
+            entry.length = length;
+            entry.mark = cBufferIndex(Data::tx()->headIndex);
+            entry.flags = flags;
+            entry.done = done;
+            queue.head++;
+        }
+
+        // Fire up the UDRE interrupt.
+        Reg::ucsrb() |= (1 << UDRIE0);
+        return true;
+    }
+
+
+    //--------------------------------------------------------
+    // How many send() descriptors are still to go?
+    //--------------------------------------------------------
+    static uint8_t sendPending() {
+        return uint8_t(State::txQueue.head - State::txQueue.tail);
+    }
+
+
+    //--------------------------------------------------------
+    // Call the "done" function of every send() descriptor
+    // sent since the last call, oldest first, with interrupts
+    // on. Call it from the main loop, while anything sent has
+    // a "done". Does nothing with USART_TX_DONE_IN_ISR.
+    //--------------------------------------------------------
+    static void sendPoll() {
+#ifndef USART_TX_DONE_IN_ISR
+        while (true) {
+            usartTxDone done;
+            const void *data;
+
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                volatile UsartTxQueue &queue = State::txQueue;
+
+                if (queue.done == queue.tail)
+                    return;
+
+                volatile UsartTxDescriptor &entry =
+                    queue.entries[queue.done & (USART_TX_QUEUE_SIZE - 1)];
+
+                done = entry.done;
+                data = entry.data;
+                queue.done++;
+            }
+
+            if (done)
+                done(data);
+        }
+#endif
+    }
+
+
+    //--------------------------------------------------------
+    // Read 1 byte of data. Returns -1 if the buffer is empty.
+    //--------------------------------------------------------
+    static int readByte() {
+        int aByte = cBufferGet(Data::rx());
+
+        flowCheck();
+        return aByte;
+    }
+
+
+    //--------------------------------------------------------
+    // Read a number of bytes into a buffer. Returns count of
+    // bytes actually read. May include CR/LF characters in
+    // the output buffer.
+    //--------------------------------------------------------
+    static int readBytes(uint8_t *buffer, int count) {
+        if (count <= 0)
+            return 0;
+
+        // At most two memcpy() calls, not one call per byte.
+        int bytesRead = cBufferRead(Data::rx(), buffer, count);
+
+        flowCheck();
+        return bytesRead;
+    }
+
+
+    //--------------------------------------------------------
+    // How many bytes are waiting in the rxBuffer?
+    //--------------------------------------------------------
+    static uint16_t available() {
+        return cBufferAvailable(Data::rx());
+    }
+
+
+    //--------------------------------------------------------
+    // Any errors in the USART receiver?
+    //--------------------------------------------------------
+    static uint8_t error() {
+        return Data::rx()->lastError;
+    }
+
+
+    //--------------------------------------------------------
+    // Take a consistent copy of the statistics. The ISRs
+    // can't update them while we do, and the 16 and 32 bit
+    // counters need more than one instruction to copy. If
+    // "reset" is true, start counting again.
+    //--------------------------------------------------------
+    static void stats(USARTStatsStruct *stats, bool reset = false) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            *stats = *(const USARTStatsStruct *)&State::stats;
+
+            if (reset)
+                memset((void *)&State::stats, 0, sizeof(State::stats));
+        }
+    }
+
+
+    //--------------------------------------------------------
+    // Line mode. The RX ISR does the editing as each byte
+    // arrives, so the rxBuffer only ever holds complete lines,
+    // ending in '\n', plus the line being typed. CR, LF and
+    // CR/LF all end a line. Backspace and DEL take back the
+    // last byte typed, if it's still in the current line. With
+    // "echo" on, what's typed is sent back, so a terminal user
+    // can see it.
+    //
+    // Turning line mode on or off empties the rxBuffer. Don't
+    // mix readLine() with readByte() or readBytes().
+    //--------------------------------------------------------
+    static void lineMode(bool enable, bool echo = true) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            cBufferInit(Data::rx());
+            cBufferSetPolicy(Data::rx(), USART_RX_OVERFLOW_POLICY);
+
+            State::line.ready = 0;
+            State::line.length = 0;
+            State::line.lastWasCR = false;
+            State::line.echo = echo;
+            State::line.enabled = enable;
+        }
+
+        flowCheck();
+    }
+
+
+    //--------------------------------------------------------
+    // How many complete lines are waiting? The main loop can
+    // sleep until this is non-zero, rather than poll every
+    // byte.
+    //--------------------------------------------------------
+    static uint8_t lineReady() {
+        return State::line.ready;
+    }
+
+
+    //--------------------------------------------------------
+    // Read the next complete line into "buffer", without the
+    // '\n', and terminated with a zero. A line too long for
+    // "buffer" is cut short, and the rest thrown away. Returns
+    // the length, or -1 if no line is ready yet.
+    //--------------------------------------------------------
+    static int readLine(char *buffer, uint8_t size) {
+        if (!State::line.ready || !size)
+            return -1;
+
+        uint8_t length = 0;
+        int aByte;
+
+        while ((aByte = cBufferGet(Data::rx())) != -1 && aByte != '\n') {
+            if (length < size - 1)
+                buffer[length++] = aByte;
+        }
+
+        buffer[length] = 0;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            State::line.ready--;
+        }
+
+        flowCheck();
+        return length;
+    }
+
+
+    //--------------------------------------------------------
+    // RX flow control. "mode" is one of USART_FLOW_xxx. The
+    // other end is told to stop when the rxBuffer holds
+    // "high" bytes, and to start again when it's down to
+    // "low". Anything that reads the rxBuffer directly, with
+    // cBufferRead() etc, must call flowCheck() afterwards.
+    //--------------------------------------------------------
+    static void flowControl(uint8_t mode, uint16_t high, uint16_t low) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            State::flow.mode = mode;
+            State::flow.high = high;
+            State::flow.low = low;
+            State::flow.pending = 0;
+            State::flow.stopped = false;
+
+            if (mode == USART_FLOW_RTS)
+                Rts::init();
+        }
+    }
+
+
+    //--------------------------------------------------------
+    // If the other end was told to stop, and the rxBuffer has
+    // drained to the low watermark, tell it to start again.
+    //--------------------------------------------------------
+    static void flowCheck() {
+        if (!State::flow.stopped)
+            return;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (State::flow.stopped &&
+                cBufferAvailable(Data::rx()) <= State::flow.low) {
+                State::flow.stopped = false;
+                flowSignal(false);
+            }
+        }
+    }
+
+
+    //--------------------------------------------------------
+    // The body of the Data Register Empty ISR. Copy next byte
+    // to be sent from the txBuffer to UDRn. Will disable the
+    // interrupt when we run out of bytes.
+    //--------------------------------------------------------
+    static void udreInterrupt() {
+        // XON or XOFF go first, then a send() descriptor if
+        // it's next in line, otherwise the txBuffer.
+        int aByte = State::flow.pending;
+        if (aByte)
+            State::flow.pending = 0;
+        else if ((aByte = txQueueGet()) == -1)
+            // Grab next byte from txBuffer for transmission.
+            aByte = cBufferGet(Data::tx());
+
+        // Is txBuffer empty? Will be -1 if so.
+        if (aByte != -1) {
+            Reg::udr() = aByte;
+            State::stats.txBytes++;
+        } else {
+            // txBuffer is empty, disable UDRE interrupt.
+            Reg::ucsrb() &= ~(1 << UDRIE0);
+        }
+
+        // Clear the TX Complete interrupt flag.
+        // The interrupt is unused but still sets the flag.
+        Reg::ucsra() |= (1 << TXC0);
+    }
+
+
+    //--------------------------------------------------------
+    // The body of the Receive Complete ISR. Copy data byte
+    // received to the rxBuffer. We must check for errors
+    // before reading the data from UDRn.
+    //--------------------------------------------------------
+    static void rxInterrupt() {
+        // Check for errors first.
+        uint8_t errors = Reg::ucsra() &
+                         ((1 << FE0) | (1 << DOR0) | (1 << UPE0));
+
+        // Read data from USART.
+        uint8_t aByte = Reg::udr();
+
+        // If no errors, add the byte to the RX buffer. If it's
+        // full, USART_RX_OVERFLOW_POLICY decides. (BUFFER_BLOCK
+        // just drops the byte, we can't wait in here.)
+        if (!errors && State::line.enabled) {
+            lineInterrupt(aByte);
+        } else if (!errors) {
+            if (cBufferAdd(Data::rx(), aByte) == ERR_BUFFER_OK) {
+                State::stats.rxBytes++;
+                rxStored();
+            } else {
+                State::stats.rxDropped++;
+            }
+        } else {
+            // Save the error bits in case the code is
+            // interested, and count them.
+            Data::rx()->lastError = errors;
+
+            if (errors & (1 << DOR0))
+                State::stats.overruns++;
+            if (errors & (1 << FE0))
+                State::stats.frameErrors++;
+            if (errors & (1 << UPE0))
+                State::stats.parityErrors++;
+        }
+    }
+
+private:
+    //--------------------------------------------------------
+    // Called from the UDRE ISR. Returns the next byte of the
+    // oldest send() descriptor, or -1 if there isn't one, or
+    // the txBuffer bytes queued before it haven't all gone
+    // yet. They have when the txBuffer's tailIndex reaches
+    // the headIndex it had when the descriptor was queued.
+    //--------------------------------------------------------
+    static inline int txQueueGet() {
+        volatile UsartTxQueue &queue = State::txQueue;
+
+        if (queue.head == queue.tail)
+            return -1;
+
+        volatile UsartTxDescriptor &entry =
+            queue.entries[queue.tail & (USART_TX_QUEUE_SIZE - 1)];
+
+        if (uint16_t(cBufferIndex(Data::tx()->tailIndex)) != entry.mark)
+            return -1;
+
+        const uint8_t *next = entry.data + queue.offset;
+        uint8_t aByte = (entry.flags & USART_TX_PROGMEM) ?
+                        pgm_read_byte(next) : *next;
+
+        if (++queue.offset == entry.length) {
+            queue.offset = 0;
+            queue.tail++;
+
+#ifdef USART_TX_DONE_IN_ISR
+            if (entry.done)
+                entry.done(entry.data);
+#endif
+        }
+
+        return aByte;
+    }
+
+
+    //--------------------------------------------------------
+    // Called from the RX ISR after every byte added to the
+    // rxBuffer. Tell the other end to stop if it's filling
+    // up.
+    //--------------------------------------------------------
+    static inline void rxStored() {
+        uint16_t used = cBufferAvailable(Data::rx());
+        if (used > State::stats.rxHighWater)
+            State::stats.rxHighWater = used;
+
+        if (State::flow.mode && !State::flow.stopped &&
+            used >= State::flow.high) {
+            State::flow.stopped = true;
+            State::stats.flowStops++;
+            flowSignal(true);
+        }
+    }
+
+
+    //--------------------------------------------------------
+    // Tell the other end to stop, or start, sending. Always
+    // called with interrupts off. XON and XOFF jump the
+    // txBuffer queue, via the UDRE ISR.
+    //--------------------------------------------------------
+    static inline void flowSignal(bool stop) {
+        if (State::flow.mode == USART_FLOW_RTS) {
+            Rts::stop(stop);
+        } else {
+            State::flow.pending = stop ? USART_XOFF : USART_XON;
+            Reg::ucsrb() |= (1 << UDRIE0);
+        }
+    }
+
+
+    //--------------------------------------------------------
+    // Line mode, called from the RX ISR. Ordinary bytes only
+    // go in if there's room left for the '\n' after them.
+    //--------------------------------------------------------
+    static inline void lineInterrupt(uint8_t aByte) {
+        volatile UsartLineStruct &line = State::line;
+
+        if (aByte == '\r' || aByte == '\n') {
+            // The LF of a CR/LF pair, already dealt with.
+            bool skip = (aByte == '\n' && line.lastWasCR);
+            line.lastWasCR = (aByte == '\r');
+            if (skip)
+                return;
+
+            if (cBufferAdd(Data::rx(), '\n', BUFFER_DROP_NEWEST) !=
+                ERR_BUFFER_OK) {
+                State::stats.rxDropped++;
+                return;
+            }
+
+            State::stats.rxBytes++;
+            line.ready++;
+            line.length = 0;
+            rxStored();
+            lineEcho('\r');
+            lineEcho('\n');
+            return;
+        }
+
+        line.lastWasCR = false;
+
+        if (aByte == '\b' || aByte == 0x7F) {
+            // Rub out the last byte on the terminal too.
+            if (line.length && cBufferDropLast(Data::rx()) == ERR_BUFFER_OK) {
+                line.length--;
+                lineEcho('\b');
+                lineEcho(' ');
+                lineEcho('\b');
+            }
+            return;
+        }
+
+        if (cBufferFree(Data::rx()) > 1 &&
+            cBufferAdd(Data::rx(), aByte, BUFFER_DROP_NEWEST) ==
+            ERR_BUFFER_OK) {
+            State::stats.rxBytes++;
+            line.length++;
+            lineEcho(aByte);
+            rxStored();
+        } else {
+            State::stats.rxDropped++;
+        }
+    }
+
+
+    //--------------------------------------------------------
+    // Echo a byte, if echo is on. Never waits, we're in the
+    // RX ISR, so echo is lost if the txBuffer is full.
+    //--------------------------------------------------------
+    static inline void lineEcho(uint8_t ch) {
+        if (!State::line.echo)
+            return;
+
+        cBufferAdd(Data::tx(), ch, BUFFER_DROP_NEWEST);
+        Reg::ucsrb() |= (1 << UDRIE0);
+    }
+
+
+    static void tryPrintfOut(char ch, void *arg) {
+        tryPrintfState *state = (tryPrintfState *)arg;
+
+        if (state->stopped)
+            return;
+
+        if (tryPutChar(ch)) {
+            state->sent++;
+        } else if (Data::tx()->overflowPolicy != BUFFER_DROP_NEWEST) {
+            // Anything after this would be out of context.
+            state->stopped = true;
+        }
+    }
+};
+
+
+//------------------------------------------------------------
+// Define the two ISRs for Usart<N>. For example, on the
+// ATmega2560:
+//
+// USART_ISRS(1, USART1_RX_vect, USART1_UDRE_vect)
+//------------------------------------------------------------
+#define USART_ISRS(N, rxVector, udreVector) \
+    ISR(rxVector) { Usart<N>::rxInterrupt(); } \
+    ISR(udreVector) { Usart<N>::udreInterrupt(); }
+
+#endif // USART_H
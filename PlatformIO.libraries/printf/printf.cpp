@@ -95,6 +95,17 @@
 #define PRINTF_SUPPORT_PTRDIFF_T
 #endif
 
+// support for strings in flash (%S), as avr-libc's printf() has
+// the argument is a PGM_P, from PSTR() or a PROGMEM array
+// default: activated
+#ifndef PRINTF_DISABLE_SUPPORT_PROGMEM
+#define PRINTF_SUPPORT_PROGMEM
+#endif
+
+#if defined(PRINTF_SUPPORT_PROGMEM)
+#include <avr/pgmspace.h>
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 
 // internal flag definitions
@@ -176,6 +187,18 @@ static inline unsigned int _strnlen_s(const char* str, size_t maxsize)
 }
 
 
+#if defined(PRINTF_SUPPORT_PROGMEM)
+// internal secure strlen, for a string in flash
+// \return The length of the string (excluding the terminating 0) limited by 'maxsize'
+static inline unsigned int _strnlen_P(const char* str, size_t maxsize)
+{
+  const char* s;
+  for (s = str; pgm_read_byte(s) && maxsize--; ++s);
+  return (unsigned int)(s - str);
+}
+#endif
+
+
 // internal test if char is a digit (0-9)
 // \return true if char is a digit
 static inline bool _is_digit(char ch)
@@ -819,6 +842,36 @@ static int _vsnprintf(out_fct_type out, char* buffer, const size_t maxlen, const
         break;
       }
 
+#if defined(PRINTF_SUPPORT_PROGMEM)
+      case 'S' : {
+        const char* p = va_arg(va, const char*);
+        unsigned int l = _strnlen_P(p, precision ? precision : (size_t)-1);
+        char c;
+        // pre padding
+        if (flags & FLAGS_PRECISION) {
+          l = (l < precision ? l : precision);
+        }
+        if (!(flags & FLAGS_LEFT)) {
+          while (l++ < width) {
+            out(' ', buffer, idx++, maxlen);
+          }
+        }
+        // string output, a byte at a time from flash
+        while (((c = (char)pgm_read_byte(p)) != 0) && (!(flags & FLAGS_PRECISION) || precision--)) {
+          out(c, buffer, idx++, maxlen);
+          p++;
+        }
+        // post padding
+        if (flags & FLAGS_LEFT) {
+          while (l++ < width) {
+            out(' ', buffer, idx++, maxlen);
+          }
+        }
+        format++;
+        break;
+      }
+#endif
+
       case 'p' : {
         width = sizeof(void*) * 2U;
         flags |= FLAGS_ZEROPAD | FLAGS_UPPERCASE;
@@ -912,3 +965,10 @@ int fctprintf(void (*out)(char character, void* arg), void* arg, const char* for
   va_end(va);
   return ret;
 }
+
+
+int vfctprintf(void (*out)(char character, void* arg), void* arg, const char* format, va_list va)
+{
+  const out_fct_wrap_type out_fct_wrap = { out, arg };
+  return _vsnprintf(_out_fct, (char*)(uintptr_t)&out_fct_wrap, (size_t)-1, format, va);
+}
@@ -0,0 +1,527 @@
+#!/usr/bin/env python3
+#--------------------------------------------------------------
+# Counts the CPU cycles each interrupt handler takes, from the
+# avr-objdump listing of a project's firmware.elf, and checks
+# them against the budgets in isrBudget.txt.
+#
+# For each ISR, the count is the longest path from the vector
+# to RETI, with every instruction costed as in the AVR
+# instruction set manual for the ATmega328P:
+#
+#   Response  - 4 cycles to take the interrupt, and 3 for the
+#               JMP in the vector table.
+#   Prologue  - saving SREG and registers, the PUSHes etc.
+#   Body      - the code itself, with branches taken or not,
+#               whichever costs more, and called functions.
+#   Epilogue  - restoring them, the POPs, and RETI.
+#
+# It's a static count, so:
+#
+#   * A loop is counted once around, from where it starts back
+#     to there, plus the way out, and marked "loop". One that
+#     goes round more often than that costs more.
+#   * A switch compiled to a jump table is counted as its most
+#     expensive case, marked "table".
+#   * A call through a pointer, ICALL, such as a callback,
+#     costs the ICALL, but not what it calls, marked "pointer".
+#
+# Usage, from anywhere:
+#
+#   tools/isrCycles.py                  Every project in the
+#                                       budget file, already
+#                                       built with "pio run".
+#   tools/isrCycles.py --build          Build them first.
+#   tools/isrCycles.py 05_PinChange/PlatformIO/AVR_PinChange_CHANGE
+#                                       Just that one.
+#   tools/isrCycles.py --listing firmware.lst PROJECT
+#                                       Use a saved listing.
+#   tools/isrCycles.py --update         Record every count as
+#                                       measured.
+#
+# The AVR_OBJDUMP environment variable overrides the
+# avr-objdump that PlatformIO installs. Exits with 1 if any
+# vector is over budget, hasn't been measured, or can't be
+# counted, 2 if something couldn't be run.
+#
+# tools/tests/isrCyclesTest.py checks the counts against
+# listings worked out by hand.
+#--------------------------------------------------------------
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(TOOLS)
+
+# Taking the interrupt, and the JMP in the vector table.
+RESPONSE_CYCLES = 4 + 3
+
+# ATmega328P vector numbers, from the data sheet.
+VECTORS = {
+    "INT0_vect": 1, "INT1_vect": 2, "PCINT0_vect": 3,
+    "PCINT1_vect": 4, "PCINT2_vect": 5, "WDT_vect": 6,
+    "TIMER2_COMPA_vect": 7, "TIMER2_COMPB_vect": 8,
+    "TIMER2_OVF_vect": 9, "TIMER1_CAPT_vect": 10,
+    "TIMER1_COMPA_vect": 11, "TIMER1_COMPB_vect": 12,
+    "TIMER1_OVF_vect": 13, "TIMER0_COMPA_vect": 14,
+    "TIMER0_COMPB_vect": 15, "TIMER0_OVF_vect": 16,
+    "SPI_STC_vect": 17, "USART_RX_vect": 18, "USART_UDRE_vect": 19,
+    "USART_TX_vect": 20, "ADC_vect": 21, "EE_READY_vect": 22,
+    "ANALOG_COMP_vect": 23, "TWI_vect": 24, "SPM_READY_vect": 25,
+}
+
+# Cycles for everything that doesn't branch. Anything not here,
+# or below, stops the count, rather than guessing.
+CYCLES = {
+    1: "add adc sub subi sbc sbci and andi or ori eor com neg sbr cbr "
+       "inc dec tst clr ser cp cpc cpi mov movw ldi in out lsl lsr rol "
+       "ror asr swap bst bld nop sleep wdr "
+       "sec clc sen cln sez clz sei cli ses cls sev clv set clt seh clh "
+       "bset bclr",
+    2: "adiw sbiw mul muls mulsu fmul fmuls fmulsu ld ldd lds st std sts "
+       "push pop sbi cbi",
+    3: "lpm elpm",
+}
+CYCLES = {op: n for n, ops in CYCLES.items() for op in ops.split()}
+
+BRANCHES = set("breq brne brcs brcc brsh brlo brmi brpl brge brlt brhs "
+               "brhc brts brtc brvs brvc brie brid brbs brbc".split())
+SKIPS = set("cpse sbrc sbrs sbic sbis".split())
+JUMPS = {"rjmp": 2, "jmp": 3}
+CALLS = {"rcall": 3, "call": 4}
+RETURNS = {"ret": 4, "reti": 4}
+
+# SREG, and the RAMP and EIND registers, which the prologue
+# saves, as I/O addresses.
+SAVED_IO = {"0x3f", "0x38", "0x39", "0x3a", "0x3b", "0x3c"}
+
+SYMBOL = re.compile(r"^([0-9a-f]+) <([^>]+)>:$")
+INSTRUCTION = re.compile(
+    r"^\s*([0-9a-f]+):\s+((?:[0-9a-f]{2} )+)\s*([a-z]+)\s*([^;]*?)\s*"
+    r"(?:;\s*(?:0x([0-9a-f]+))?.*)?$")
+
+
+class Instruction:
+    def __init__(self, address, size, op, operands, target, symbol):
+        self.address = address
+        self.size = size
+        self.op = op
+        self.operands = operands
+        self.target = target
+        self.symbol = symbol
+
+    def text(self):
+        return "%x: %s %s" % (self.address, self.op, self.operands)
+
+
+#--------------------------------------------------------------
+# Everything avr-objdump -d disassembled, by address, and the
+# address of each symbol.
+#--------------------------------------------------------------
+def parseListing(lines):
+    code = {}
+    symbols = {}
+    symbol = None
+
+    for line in lines:
+        line = line.rstrip()
+        found = SYMBOL.match(line)
+        if found:
+            symbol = found.group(2)
+            symbols[symbol] = int(found.group(1), 16)
+            continue
+
+        found = INSTRUCTION.match(line)
+        if not found or symbol is None:
+            continue
+
+        address = int(found.group(1), 16)
+        size = len(found.group(2).split()) // 2
+        target = int(found.group(5), 16) if found.group(5) else None
+        code[address] = Instruction(address, size, found.group(3),
+                                    found.group(4), target, symbol)
+
+    return code, symbols
+
+
+class CountError(Exception):
+    pass
+
+
+#--------------------------------------------------------------
+# The longest path, in cycles, from an address to the RET or
+# RETI that ends its function, and what got in the way of an
+# exact count.
+#--------------------------------------------------------------
+class Counter:
+    def __init__(self, code, symbols):
+        self.code = code
+        self.symbols = symbols
+        self.worst = {}
+        self.active = set()
+        self.notes = set()
+
+    def at(self, address, after):
+        if address not in self.code:
+            raise CountError("no instruction at %x%s" %
+                             (address, ", after " + after.text()
+                              if after else ""))
+        return self.code[address]
+
+    # Where a jump table can go: anywhere in the function that
+    # only a jump could reach, i.e. just after an unconditional
+    # jump or a return.
+    def tableTargets(self, symbol):
+        addresses = sorted(a for a, i in self.code.items()
+                           if i.symbol == symbol)
+        targets = []
+        for previous, address in zip(addresses, addresses[1:]):
+            op = self.code[previous].op
+            if op in JUMPS or op in RETURNS or op in ("ijmp", "eijmp"):
+                targets.append(address)
+        return targets
+
+    def isTable(self, insn):
+        if insn.target is None or insn.target not in self.code:
+            return False
+        return self.code[insn.target].symbol.startswith("__tablejump")
+
+    # A jump table, through __tablejump2__, or an IJMP.
+    def table(self, insn, cycles):
+        self.notes.add("table")
+        targets = self.tableTargets(insn.symbol)
+        if not targets:
+            raise CountError("can't find the cases for %s" % insn.text())
+
+        if insn.op in ("ijmp", "eijmp"):
+            table = 0
+        else:
+            # Through __tablejump2__, which ends in an IJMP.
+            table = cycles + self.straight(insn.target, insn)
+
+        return plus(table, longest(*(self.path(t, insn) for t in targets)))
+
+    # The instructions of __tablejump2__, up to its IJMP.
+    def straight(self, address, after):
+        total = 0
+        while True:
+            insn = self.at(address, after)
+            if insn.op in ("ijmp", "eijmp"):
+                return total + 2
+            total += self.cost(insn)
+            address += 2 * insn.size
+
+    def cost(self, insn):
+        if insn.op not in CYCLES:
+            raise CountError("don't know how long %s takes" % insn.text())
+        return CYCLES[insn.op]
+
+    # The longest paths on from an address, as a dict. Under
+    # None, to the RET or RETI that ends the function. Under a
+    # loop's address, to the jump or branch back to it, for
+    # the loop to add once round.
+    def path(self, address, after=None):
+        if address in self.worst:
+            return self.worst[address]
+        if address in self.active:
+            # Back round a loop, costed where it starts.
+            self.notes.add("loop")
+            return {address: 0}
+
+        self.active.add(address)
+        try:
+            insn = self.at(address, after)
+            paths = self.step(insn)
+        finally:
+            self.active.discard(address)
+
+        if address in paths:
+            # Once round the loop, and then any way on from here.
+            once = paths.pop(address)
+            paths = {end: once + cycles for end, cycles in paths.items()}
+
+        self.worst[address] = paths
+        return paths
+
+    # A function called, which must get to its RET.
+    def call(self, address, after):
+        if address in self.active:
+            raise CountError("can't count recursion, at %s" % after.text())
+        paths = self.path(address, after)
+        if None not in paths:
+            raise CountError("%x never returns" % address)
+        return paths[None]
+
+    def step(self, insn):
+        op = insn.op
+        following = insn.address + 2 * insn.size
+
+        if op in RETURNS:
+            return {None: RETURNS[op]}
+
+        if op in BRANCHES:
+            return longest(plus(1, self.path(following, insn)),
+                           plus(2, self.path(insn.target, insn)))
+
+        if op in SKIPS:
+            skipped = self.at(following, insn)
+            over = following + 2 * skipped.size
+            return longest(plus(1, self.path(following, insn)),
+                           plus(1 + skipped.size, self.path(over, insn)))
+
+        if op in JUMPS:
+            if self.isTable(insn):
+                return self.table(insn, JUMPS[op])
+            return plus(JUMPS[op], self.path(insn.target, insn))
+
+        if op in CALLS:
+            if self.isTable(insn):
+                return self.table(insn, CALLS[op])
+            return plus(CALLS[op] + self.call(insn.target, insn),
+                        self.path(following, insn))
+
+        if op in ("ijmp", "eijmp"):
+            return self.table(insn, 0)
+
+        if op in ("icall", "eicall"):
+            self.notes.add("pointer")
+            return plus(3, self.path(following, insn))
+
+        return plus(self.cost(insn), self.path(following, insn))
+
+
+# Every path in "paths", "cycles" longer.
+def plus(cycles, paths):
+    return {end: cycles + total for end, total in paths.items()}
+
+
+# The longer of each path, where the choices go to the same end.
+def longest(*choices):
+    paths = {}
+    for choice in choices:
+        for end, total in choice.items():
+            paths[end] = max(total, paths.get(end, total))
+    return paths
+
+
+#--------------------------------------------------------------
+# The cycles for one vector, split up as the budget file's
+# header describes, and the notes.
+#--------------------------------------------------------------
+def countVector(code, symbols, vector):
+    name = "__vector_%d" % VECTORS[vector]
+    if name not in symbols:
+        raise CountError("%s, %s, isn't in the listing" % (vector, name))
+
+    counter = Counter(code, symbols)
+    start = symbols[name]
+    total = counter.call(start, None)
+
+    # The prologue is the saves at the start.
+    prologue = 0
+    address = start
+    while address in code:
+        insn = code[address]
+        saving = (insn.op == "push" or
+                  (insn.op == "in" and
+                   insn.operands.split(",")[-1].strip() in SAVED_IO) or
+                  (insn.op in ("eor", "clr") and
+                   insn.operands.replace(" ", "") in ("r1,r1", "r1")))
+        if not saving:
+            break
+        prologue += counter.cost(insn)
+        address += 2 * insn.size
+
+    # The epilogue, the most expensive run of restores before a
+    # RETI in this function.
+    epilogue = 0
+    for insn in code.values():
+        if insn.symbol != name or insn.op != "reti":
+            continue
+        cycles = RETURNS["reti"]
+        address = insn.address - 2
+        while address in code and code[address].symbol == name:
+            before = code[address]
+            restoring = (before.op == "pop" or
+                         (before.op == "out" and
+                          before.operands.split(",")[0].strip() in SAVED_IO))
+            if not restoring:
+                break
+            cycles += counter.cost(before)
+            address -= 2
+        epilogue = max(epilogue, cycles)
+
+    body = total - prologue - epilogue
+    return {
+        "response": RESPONSE_CYCLES,
+        "prologue": prologue,
+        "body": body,
+        "epilogue": epilogue,
+        "total": RESPONSE_CYCLES + total,
+        "notes": sorted(counter.notes),
+    }
+
+
+#--------------------------------------------------------------
+# The budget file, a project, a vector, the measured count, or
+# "-" if it hasn't been, and the margin to a line, in order, so
+# --update can keep it that way.
+#--------------------------------------------------------------
+def readBudgets(path):
+    budgets = []
+    with open(path) as budgetFile:
+        for number, line in enumerate(budgetFile, 1):
+            fields = line.split("#")[0].split()
+            if not fields:
+                continue
+            if len(fields) != 4 or fields[1] not in VECTORS or \
+                    not (fields[2].isdigit() or fields[2] == "-") or \
+                    not (fields[3].endswith("%") and
+                         fields[3][:-1].isdigit()):
+                sys.exit("%s:%d: should be PROJECT VECTOR MEASURED MARGIN%%" %
+                         (path, number))
+            measured = int(fields[2]) if fields[2] != "-" else None
+            budgets.append((fields[0], fields[1], measured,
+                            int(fields[3][:-1])))
+    return budgets
+
+
+# The measured count, plus the margin, rounded up.
+def budgetFor(measured, margin):
+    return measured + (measured * margin + 99) // 100
+
+
+def writeBudgets(path, budgets):
+    with open(path) as budgetFile:
+        header = []
+        for line in budgetFile:
+            if line.split("#")[0].strip():
+                break
+            header.append(line)
+
+    width = max(len(project) for project, _, _, _ in budgets) + 3
+    with open(path, "w") as budgetFile:
+        budgetFile.writelines(header)
+        for project, vector, measured, margin in budgets:
+            budgetFile.write("%-*s%-20s%-10s%d%%\n" %
+                             (width, project, vector,
+                              "-" if measured is None else measured,
+                              margin))
+
+
+def objdump():
+    if "AVR_OBJDUMP" in os.environ:
+        return os.environ["AVR_OBJDUMP"]
+
+    platformio = os.path.join(os.path.expanduser("~"), ".platformio",
+                              "packages", "toolchain-atmelavr", "bin",
+                              "avr-objdump")
+    return platformio if os.path.exists(platformio) else "avr-objdump"
+
+
+def listing(project, args):
+    if args.listing:
+        with open(args.listing) as listingFile:
+            return listingFile.readlines()
+
+    directory = os.path.join(ROOT, project)
+    if args.build:
+        subprocess.check_call(["pio", "run", "-d", directory,
+                               "-e", args.env])
+
+    elf = os.path.join(directory, ".pio", "build", args.env, "firmware.elf")
+    if not os.path.exists(elf):
+        raise OSError("No %s, build it, or use --build." % elf)
+
+    return subprocess.check_output([objdump(), "-d", elf],
+                                   universal_newlines=True).splitlines()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Count ISR cycles, and check them against budgets.")
+    parser.add_argument("projects", nargs="*",
+                        help="projects to check, from the top of the "
+                             "repository, default all in the budget file")
+    parser.add_argument("--budget", default=os.path.join(TOOLS,
+                                                         "isrBudget.txt"))
+    parser.add_argument("--build", action="store_true",
+                        help="run pio run on each project first")
+    parser.add_argument("--env", default="uno",
+                        help="the platformio.ini environment, default uno")
+    parser.add_argument("--listing",
+                        help="an avr-objdump -d listing, for one project")
+    parser.add_argument("--update", action="store_true",
+                        help="record each count as the measured one")
+    args = parser.parse_args()
+
+    budgets = readBudgets(args.budget)
+    projects = [p.rstrip("/") for p in args.projects]
+    if args.listing and len(projects) != 1:
+        sys.exit("--listing needs just the one project")
+
+    chosen = [b for b in budgets if not projects or b[0] in projects]
+    if not chosen:
+        sys.exit("nothing in %s for %s" % (args.budget, " ".join(projects)))
+
+    failed = 0
+    updated = {}
+    current = None
+
+    width = max([len("Project")] + [len(b[0]) for b in chosen])
+    print("%-*s %-18s %5s %5s %5s %5s %6s %6s" %
+          (width, "Project", "Vector", "Resp", "Pro", "Body", "Epi",
+           "Total", "Budget"))
+
+    for project, vector, measured, margin in chosen:
+        try:
+            if project != current:
+                current = project
+                code, symbols = parseListing(listing(project, args))
+            count = countVector(code, symbols, vector)
+        except CountError as e:
+            print("%-*s %-18s FAIL: %s" % (width, project, vector, e))
+            failed += 1
+            continue
+
+        updated[(project, vector)] = count["total"]
+        if measured is None:
+            budget = "-"
+            verdict = "NOT MEASURED"
+        else:
+            budget = budgetFor(measured, margin)
+            verdict = "OVER" if count["total"] > budget else ""
+        failed += verdict != ""
+
+        print("%-*s %-18s %5d %5d %5d %5d %6d %6s %s" %
+              (width, project, vector, count["response"], count["prologue"],
+               count["body"], count["epilogue"], count["total"], budget,
+               " ".join([verdict] + count["notes"]).strip()))
+
+    if args.update:
+        writeBudgets(args.budget,
+                     [(p, v, updated.get((p, v), m), margin)
+                      for p, v, m, margin in budgets])
+        print("Updated %s." % args.budget)
+        return 0
+
+    if failed:
+        print("%d over budget, not measured, or not counted." % failed)
+        return 1
+
+    print("All within budget.")
+    return 0
+
+
+if __name__ == "__main__":
+    # One level per instruction, along the longest path.
+    sys.setrecursionlimit(20000)
+
+    try:
+        sys.exit(main())
+    except (OSError, subprocess.CalledProcessError) as e:
+        print(e, file=sys.stderr)
+        sys.exit(2)
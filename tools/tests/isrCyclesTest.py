@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+#--------------------------------------------------------------
+# Checks isrCycles.py's counts against the hand-made listings
+# here, each worked out by hand from the instruction set
+# manual. Run it after changing how isrCycles.py counts:
+#
+#   tools/tests/isrCyclesTest.py
+#
+# Exits with 1 if any count is wrong.
+#--------------------------------------------------------------
+
+import os
+import sys
+
+TESTS = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(TESTS))
+
+import isrCycles
+
+# Listing, vector, then prologue, body, epilogue and total, and
+# the notes, or the start of the error that stops the count.
+EXPECTED = [
+    # SBI, and nothing else.
+    ("sample.lst", "PCINT2_vect", (8, 2, 11, 28, [])),
+    # A call to a function with a delay loop, going round once
+    # and out, and an ICALL it may skip.
+    ("sample.lst", "ADC_vect", (10, 24, 13, 54, ["loop", "pointer"])),
+    # A switch through __tablejump2__, with a skip in a case.
+    ("sample.lst", "TWI_vect", (2, 22, 6, 37, ["table"])),
+    # RJMP to a test at the bottom, then DEC and BRNE back over
+    # two NOPs, then ten NOPs. Once round is the DEC, the BRNE
+    # taken and the NOPs, 5 cycles, then the DEC, the BRNE not
+    # taken and the ten NOPs on the way out, 12, and the RJMP.
+    ("loop.lst", "PCINT2_vect", (10, 19, 13, 49, ["loop"])),
+    # A loop inside a loop, each once round, the inner one once
+    # round each time the outer one is.
+    ("loop.lst", "ADC_vect", (4, 22, 8, 41, ["loop"])),
+    # A function that calls itself.
+    ("loop.lst", "TWI_vect", "can't count recursion"),
+]
+
+
+def main():
+    failed = 0
+    listings = {}
+
+    for name, vector, expected in EXPECTED:
+        if name not in listings:
+            with open(os.path.join(TESTS, name)) as listingFile:
+                listings[name] = isrCycles.parseListing(listingFile)
+        code, symbols = listings[name]
+
+        try:
+            count = isrCycles.countVector(code, symbols, vector)
+            got = (count["prologue"], count["body"], count["epilogue"],
+                   count["total"], count["notes"])
+        except isrCycles.CountError as e:
+            got = str(e)
+
+        if isinstance(expected, str):
+            ok = isinstance(got, str) and got.startswith(expected)
+        else:
+            ok = got == expected
+
+        if not ok:
+            print("%s %s: expected %s, got %s" % (name, vector, expected, got))
+            failed += 1
+
+    if isrCycles.budgetFor(49, 10) != 54 or isrCycles.budgetFor(50, 10) != 55:
+        print("budgetFor() doesn't round the margin up")
+        failed += 1
+
+    if failed:
+        print("%d wrong." % failed)
+        return 1
+
+    print("All %d counts right." % len(EXPECTED))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.setrecursionlimit(20000)
+    sys.exit(main())